@@ -0,0 +1,146 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file aamux.c A/A-Mux bus engine
+ *
+ * The parallel programming interface of FWH/LPC parts. Each access latches a
+ * row address, A[10:0] of the chip, on the falling edge of R/#C, and a column
+ * address, the bits above those, on the rising edge. The data then moves over
+ * DQ[7:0] with #OE or #WE, a byte at a time rather than a nibble per clock.
+ *
+ * aamux_read() and aamux_write() take the same addresses as lpc_mread() and
+ * lpc_mwrite(), so the JEDEC layer works on either engine. Bits of the address
+ * above the chip are not seen by the chip, so the top of the 4 GiB space is
+ * still the top of the chip. Unlike LPC, there is no ID decoding, so only one
+ * chip can sit on the bus.
+ *
+ * See aamux_pins.h for the pins. lpc_init() must have run first, as it sets up
+ * the ports.
+ */
+
+#include "aamux.h"
+#include "aamux_pins.h"
+#include "stellaris.h"
+
+#include <timebase.h>
+
+/*
+ * Loops of pin_delay() between edges. The parts want around 100ns for address
+ * setup and hold, output enable and write pulses. Every loop takes at least a
+ * core clock, so this errs on the slow side.
+ */
+static uint8_t edge_loops = 1;
+
+/**
+ * @brief Work out the delays for the new core clock
+ */
+void aamux_set_clock(uint32_t core_hz)
+{
+	edge_loops = core_hz / 10000000 + 1;
+}
+
+/**
+ * @brief Put the chip in A/A-Mux mode
+ *
+ * The chip only looks at MODE as it comes out of reset, so it is reset here.
+ * lpc_init() puts it back in LPC mode.
+ */
+void aamux_init(void)
+{
+	gpio_clear(CTLPORT, RSTPIN);
+
+	gpio_mode_setup(DQPORT, GPIO_MODE_INPUT, GPIO_PUPD_PULLUP, DQPINS);
+	gpio_set_output_config(DQPORT, GPIO_OTYPE_PP, GPIO_DRIVE_8MA, DQPINS);
+
+	gpio_mode_setup(ALOPORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, ALOPINS);
+	gpio_set_output_config(ALOPORT, GPIO_OTYPE_PP, GPIO_DRIVE_2MA, ALOPINS);
+	gpio_mode_setup(AMIDPORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, AMIDPINS);
+	gpio_set_output_config(AMIDPORT, GPIO_OTYPE_PP, GPIO_DRIVE_2MA,
+			       AMIDPINS);
+	gpio_mode_setup(AHIPORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, AHIPINS);
+	gpio_set_output_config(AHIPORT, GPIO_OTYPE_PP, GPIO_DRIVE_2MA, AHIPINS);
+
+	gpio_mode_setup(OEPORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, OEPIN);
+	gpio_set_output_config(OEPORT, GPIO_OTYPE_PP, GPIO_DRIVE_2MA, OEPIN);
+
+	/* R/#C and #WE were set up as CLK and #LFRAME. Idle them high. */
+	oe_high();
+	we_high();
+	rc_high();
+
+	aamux_set_clock(stellaris_core_hz());
+
+	/* MODE is sampled on the rising edge of #RST */
+	gpio_set(CTLPORT, MODEPIN);
+	timebase_delay_us(10);
+	gpio_set(CTLPORT, RSTPIN);
+	timebase_delay_us(10);
+}
+
+/**
+ * @brief Latch the row, then the column address
+ */
+static inline void aamux_latch(uint32_t addr)
+{
+	addr_write(addr & AAMUX_ADDR_MASK);
+	pin_delay(edge_loops);
+	rc_low();
+	pin_delay(edge_loops);
+
+	addr_write((addr >> AAMUX_ADDR_BITS) & AAMUX_ADDR_MASK);
+	pin_delay(edge_loops);
+	rc_high();
+	pin_delay(edge_loops);
+}
+
+/**
+ * @brief Do an A/A-Mux read cycle
+ */
+qiprog_err aamux_read(uint32_t addr, uint8_t * val8)
+{
+	aamux_latch(addr);
+
+	oe_low();
+	pin_delay(edge_loops);
+	*val8 = dq_read();
+	oe_high();
+	/* Let the chip release DQ before anyone drives it */
+	pin_delay(edge_loops);
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Do an A/A-Mux write cycle
+ */
+qiprog_err aamux_write(uint32_t addr, uint8_t data)
+{
+	aamux_latch(addr);
+
+	dq_write(data);
+	dq_mode_out();
+	we_low();
+	pin_delay(edge_loops);
+	we_high();
+	pin_delay(edge_loops);
+	dq_mode_in();
+
+	return QIPROG_SUCCESS;
+}
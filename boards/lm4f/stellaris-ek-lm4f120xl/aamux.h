@@ -0,0 +1,31 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AAMUX_H
+#define AAMUX_H
+
+#include <qiprog.h>
+#include <stdint.h>
+
+void aamux_init(void);
+void aamux_set_clock(uint32_t core_hz);
+qiprog_err aamux_read(uint32_t addr, uint8_t * val8);
+qiprog_err aamux_write(uint32_t addr, uint8_t data);
+
+#endif				/* AAMUX_H */
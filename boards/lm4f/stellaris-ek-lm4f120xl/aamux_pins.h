@@ -0,0 +1,175 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The pins of the A/A-Mux (address/address multiplexed) interface, and the
+ * primitives which drive them. FWH/LPC parts switch to this parallel
+ * programming interface when MODE is high as they come out of reset. The
+ * interface reuses the LPC pins where the chip does, and needs a few more:
+ *
+ *	A/A-Mux		LPC/FWH		Stellaris
+ *	DQ[3:0]		LAD[3:0]	PB[3:0]
+ *	DQ[7:4]		-		PB[7:4]
+ *	R/#C		CLK		PC5
+ *	#WE		#LFRAME		PD2
+ *	A[3:0]		ID[3:0]		PE[3:0]
+ *	A[5:4]		TBL#, WP#	PE[5:4]
+ *	A[7:6]		GPI[1:0]	PC[7:6]
+ *	A[8]		GPI[2]		PC4
+ *	A[9]		GPI[3]		PD3
+ *	A[10]		GPI[4]		PD6
+ *	#OE		INIT#		PA5
+ *	MODE		MODE		PA4
+ *	#RST		#RST		PA6
+ *
+ * RY/#BY is not used, as the JEDEC layer polls the status bits instead. On the
+ * Launchpad, PB[7:6] are tied to PD[1:0] through R9 and R10. PD[1:0] are left
+ * as inputs, so they do not get in the way of DQ[7:6].
+ */
+
+#ifndef AAMUX_PINS_H
+#define AAMUX_PINS_H
+
+#include "lpc_pins.h"
+
+#include <stdint.h>
+#include <libopencm3/lm4f/gpio.h>
+
+/* DQ[7:0] */
+#define DQPORT		GPIOB
+#define DQPINS		GPIO_ALL
+/* A[5:0] */
+#define ALOPORT		GPIOE
+#define ALOPINS		(GPIO0 | GPIO1 | GPIO2 | GPIO3 | GPIO4 | GPIO5)
+/* A[8:6] */
+#define AMIDPORT	GPIOC
+#define AMIDPINS	(GPIO4 | GPIO6 | GPIO7)
+/* A[10:9] */
+#define AHIPORT		GPIOD
+#define AHIPINS		(GPIO3 | GPIO6)
+/* #OE */
+#define OEPORT		GPIOA
+#define OEPIN		(GPIO5)
+/* R/#C and #WE are the LPC CLK and #LFRAME pins */
+#define RCPORT		CLKPORT
+#define RCPIN		CLKPIN
+#define WEPORT		LFPORT
+#define WEPIN		LFPIN
+
+/* Row and column addresses are this wide */
+#define AAMUX_ADDR_BITS	11
+#define AAMUX_ADDR_MASK	((1 << AAMUX_ADDR_BITS) - 1)
+
+/**
+ * @brief Switch DQ[7:0] pins to inputs
+ */
+static inline void dq_mode_in(void)
+{
+	GPIO_DIR(DQPORT) &= ~DQPINS;
+}
+
+/**
+ * @brief Switch DQ[7:0] pins to outputs
+ */
+static inline void dq_mode_out(void)
+{
+	GPIO_DIR(DQPORT) |= DQPINS;
+}
+
+/**
+ * @brief Write a byte on the DQ[7:0] pins
+ */
+static inline void dq_write(uint8_t data)
+{
+	gpio_write(DQPORT, DQPINS, data);
+}
+
+/**
+ * @brief Read a byte from the DQ[7:0] pins
+ */
+static inline uint8_t dq_read(void)
+{
+	/* Same input latching delay as lad_read() */
+	asm("nop"); asm("nop");asm("nop");asm("nop");
+	return gpio_read(DQPORT, DQPINS);
+}
+
+/**
+ * @brief Put a row or column address on A[10:0]
+ */
+static inline void addr_write(uint16_t addr)
+{
+	/* A[5:0] map straight to PE[5:0] */
+	gpio_write(ALOPORT, ALOPINS, addr);
+	/* A[7:6] to PC[7:6], and A[8] to PC4 */
+	gpio_write(AMIDPORT, AMIDPINS, (addr & 0xc0) | ((addr >> 4) & 0x10));
+	/* A[9] to PD3, and A[10] to PD6 */
+	gpio_write(AHIPORT, AHIPINS, ((addr >> 6) & 0x08) |
+		   ((addr >> 4) & 0x40));
+}
+
+/**
+ * @brief Set R/#C high, which latches the column address
+ */
+static inline void rc_high(void)
+{
+	gpio_set(RCPORT, RCPIN);
+}
+
+/**
+ * @brief Set R/#C low, which latches the row address
+ */
+static inline void rc_low(void)
+{
+	gpio_clear(RCPORT, RCPIN);
+}
+
+/**
+ * @brief De-assert #WE, which latches the data
+ */
+static inline void we_high(void)
+{
+	gpio_set(WEPORT, WEPIN);
+}
+
+/**
+ * @brief Assert #WE
+ */
+static inline void we_low(void)
+{
+	gpio_clear(WEPORT, WEPIN);
+}
+
+/**
+ * @brief De-assert #OE
+ */
+static inline void oe_high(void)
+{
+	gpio_set(OEPORT, OEPIN);
+}
+
+/**
+ * @brief Assert #OE, so the chip drives DQ[7:0]
+ */
+static inline void oe_low(void)
+{
+	gpio_clear(OEPORT, OEPIN);
+}
+
+#endif				/* AAMUX_PINS_H */
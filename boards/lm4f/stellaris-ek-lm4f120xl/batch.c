@@ -0,0 +1,179 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file batch.c Lists of register accesses, done back to back
+ *
+ * Every read8() or write8() from the host is its own control transfer, which
+ * costs a frame or so. Probing, setting up block lock registers or unlocking a
+ * chip takes dozens of them. Instead, the host can send a list of reads and
+ * writes in one transfer, and get all the values read in one response.
+ *
+ * Each op is a header byte, the address as a 32-bit word, and for writes, the
+ * value. The low two bits of the header are log2 of the width, and bit 7 is
+ * set for writes. Addresses are those of read8() and write8(), and values are
+ * little-endian.
+ *
+ * Like checksums, lists come in from the USB interrupt, and are done from the
+ * main loop once pending jobs have finished.
+ */
+
+#include "stellaris.h"
+
+#include <blackbox.h>
+#include <byteorder.h>
+#include <string.h>
+
+#define BATCH_MAX		256
+/* State, error, and number of ops done, before the values read */
+#define BATCH_HEADER		12
+
+#define BATCH_OP_WRITE		(1 << 7)
+#define BATCH_OP_WIDTH_MASK	0x03
+
+static struct {
+	volatile enum batch_state state;
+	qiprog_err error;
+	uint16_t len;
+	uint16_t ops_done;
+	uint16_t result_len;
+} batch;
+
+static uint8_t ops_buf[BATCH_MAX];
+static uint8_t result_buf[BATCH_HEADER + BATCH_MAX];
+
+/* Size of the op at 'op', or zero if it is not valid */
+static uint16_t op_size(const uint8_t *op)
+{
+	uint8_t width;
+
+	if (op[0] & ~(BATCH_OP_WRITE | BATCH_OP_WIDTH_MASK))
+		return 0;
+
+	width = 1 << (op[0] & BATCH_OP_WIDTH_MASK);
+	if (width > sizeof(uint32_t))
+		return 0;
+
+	return 1 + sizeof(uint32_t) + ((op[0] & BATCH_OP_WRITE) ? width : 0);
+}
+
+/**
+ * @brief Queue a list of reads and writes
+ *
+ * The list is checked here, so a bad list is refused before any of it is done.
+ * This may be called from an interrupt.
+ */
+qiprog_err batch_submit(const uint8_t *ops, uint16_t len)
+{
+	uint16_t pos, size;
+
+	if (batch.state == BATCH_BUSY)
+		return QIPROG_ERR;
+
+	if (!len || (len > BATCH_MAX))
+		return QIPROG_ERR_ARG;
+
+	for (pos = 0; pos < len; pos += size) {
+		size = op_size(ops + pos);
+		if (!size || (size > (len - pos)))
+			return QIPROG_ERR_ARG;
+	}
+
+	memcpy(ops_buf, ops, len);
+	batch.len = len;
+	batch.ops_done = 0;
+	batch.result_len = 0;
+	batch.error = QIPROG_SUCCESS;
+	batch.state = BATCH_BUSY;
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Is a list waiting to be done?
+ */
+bool batch_busy(void)
+{
+	return batch.state == BATCH_BUSY;
+}
+
+/**
+ * @brief Do the queued list, if there is one
+ *
+ * The whole list is done in one go, and stops at the first op which fails.
+ * Call this from the main loop.
+ */
+void batch_step(void)
+{
+	uint16_t pos, size;
+	uint8_t width, *result = result_buf + BATCH_HEADER;
+	const uint8_t *op;
+	qiprog_err ret;
+
+	if (batch.state != BATCH_BUSY)
+		return;
+
+	for (pos = 0; pos < batch.len; pos += size) {
+		op = ops_buf + pos;
+		size = op_size(op);
+		width = 1 << (op[0] & BATCH_OP_WIDTH_MASK);
+
+		if (op[0] & BATCH_OP_WRITE) {
+			ret = stellaris_bus_write(get_le32(op + 1), op + 5,
+						  width);
+		} else {
+			ret = stellaris_bus_read(get_le32(op + 1),
+						 result + batch.result_len,
+						 width);
+			batch.result_len += width;
+		}
+
+		if (ret != QIPROG_SUCCESS) {
+			print_err("Batch op %u failed\n", batch.ops_done);
+			batch.error = ret;
+			batch.state = BATCH_FAILED;
+			return;
+		}
+		batch.ops_done++;
+	}
+
+	batch.state = BATCH_DONE;
+}
+
+/**
+ * @brief Get the outcome of the last list
+ *
+ * The response holds the state, the error code and the number of ops done, as
+ * three 32-bit words, followed by the values read, in the order they were read.
+ * The values are only there once the list is done.
+ */
+const uint8_t *batch_get_result(uint16_t *len)
+{
+	const enum batch_state state = batch.state;
+
+	put_le32(result_buf + 0, state);
+	put_le32(result_buf + 4, batch.error);
+	put_le32(result_buf + 8, batch.ops_done);
+
+	*len = BATCH_HEADER;
+	if ((state == BATCH_DONE) || (state == BATCH_FAILED))
+		*len += batch.result_len;
+
+	return result_buf;
+}
@@ -0,0 +1,210 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file bench.c Cycles per byte of the bus primitives
+ *
+ * A fixed set of bus accesses is timed with the DWT cycle counter, so that
+ * changes to lpc_io.c or to the read path can be compared against a known
+ * baseline. tools/bench.py runs it, and flags any regression.
+ *
+ * The single-cycle primitives are timed with interrupts masked, so USB traffic
+ * does not end up in the count. Reading through stellaris_read() is timed as it
+ * runs normally. Writing is only timed with lpc_mwrite() of a reset command, as
+ * timing programming would change what is on the chip.
+ *
+ * Like checksums, a run is requested from the USB interrupt, and done from the
+ * main loop once pending jobs have finished.
+ */
+
+#include "stellaris.h"
+#include "lpc_io.h"
+
+#include <blackbox.h>
+#include <config.h>
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scs.h>
+
+/* Single cycles done for each of the primitives */
+#define BENCH_CYCLES		256
+/* Bytes read through stellaris_read(), in chunks of BENCH_CHUNK */
+#define BENCH_READ_SIZE		4096
+#define BENCH_CHUNK		256
+/*
+ * The top of the memory space. The boot chip decodes it no matter its size, so
+ * there is always something to answer.
+ */
+#define BENCH_ADDR		0xffffff00
+/* Read/reset command, which leaves the chip as it was */
+#define BENCH_WRITE_DATA	0xf0
+
+/* Describes how the firmware was built, as it changes the numbers */
+#define BENCH_FLAG_PROFILE	(1 << 0)
+#define BENCH_FLAG_WAVE		(1 << 1)
+
+static struct {
+	volatile enum bench_state state;
+	qiprog_err error;
+	uint32_t core_hz;
+	struct bench_result result[BENCH_NUM_METRICS];
+} bench;
+
+static uint8_t read_buf[BENCH_CHUNK];
+
+/**
+ * @brief Queue a benchmark run
+ *
+ * This may be called from an interrupt.
+ */
+qiprog_err bench_submit(void)
+{
+	if (bench.state == BENCH_BUSY)
+		return QIPROG_ERR;
+	/* The primitives we time belong to the LPC engine */
+	if (!stellaris_lpc_active())
+		return QIPROG_ERR;
+
+	bench.error = QIPROG_SUCCESS;
+	bench.state = BENCH_BUSY;
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Is a run waiting to be done?
+ */
+bool bench_busy(void)
+{
+	return bench.state == BENCH_BUSY;
+}
+
+static qiprog_err bench_mread(struct bench_result *res)
+{
+	uint32_t i, t_start, irq_mask;
+	uint8_t val;
+	qiprog_err ret = QIPROG_SUCCESS;
+
+	irq_mask = cm_mask_interrupts(1);
+	t_start = DWT_CYCCNT;
+	for (i = 0; i < BENCH_CYCLES; i++)
+		ret |= lpc_mread(BENCH_ADDR + i, &val);
+	res->cycles = DWT_CYCCNT - t_start;
+	cm_mask_interrupts(irq_mask);
+
+	res->bytes = BENCH_CYCLES;
+	return ret;
+}
+
+static qiprog_err bench_mwrite(struct bench_result *res)
+{
+	uint32_t i, t_start, irq_mask;
+	qiprog_err ret = QIPROG_SUCCESS;
+
+	irq_mask = cm_mask_interrupts(1);
+	t_start = DWT_CYCCNT;
+	for (i = 0; i < BENCH_CYCLES; i++)
+		ret |= lpc_mwrite(BENCH_ADDR + i, BENCH_WRITE_DATA);
+	res->cycles = DWT_CYCCNT - t_start;
+	cm_mask_interrupts(irq_mask);
+
+	res->bytes = BENCH_CYCLES;
+	return ret;
+}
+
+static qiprog_err bench_read(struct bench_result *res)
+{
+	uint32_t where, t_start;
+	qiprog_err ret;
+
+	t_start = DWT_CYCCNT;
+	for (where = 0; where < BENCH_READ_SIZE; where += BENCH_CHUNK) {
+		ret = stellaris_read(where, read_buf, BENCH_CHUNK);
+		if (ret != QIPROG_SUCCESS)
+			return ret;
+	}
+	res->cycles = DWT_CYCCNT - t_start;
+	res->bytes = BENCH_READ_SIZE;
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Do the queued run, if there is one
+ *
+ * The whole run is done in one go, and stops at the first metric which fails.
+ * Call this from the main loop.
+ */
+void bench_step(void)
+{
+	qiprog_err ret;
+
+	if (bench.state != BENCH_BUSY)
+		return;
+
+	/* Leave the counter running, it may be shared with the profiler */
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+	bench.core_hz = stellaris_core_hz();
+
+	ret = bench_mread(&bench.result[BENCH_LPC_MREAD]);
+	if (ret == QIPROG_SUCCESS)
+		ret = bench_mwrite(&bench.result[BENCH_LPC_MWRITE]);
+	if (ret == QIPROG_SUCCESS)
+		ret = bench_read(&bench.result[BENCH_READ]);
+
+	if (ret != QIPROG_SUCCESS) {
+		print_err("Benchmark failed\n");
+		bench.error = ret;
+		bench.state = BENCH_FAILED;
+		return;
+	}
+
+	print_spew("Benchmark done at %u Hz\n", bench.core_hz);
+	bench.state = BENCH_DONE;
+}
+
+/**
+ * @brief Get the outcome of the last run
+ *
+ * The metrics are only filled in once the run is done, and are zero otherwise.
+ */
+void bench_get_status(struct bench_status *stat)
+{
+	const enum bench_state state = bench.state;
+	uint8_t i;
+
+	stat->state = state;
+	stat->error = bench.error;
+	stat->core_hz = bench.core_hz;
+	stat->flags = 0;
+	if (CONFIG_PROFILE)
+		stat->flags |= BENCH_FLAG_PROFILE;
+	if (CONFIG_LPC_WAVE_PLAYBACK)
+		stat->flags |= BENCH_FLAG_WAVE;
+
+	for (i = 0; i < BENCH_NUM_METRICS; i++) {
+		stat->result[i].bytes = 0;
+		stat->result[i].cycles = 0;
+		if (state == BENCH_DONE)
+			stat->result[i] = bench.result[i];
+	}
+}
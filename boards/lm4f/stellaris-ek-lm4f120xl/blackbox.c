@@ -25,8 +25,35 @@
 #include <libopencm3/lm4f/uart.h>
 #include <libopencm3/cm3/scb.h>
 #include <libopencm3/lm4f/nvic.h>
+#include <libopencm3/cm3/cortex.h>
 
 #include <blackbox.h>
+#include <byteorder.h>
+#include <timebase.h>
+
+/*
+ * Console output is deferred. print_blackbox() only copies the message into a
+ * ring buffer, and the UART TX interrupt drains it, so logging does not hold
+ * up the LPC bus for the time it takes to send each character. When the ring
+ * is full, messages are dropped and counted, rather than waited on.
+ *
+ * The interrupt is the only consumer, and never has to take a lock. Writers may
+ * come from interrupts too, so they mask interrupts while copying a message.
+ * Must be a power of two.
+ */
+#define CONSOLE_RING_SIZE	2048
+
+static char ring[CONSOLE_RING_SIZE];
+/* Where the next character goes */
+static volatile uint16_t ring_head = 0;
+/* Next character to send */
+static volatile uint16_t ring_tail = 0;
+/* Messages which did not fit */
+static volatile uint32_t dropped = 0;
+/* Drops we have not told the reader about yet */
+static uint32_t dropped_unreported = 0;
+/* Send synchronously, bypassing the ring. Set when we are about to die. */
+static bool console_sync = false;
 
 /**
  * \brief Initialize the debugging subsystem.
@@ -55,12 +82,63 @@ void blackbox_init(void)
 	uart_enable_fifo(UART0);
 	/* Now that we're done messing with the settings, enable the UART */
 	uart_enable(UART0);
+
+	/* The ring is drained as the TX FIFO empties */
+	uart_enable_interrupts(UART0, UART_INT_TX);
+	nvic_enable_irq(NVIC_UART0_IRQ);
+}
+
+static uint16_t ring_used(void)
+{
+	return (uint16_t)(ring_head - ring_tail);
+}
+
+/*
+ * Move what we can from the ring to the TX FIFO. Called from the UART
+ * interrupt, or with interrupts masked.
+ */
+static void console_drain(void)
+{
+	while ((ring_tail != ring_head) && !uart_is_tx_fifo_full(UART0)) {
+		uart_send(UART0, ring[ring_tail % CONSOLE_RING_SIZE]);
+		ring_tail++;
+	}
+}
+
+void uart0_isr(void)
+{
+	uart_clear_interrupt_flag(UART0, UART_INT_TX);
+	console_drain();
+}
+
+/*
+ * Send everything in the ring, without relying on interrupts. From here on,
+ * messages are sent as they come.
+ */
+static void console_flush(void)
+{
+	uart_disable_interrupts(UART0, UART_INT_TX);
+	console_sync = true;
+	while (ring_tail != ring_head) {
+		uart_send_blocking(UART0, ring[ring_tail % CONSOLE_RING_SIZE]);
+		ring_tail++;
+	}
+}
+
+/**
+ * \brief Number of console messages dropped because the ring was full
+ */
+uint32_t blackbox_get_dropped(void)
+{
+	return dropped;
 }
 
 void hard_fault_handler(void)
 {
 	uint32_t reg32;
 
+	/* Interrupts won't run anymore. Get out what is already queued. */
+	console_flush();
 	print_emerg("Hard fault occured\n");
 
 	/*
@@ -115,17 +193,76 @@ void hard_fault_handler(void)
 	while (1) ;
 }
 
-static void send_uart(char *ptr, int len)
+static void send_uart(const char *ptr, int len, bool text)
 {
 	int i;
 
 	for (i = 0; i < len; i++) {
-		if (ptr[i] == '\n')
+		if (text && (ptr[i] == '\n'))
 			uart_send_blocking(UART0, '\r');
 		uart_send_blocking(UART0, ptr[i]);
 	}
 }
 
+/*
+ * Space a message takes in the ring. Newlines in text become "\r\n". Binary
+ * messages go out as they are.
+ */
+static int ring_space_needed(const char *ptr, int len, bool text)
+{
+	int i, space = len;
+
+	for (i = 0; text && (i < len); i++) {
+		if (ptr[i] == '\n')
+			space++;
+	}
+	return space;
+}
+
+/* Copy a message into the ring. There must be room for it. */
+static void ring_put(const char *ptr, int len, bool text)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (text && (ptr[i] == '\n'))
+			ring[ring_head++ % CONSOLE_RING_SIZE] = '\r';
+		ring[ring_head++ % CONSOLE_RING_SIZE] = ptr[i];
+	}
+}
+
+/* Queue a message, or drop it if there is no room */
+static void queue_uart(const char *ptr, int len, bool text)
+{
+	char note[32];
+	int note_len = 0, space;
+	uint32_t irq_mask;
+
+	space = ring_space_needed(ptr, len, text);
+
+	irq_mask = cm_mask_interrupts(1);
+	if (dropped_unreported) {
+		note_len = snprintf(note, sizeof(note), "<%lu dropped>\n",
+				    (unsigned long)dropped_unreported);
+		note_len = (note_len < (int)sizeof(note)) ? note_len :
+			   (int)sizeof(note) - 1;
+	}
+
+	if ((space + note_len) > (CONSOLE_RING_SIZE - ring_used())) {
+		dropped++;
+		dropped_unreported++;
+	} else {
+		if (note_len) {
+			ring_put(note, note_len, true);
+			dropped_unreported = 0;
+		}
+		ring_put(ptr, len, text);
+		/* Get the TX interrupt going, if the FIFO had run dry */
+		console_drain();
+	}
+	cm_mask_interrupts(irq_mask);
+}
+
 /*
  * Route debug output to UART0
  */
@@ -136,6 +273,53 @@ void print_blackbox(const char *format, ...)
 	va_list args;
 	va_start(args, format);
 	len = vsnprintf(buffer, sizeof(buffer), format, args);
-	send_uart(buffer, len);
 	va_end(args);
+	if (len < 0)
+		return;
+
+	/* vsnprintf() returns what it would have written */
+	len = (len < (int)sizeof(buffer)) ? len : (int)sizeof(buffer) - 1;
+	if (console_sync)
+		send_uart(buffer, len, true);
+	else
+		queue_uart(buffer, len, true);
+}
+
+/*
+ * Binary log messages. Each one is a frame of:
+ *   BLACKBOX_FRAME_MAGIC, number of arguments,
+ *   address of the format string, timestamp in microseconds,
+ *   the arguments, as 32-bit words
+ * All words are little-endian. Anything between frames is plain text, such as
+ * the note about dropped messages. tools/decode_log.py turns frames back into
+ * text, with the format strings from the ELF file.
+ */
+#define BLACKBOX_FRAME_MAGIC	0xa5
+
+/*
+ * Send a message in binary form. Called by printk() when CONFIG_BINARY_LOG is
+ * set. All arguments must be 32 bits wide.
+ */
+void print_binary(const char *format, unsigned int nargs, ...)
+{
+	uint8_t frame[10 + 4 * BLACKBOX_MAX_ARGS];
+	unsigned int i;
+	va_list args;
+
+	nargs = (nargs > BLACKBOX_MAX_ARGS) ? BLACKBOX_MAX_ARGS : nargs;
+
+	frame[0] = BLACKBOX_FRAME_MAGIC;
+	frame[1] = nargs;
+	put_le32(frame + 2, (uintptr_t)format);
+	put_le32(frame + 6, timebase_us());
+
+	va_start(args, nargs);
+	for (i = 0; i < nargs; i++)
+		put_le32(frame + 10 + 4 * i, va_arg(args, uint32_t));
+	va_end(args);
+
+	if (console_sync)
+		send_uart((const char *)frame, 10 + 4 * nargs, false);
+	else
+		queue_uart((const char *)frame, 10 + 4 * nargs, false);
 }
@@ -0,0 +1,312 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file lpc_calib.c Finding the fastest bus timing which works
+ *
+ * How fast the bus can be run depends on the wiring. Short, clean wires work at
+ * the speed the core can toggle the pins, while long cables need more time for
+ * LAD to settle, and longer clock pulses. Calibration sweeps the clock stretch,
+ * the settle delay and the drive strength, fastest first, and keeps the first
+ * setting which reads back correctly on every pass.
+ *
+ * What is read correctly is decided at the slowest setting: the ID of the first
+ * chip in the gang, and the CRC32 of the start of the chip, when its size is
+ * known. The ID is a reliable pattern, even on an erased chip, but reading it
+ * takes command writes. So a setting is only tried with the ID once plain
+ * reads have passed at that setting.
+ *
+ * The chosen timing stays in effect until the next calibration, or until the
+ * host sets one. Like checksums, both are requested from the USB interrupt,
+ * and done from the main loop once pending jobs have finished. A calibration
+ * tries one setting per step, and puts the timing which was in effect back in
+ * between, so the main loop keeps running on a timing known to work.
+ */
+
+#include "lpc_calib.h"
+#include "stellaris.h"
+
+#include <blackbox.h>
+#include <crc32.h>
+#include <stdbool.h>
+
+/* Passes every setting must read back correctly, unless the host says */
+#define CALIB_PASSES		4
+/* Bytes at the start of the chip checked on every pass */
+#define CALIB_SIZE		1024
+#define CALIB_CHUNK		256
+
+/* Tried in this order at every delay, strongest first */
+static const enum lpc_drive drives[] = {
+	LPC_DRIVE_8MA,
+	LPC_DRIVE_4MA,
+	LPC_DRIVE_2MA,
+};
+
+static struct {
+	volatile enum calib_state state;
+	qiprog_err error;
+	uint8_t passes;
+	uint32_t tried;
+	uint32_t core_hz;
+	/* What the slowest setting read, once we have read it */
+	bool have_ref;
+	struct qiprog_chip_id ref_id;
+	uint32_t ref_crc;
+	bool use_range;
+	/* The setting to try next, and the one to go back to */
+	struct lpc_timing next;
+	size_t drive;
+	struct lpc_timing saved;
+	/* Timing the host asked for, applied from the main loop */
+	volatile bool set_pending;
+	struct lpc_timing set_timing;
+} calib;
+
+static uint8_t chunk[CALIB_CHUNK];
+
+/**
+ * @brief Queue a calibration
+ *
+ * This may be called from an interrupt.
+ *
+ * @param[in] passes Times every setting must read back correctly, or zero for
+ *		     the default.
+ */
+qiprog_err calib_submit(uint8_t passes)
+{
+	if ((calib.state == CALIB_BUSY) || calib.set_pending)
+		return QIPROG_ERR;
+	/* The timing only applies to the LPC engine */
+	if (!stellaris_lpc_active())
+		return QIPROG_ERR;
+	/* There is nothing to compare against without a chip */
+	if (!stellaris_chip_probed())
+		return QIPROG_ERR_ARG;
+
+	calib.passes = passes ? passes : CALIB_PASSES;
+	calib.have_ref = false;
+	calib.error = QIPROG_SUCCESS;
+	calib.state = CALIB_BUSY;
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Queue a change to a timing the host chose
+ *
+ * This may be called from an interrupt.
+ */
+qiprog_err calib_set_timing(const struct lpc_timing *timing)
+{
+	if ((calib.state == CALIB_BUSY) || calib.set_pending)
+		return QIPROG_ERR;
+	/* The timing only applies to the LPC engine */
+	if (!stellaris_lpc_active())
+		return QIPROG_ERR;
+
+	if ((timing->settle > LPC_TIMING_MAX_DELAY) ||
+	    (timing->stretch > LPC_TIMING_MAX_DELAY) ||
+	    (timing->drive >= LPC_NUM_DRIVES))
+		return QIPROG_ERR_ARG;
+
+	calib.set_timing = *timing;
+	calib.set_pending = true;
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Is a calibration or a timing change waiting to be done?
+ */
+bool calib_busy(void)
+{
+	return (calib.state == CALIB_BUSY) || calib.set_pending;
+}
+
+static qiprog_err read_crc(uint32_t *crc)
+{
+	uint32_t where;
+	qiprog_err ret;
+
+	*crc = 0;
+	for (where = 0; where < CALIB_SIZE; where += CALIB_CHUNK) {
+		ret = stellaris_read(where, chunk, CALIB_CHUNK);
+		if (ret != QIPROG_SUCCESS)
+			return ret;
+		*crc = crc32_update(*crc, chunk, CALIB_CHUNK);
+	}
+
+	return QIPROG_SUCCESS;
+}
+
+/* Did any frame have to be tried again since 'before'? */
+static bool frames_retried(const struct lpc_bus_stats *before)
+{
+	struct lpc_bus_stats now;
+
+	lpc_get_bus_stats(&now, false);
+	return now.retries != before->retries;
+}
+
+/* Does the bus read back what it did at the slowest setting? */
+static bool timing_works(const struct lpc_timing *timing)
+{
+	struct lpc_bus_stats before;
+	struct qiprog_chip_id id;
+	uint32_t crc;
+	uint8_t pass;
+
+	lpc_set_timing(timing);
+	/* A setting which only works with retries is not good enough */
+	lpc_get_bus_stats(&before, false);
+
+	for (pass = 0; calib.use_range && (pass < calib.passes); pass++) {
+		if (read_crc(&crc) != QIPROG_SUCCESS)
+			return false;
+		if ((crc != calib.ref_crc) || frames_retried(&before))
+			return false;
+	}
+
+	for (pass = 0; pass < calib.passes; pass++) {
+		if (stellaris_read_id(&id) != QIPROG_SUCCESS)
+			return false;
+		if ((id.vendor_id != calib.ref_id.vendor_id) ||
+		    (id.device_id != calib.ref_id.device_id) ||
+		    frames_retried(&before))
+			return false;
+	}
+
+	return true;
+}
+
+static void calib_finish(enum calib_state state, qiprog_err error)
+{
+	if (state != CALIB_DONE)
+		lpc_set_timing(&calib.saved);
+	calib.error = error;
+	calib.state = state;
+}
+
+/* Read what the slowest setting reads, which is taken as the truth */
+static void calib_read_ref(void)
+{
+	struct lpc_timing timing;
+	qiprog_err ret;
+
+	lpc_get_timing(&calib.saved);
+	calib.tried = 0;
+	calib.core_hz = stellaris_core_hz();
+
+	timing.settle = LPC_TIMING_MAX_DELAY;
+	timing.stretch = LPC_TIMING_MAX_DELAY;
+	timing.drive = LPC_DRIVE_8MA;
+	lpc_set_timing(&timing);
+
+	ret = stellaris_read_id(&calib.ref_id);
+	if (ret != QIPROG_SUCCESS) {
+		print_err("Calibration: no chip to calibrate against\n");
+		calib_finish(CALIB_FAILED, ret);
+		return;
+	}
+
+	/* Chips of unknown size can only be checked with their ID */
+	crc32_init();
+	calib.use_range = (read_crc(&calib.ref_crc) == QIPROG_SUCCESS);
+	lpc_set_timing(&calib.saved);
+
+	calib.next.settle = 0;
+	calib.next.stretch = 0;
+	calib.drive = 0;
+	calib.have_ref = true;
+}
+
+/*
+ * Move on to the next setting. Stretch costs every clock, settle only the
+ * reads, so stretch goes last.
+ */
+static bool calib_advance(void)
+{
+	if (++calib.drive < sizeof(drives) / sizeof(drives[0]))
+		return true;
+	calib.drive = 0;
+
+	if (++calib.next.settle <= LPC_TIMING_MAX_DELAY)
+		return true;
+	calib.next.settle = 0;
+
+	return ++calib.next.stretch <= LPC_TIMING_MAX_DELAY;
+}
+
+/* Try one setting, fastest first */
+static void calib_try_next(void)
+{
+	struct lpc_timing *timing = &calib.next;
+
+	timing->drive = drives[calib.drive];
+	calib.tried++;
+	if (timing_works(timing)) {
+		print_info("Bus calibrated: settle %u, stretch %u, drive %u\n",
+			   timing->settle, timing->stretch, timing->drive);
+		calib_finish(CALIB_DONE, QIPROG_SUCCESS);
+		return;
+	}
+
+	/* Don't leave a setting which does not work on the bus */
+	lpc_set_timing(&calib.saved);
+
+	if (!calib_advance()) {
+		print_err("Calibration: no setting reads back reliably\n");
+		calib_finish(CALIB_FAILED, QIPROG_ERR);
+	}
+}
+
+/**
+ * @brief Do the queued timing change, or the next step of a calibration
+ *
+ * A calibration reads its reference in the first step, then tries one setting
+ * per step. Call this from the main loop.
+ */
+void calib_step(void)
+{
+	if (calib.set_pending) {
+		lpc_set_timing(&calib.set_timing);
+		calib.set_pending = false;
+	}
+
+	if (calib.state != CALIB_BUSY)
+		return;
+
+	if (!calib.have_ref)
+		calib_read_ref();
+	else
+		calib_try_next();
+}
+
+/**
+ * @brief Get the outcome of the last calibration, and the timing in effect
+ */
+void calib_get_status(struct calib_status *stat)
+{
+	stat->state = calib.state;
+	stat->error = calib.error;
+	stat->tried = calib.tried;
+	stat->core_hz = calib.core_hz;
+	lpc_get_timing(&stat->timing);
+}
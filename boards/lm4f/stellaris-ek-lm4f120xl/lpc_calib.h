@@ -0,0 +1,50 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LPC_CALIB_H
+#define LPC_CALIB_H
+
+#include "lpc_io.h"
+
+#include <qiprog.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+enum calib_state {
+	CALIB_IDLE = 0,
+	CALIB_BUSY = 1,
+	CALIB_DONE = 2,
+	CALIB_FAILED = 3,
+};
+
+struct calib_status {
+	enum calib_state state;
+	qiprog_err error;
+	uint32_t tried;		/**< Settings tried by the last calibration */
+	uint32_t core_hz;	/**< Core clock the last calibration ran at */
+	struct lpc_timing timing;	/**< The timing in effect */
+};
+
+qiprog_err calib_submit(uint8_t passes);
+qiprog_err calib_set_timing(const struct lpc_timing *timing);
+bool calib_busy(void);
+void calib_step(void);
+void calib_get_status(struct calib_status *stat);
+
+#endif				/* LPC_CALIB_H */
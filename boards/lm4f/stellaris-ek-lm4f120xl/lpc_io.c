@@ -18,36 +18,79 @@
  */
 
 #include "lpc_io.h"
+#include "lpc_pins.h"
+#include "lpc_wave.h"
 
+#include <config.h>
+#include <profile.h>
 #include <qiprog.h>
+#include <stdbool.h>
+#include <libopencm3/cm3/cortex.h>
 #include <libopencm3/lm4f/rcc.h>
 #include <libopencm3/lm4f/gpio.h>
 
-/* LAD[3:0] */
-#define LADPORT		GPIOB
-#define LADPINS		(GPIO0 | GPIO1 | GPIO2 | GPIO3)
-/* LCLK */
-#define CLKPORT		GPIOC
-#define CLKPIN		(GPIO5)
-/* #LFRAME */
-#define LFPORT		GPIOD
-#define LFPIN		(GPIO2)
-/* ID[3:0] */
-#define IDPORT		GPIOE
-#define IDPINS		(GPIO0 | GPIO1 | GPIO2 | GPIO3)
-/* MODE and #CE pins */
-#define CTLPORT		GPIOA
-#define MODEPIN		(GPIO4)
-#define CEPIN		(GPIO3)
-#define RSTPIN		(GPIO6)
-
-#include <blackbox.h>
+#include <timebase.h>
+
+uint8_t lpc_settle_loops = 0;
+uint8_t lpc_stretch_loops = 0;
+
+/* The bus timing in effect. The delays are mirrored in lpc_*_loops. */
+static struct lpc_timing timing = {
+	.settle = 0,
+	.stretch = 0,
+	.drive = LPC_DRIVE_8MA,
+};
+
+static const enum gpio_drive_strength drive_strength[LPC_NUM_DRIVES] = {
+	[LPC_DRIVE_2MA] = GPIO_DRIVE_2MA,
+	[LPC_DRIVE_4MA] = GPIO_DRIVE_4MA,
+	[LPC_DRIVE_8MA] = GPIO_DRIVE_8MA,
+};
+
+/* The GPIO ports are only clocked once lpc_init() has run */
+static bool pins_ready = false;
+
+/* What the slave answers during SYNC */
+enum lpc_sync {
+	LPC_SYNC_READY = 0x0,
+	LPC_SYNC_SHORT_WAIT = 0x5,
+	LPC_SYNC_LONG_WAIT = 0x6,
+	LPC_SYNC_ERROR = 0xa,
+};
+
+/*
+ * Wait clocks we give a slave before we abort the frame. Short waits are
+ * limited to eight clocks by the spec. Long waits have no limit, but a slave
+ * which has not answered after this long is not going to.
+ */
+#define LPC_SYNC_MAX_SHORT_WAITS	8
+#define LPC_SYNC_MAX_LONG_WAITS		1024
+/* Times a failed frame is tried again before we give up */
+#define LPC_FRAME_RETRIES		2
+/*
+ * #RST is held low for as long as the LPC spec wants LRESET# asserted, which is
+ * far longer than the FWH parts need. They accept a frame a few microseconds
+ * after #RST goes high.
+ */
+#define LPC_RESET_US			1000
+#define LPC_RESET_RECOVERY_US		10
+
+static struct lpc_bus_stats bus_stats;
 
 /*
- * GPIOE[3:0] <-> LDAT[3:0]
- * GPIOC5 <-> CLK
- * GPIOD2 <-> #LFRAME
+ * Single memory cycles, built once by lpc_wave_build(). Each access only
+ * patches in its address and data.
  */
+static struct lpc_wave mread_wave;
+static struct lpc_wave mwrite_wave;
+
+static void lpc_wave_build(void)
+{
+	lpc_wave_init(&mread_wave);
+	lpc_wave_mread(&mread_wave, 0);
+	lpc_wave_init(&mwrite_wave);
+	lpc_wave_mwrite(&mwrite_wave, 0, 0);
+}
 
 void lpc_init(void)
 {
@@ -72,17 +115,14 @@ void lpc_init(void)
 	/*
 	 * The default drive strength is 2mA. Depending on how fast we turn the
 	 * bus and the layout of the tracks/wires, this may or may not be
-	 * sufficient. 8mA drive gives more consistent results, even with long
-	 * wires, so use this setting for the time being.
+	 * sufficient. We start at 8mA, which gives more consistent results,
+	 * even with long wires. Calibration may pick something else.
 	 */
 	gpio_mode_setup(LADPORT, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, LADPINS);
-	gpio_set_output_config(LADPORT, GPIO_OTYPE_PP, GPIO_DRIVE_8MA, LADPINS);
-
 	gpio_mode_setup(CLKPORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, CLKPIN);
-	gpio_set_output_config(CLKPORT, GPIO_OTYPE_PP, GPIO_DRIVE_8MA, CLKPIN);
-
 	gpio_mode_setup(LFPORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, LFPIN);
-	gpio_set_output_config(LFPORT, GPIO_OTYPE_PP, GPIO_DRIVE_8MA, LFPIN);
+	pins_set_drive(drive_strength[timing.drive]);
+	pins_ready = true;
 
 	gpio_mode_setup(IDPORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, IDPINS);
 	gpio_set_output_config(IDPORT, GPIO_OTYPE_PP, GPIO_DRIVE_2MA, IDPINS);
@@ -95,88 +135,201 @@ void lpc_init(void)
 
 	/* Put chip in LPC mode, select #CE, and put chip in reset */
 	gpio_clear(CTLPORT, pins);
-	print_spew("This line is used to delay until RESET is released.\n");
-	/* Release reset. the chip is now ready */
+	timebase_delay_us(LPC_RESET_US);
+	/* Release reset, and give the chip time to come out of it */
 	gpio_set(CTLPORT, RSTPIN);
+	timebase_delay_us(LPC_RESET_RECOVERY_US);
+
+	if (CONFIG_LPC_WAVE_PLAYBACK)
+		lpc_wave_build();
 }
 
 /**
- * @brief Switch LAD[3:0] pins to inputs
+ * @brief Change how fast we run the bus
+ *
+ * This must not be called in the middle of a frame.
  */
-static inline void lad_mode_in(void)
+qiprog_err lpc_set_timing(const struct lpc_timing *new_timing)
 {
-	GPIO_DIR(LADPORT) &= ~LADPINS;
+	if ((new_timing->settle > LPC_TIMING_MAX_DELAY) ||
+	    (new_timing->stretch > LPC_TIMING_MAX_DELAY) ||
+	    (new_timing->drive >= LPC_NUM_DRIVES))
+		return QIPROG_ERR_ARG;
+
+	timing = *new_timing;
+	lpc_settle_loops = timing.settle;
+	lpc_stretch_loops = timing.stretch;
+	/* Otherwise, lpc_init() applies the drive strength */
+	if (pins_ready)
+		pins_set_drive(drive_strength[timing.drive]);
+
+	return QIPROG_SUCCESS;
 }
 
 /**
- * @brief Switch LAD[3:0] pins to outputs
+ * @brief Get the bus timing in effect
  */
-static inline void lad_mode_out(void)
+void lpc_get_timing(struct lpc_timing *out)
+{
+	*out = timing;
+}
+
+/* Loops which take at least as long at new_hz as 'loops' did at old_hz */
+static uint8_t scale_delay(uint8_t loops, uint32_t old_hz, uint32_t new_hz)
 {
-	GPIO_DIR(LADPORT) |= LADPINS;
+	uint32_t scaled;
+
+	scaled = ((uint64_t) loops * new_hz + old_hz - 1) / old_hz;
+	return (scaled > LPC_TIMING_MAX_DELAY) ? LPC_TIMING_MAX_DELAY : scaled;
 }
 
 /**
- * @brief Write a nibble on the LAD[3:0] pins
+ * @brief Keep the bus timing when the core clock changes
+ *
+ * The delays are in busy loops, which take longer as the core clock goes down.
+ * This works out the loops which take as long at the new clock, rounding up,
+ * so a calibrated timing stays safe. This must not be called in the middle of
+ * a frame.
  */
-static inline void lad_write(uint8_t dat4)
+void lpc_scale_timing(uint32_t old_hz, uint32_t new_hz)
 {
-	/*
-	 * This works without bit shifting because our LAD pins are sequential
-	 * and start from GPIO0. Thus, the lower nibble of dat4 maps to the LAD
-	 * pins without needing shifting.
-	 * The same reasoning applies in lad_read().
-	 */
-	gpio_write(LADPORT, LADPINS, dat4);
+	if (!old_hz || (old_hz == new_hz))
+		return;
+
+	timing.settle = scale_delay(timing.settle, old_hz, new_hz);
+	timing.stretch = scale_delay(timing.stretch, old_hz, new_hz);
+	lpc_settle_loops = timing.settle;
+	lpc_stretch_loops = timing.stretch;
 }
 
 /**
- * @brief Read a nibble from the LAD[3:0] pins
+ * @brief Is the slave allowed another wait clock?
+ *
+ * @param[in] sync What the slave answered during the last SYNC clock
+ * @param[in,out] waits Wait clocks in this frame so far
  */
-static inline uint8_t lad_read(void)
+static inline bool lpc_sync_wait(uint8_t sync, uint16_t * waits)
 {
-	/*
-	 * Writing then reading to a GPIO port does not guarantee that the input
-	 * data is latched after the output has been driven. This effect can be
-	 * observed regardless of the clock frequency. A memory barrier does not
-	 * solve the issue; however a delay of at least four "nop" ensures that
-	 * the data is latched after the output has been written. The four "nop"
-	 * delay is independent of the core clock.
-	 */
-	asm("nop"); asm("nop");asm("nop");asm("nop");
-	return gpio_read(LADPORT, LADPINS);
+	uint16_t limit;
+
+	if (sync == LPC_SYNC_SHORT_WAIT)
+		limit = LPC_SYNC_MAX_SHORT_WAITS;
+	else if (sync == LPC_SYNC_LONG_WAIT)
+		limit = LPC_SYNC_MAX_LONG_WAITS;
+	else
+		return false;
+
+	bus_stats.waits++;
+	return (++(*waits) <= limit);
 }
 
 /**
- * @brief Assert clock signal
+ * @brief Error for a SYNC other than ready
  */
-static inline void clk_high(void)
+static inline qiprog_err lpc_sync_error(uint8_t sync)
 {
-	gpio_set(CLKPORT, CLKPIN);
+	if ((sync == LPC_SYNC_SHORT_WAIT) || (sync == LPC_SYNC_LONG_WAIT))
+		return QIPROG_ERR_TIMEOUT;
+
+	return QIPROG_ERR_NO_RESPONSE;
 }
 
 /**
- * @brief De-assert clock signal
+ * @brief Clock SYNC for as long as the slave asks us to wait
+ *
+ * On failure, the slave may still be driving LAD. lpc_abort() takes the bus
+ * back.
  */
-static inline void clk_low(void)
+static inline qiprog_err lpc_sync(void)
 {
-	gpio_clear(CLKPORT, CLKPIN);
+	uint8_t sync;
+	uint16_t waits = 0;
+
+	do {
+		clk_high();
+		sync = lad_read();
+		clk_low();
+	} while (lpc_sync_wait(sync, &waits));
+
+	if (sync != LPC_SYNC_READY)
+		return lpc_sync_error(sync);
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Abort the frame in progress, and get the bus back to idle
+ *
+ * #LFRAME low for four clocks with LAD[3:0] at 1111 makes every slave drop
+ * whatever it was doing, and stop driving LAD. The first clock is left to the
+ * pull-ups, so we do not fight a slave which is still driving the bus.
+ */
+static void lpc_abort(void)
+{
+	uint8_t i;
+
+	clk_low();
+	lad_mode_in();
+	lframe_low();
+	clk_high();
+	clk_low();
+
+	lad_write(0xf);
+	lad_mode_out();
+	for (i = 0; i < 3; i++) {
+		clk_high();
+		clk_low();
+	}
+	lframe_high();
+
+	/* One idle clock before the next START */
+	clk_high();
+	clk_low();
 }
 
 /**
- * @brief Assert #LFRAME signal
+ * @brief Clean up after a failed frame, and decide if it is tried again
+ *
+ * Only frames the slave did not answer are tried again. A write which is tried
+ * again may reach the chip twice, but the abort has reset the chip's view of
+ * the cycle, and JEDEC command sequences start over on a repeated first cycle.
+ *
+ * @param[in] ret What the last try of the frame returned
+ * @param[in,out] tries Times the frame was tried again so far
  */
-static inline void lframe_high(void)
+static bool lpc_retry(qiprog_err ret, uint8_t * tries)
 {
-	gpio_set(LFPORT, LFPIN);
+	if ((ret != QIPROG_ERR_NO_RESPONSE) && (ret != QIPROG_ERR_TIMEOUT))
+		return false;
+
+	lpc_abort();
+	if ((*tries)++ >= LPC_FRAME_RETRIES) {
+		bus_stats.failures++;
+		return false;
+	}
+
+	bus_stats.retries++;
+	return true;
 }
 
 /**
- * @brief De-assert #LFRAME signal
+ * @brief Get the SYNC wait and frame retry counters
+ *
+ * @param[out] stats Where to store the counters
+ * @param[in] reset Clear the counters once they are read
  */
-static inline void lframe_low(void)
+void lpc_get_bus_stats(struct lpc_bus_stats *stats, bool reset)
 {
-	gpio_clear(LFPORT, LFPIN);
+	uint32_t irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	*stats = bus_stats;
+	if (reset) {
+		bus_stats.waits = 0;
+		bus_stats.retries = 0;
+		bus_stats.failures = 0;
+	}
+	cm_mask_interrupts(irq_mask);
 }
 
 /**
@@ -232,6 +385,56 @@ static inline void lpc_send_address(uint32_t addr)
 	clk_low();
 }
 
+/**
+ * @brief Start an FWH frame (START and IDSEL clocks of an FWH frame)
+ */
+static inline void fwh_start_frame(uint8_t start, uint8_t idsel)
+{
+	lad_mode_out();
+	clk_low();
+
+	/* 1: START */
+	lframe_low();
+	lad_write(start);
+	clk_high();
+	lframe_high();
+	clk_low();
+
+	/* 2: IDSEL */
+	lad_write(idsel);
+	clk_high();
+	clk_low();
+}
+
+/**
+ * @brief Write a 28-bit FWH address on the bus (clocks 3-9)
+ */
+static inline void fwh_send_address(uint32_t addr)
+{
+	/* Unrolled for the same reason as lpc_send_address() */
+	lad_write(addr >> 24);
+	clk_high();
+	clk_low();
+	lad_write(addr >> 20);
+	clk_high();
+	clk_low();
+	lad_write(addr >> 16);
+	clk_high();
+	clk_low();
+	lad_write(addr >> 12);
+	clk_high();
+	clk_low();
+	lad_write(addr >> 8);
+	clk_high();
+	clk_low();
+	lad_write(addr >> 4);
+	clk_high();
+	clk_low();
+	lad_write(addr >> 0);
+	clk_high();
+	clk_low();
+}
+
 /**
  * @brief Read a byte from the LPC bus (2 clocks)
  */
@@ -311,12 +514,121 @@ static inline uint8_t lpc_tar_to_host(void)
 }
 
 /**
- * @brief Do an LPC memory read cycle
+ * @brief Replay a precompiled waveform on the bus
+ *
+ * Interrupts are masked while the table is clocked out, so that the timing of
+ * the bus is the same from one frame to the next. A slave which asks for wait
+ * states has already given up on tight timing, so interrupts are let through
+ * for as long as it keeps us waiting. A long wait may take 1024 clocks, which
+ * is too long to hold off the USB interrupt.
+ *
+ * @param[in] wave The waveform to play
+ * @param[out] rdata Where to store bytes from read cycles, in order. May be
+ *		     NULL if the waveform contains no read cycles.
  */
-qiprog_err lpc_mread(uint32_t addr, uint8_t * val8)
+qiprog_err lpc_wave_play(const struct lpc_wave *wave, uint8_t * rdata)
+{
+	size_t i;
+	uint16_t step;
+	uint8_t nibble = 0, data = 0;
+	uint16_t waits = 0;
+	bool driving = true, lsn = true;
+	uint32_t irq_mask;
+	qiprog_err ret = QIPROG_SUCCESS;
+
+	irq_mask = cm_mask_interrupts(1);
+
+	lad_mode_out();
+	clk_low();
+
+	for (i = 0; i < wave->len; i++) {
+		step = wave->step[i];
+
+		lad_write(step & LPC_WAVE_LAD);
+		if ((step & LPC_WAVE_FLOAT) && driving) {
+			lad_mode_in();
+			driving = false;
+		} else if (!(step & LPC_WAVE_FLOAT) && !driving) {
+			lad_mode_out();
+			driving = true;
+		}
+
+		if (step & LPC_WAVE_LFRAME) {
+			lframe_low();
+			clk_high();
+			lframe_high();
+		} else {
+			clk_high();
+		}
+
+		if (step & (LPC_WAVE_SAMPLE | LPC_WAVE_TAR | LPC_WAVE_SYNC))
+			nibble = lad_read();
+		clk_low();
+
+		if (step & LPC_WAVE_SAMPLE) {
+			if (lsn) {
+				data = nibble;
+			} else {
+				data |= nibble << 4;
+				*rdata++ = data;
+			}
+			lsn = !lsn;
+		} else if ((step & LPC_WAVE_TAR) && !nibble) {
+			/* Early SYNC, see lpc_mread(). Skip the SYNC clock. */
+			if ((i + 1 < wave->len) &&
+			    (wave->step[i + 1] & LPC_WAVE_SYNC))
+				i++;
+		} else if ((step & LPC_WAVE_SYNC) && nibble) {
+			/* Clock the same SYNC again, until the slave is ready */
+			if (lpc_sync_wait(nibble, &waits)) {
+				if (waits == 1)
+					cm_mask_interrupts(irq_mask);
+				i--;
+				continue;
+			}
+			ret = lpc_sync_error(nibble);
+			break;
+		} else if (step & LPC_WAVE_SYNC) {
+			if (waits)
+				cm_mask_interrupts(1);
+			waits = 0;
+		}
+	}
+
+	cm_mask_interrupts(irq_mask);
+
+	return ret;
+}
+
+/* lpc_mread(), when CONFIG_LPC_WAVE_PLAYBACK is set */
+static qiprog_err lpc_mread_wave(uint32_t addr, uint8_t * val8)
+{
+	qiprog_err ret;
+
+	lpc_wave_patch_addr(&mread_wave, 0, addr);
+	ret = lpc_wave_play(&mread_wave, val8);
+	if (ret != QIPROG_SUCCESS)
+		*val8 = 0xff;
+
+	return ret;
+}
+
+/* lpc_mwrite(), when CONFIG_LPC_WAVE_PLAYBACK is set */
+static qiprog_err lpc_mwrite_wave(uint32_t addr, uint8_t data)
+{
+	lpc_wave_patch_addr(&mwrite_wave, 0, addr);
+	lpc_wave_patch_data(&mwrite_wave, 0, data);
+	return lpc_wave_play(&mwrite_wave, NULL);
+}
+
+static qiprog_err lpc_mread_frame(uint32_t addr, uint8_t * val8)
 {
 	uint8_t data;
-	uint8_t tar1_12, rsync;
+	uint8_t tar1_12;
+	qiprog_err ret;
+
+	if (CONFIG_LPC_WAVE_PLAYBACK)
+		return lpc_mread_wave(addr, val8);
 
 	/* 1-2: START, cycle type and direction */
 	lpc_start_frame(0x4);
@@ -336,13 +648,11 @@ qiprog_err lpc_mread(uint32_t addr, uint8_t * val8)
 	if (!tar1_12)
 		goto skip_sync_at_lpc_read;
 
-	/* 13 - RSYNC */
-	clk_high();
-	if ((rsync = lad_read()) != 0) {
+	/* 13 - RSYNC, and any wait clocks before it */
+	if ((ret = lpc_sync()) != QIPROG_SUCCESS) {
 		*val8 = 0xff;
-		return QIPROG_ERR_NO_RESPONSE;
+		return ret;
 	}
-	clk_low();
 
  skip_sync_at_lpc_read:
 	/* 14 - 15: Data byte */
@@ -355,12 +665,13 @@ qiprog_err lpc_mread(uint32_t addr, uint8_t * val8)
 	return QIPROG_SUCCESS;
 }
 
-/**
- * @brief Do an LPC memory write cycle
- */
-qiprog_err lpc_mwrite(uint32_t addr, uint8_t data)
+static qiprog_err lpc_mwrite_frame(uint32_t addr, uint8_t data)
 {
-	uint8_t tar1_12, rsync;
+	uint8_t tar1_12;
+	qiprog_err ret;
+
+	if (CONFIG_LPC_WAVE_PLAYBACK)
+		return lpc_mwrite_wave(addr, data);
 
 	/* 1-2: START, cycle type and direction */
 	lpc_start_frame(0x6);
@@ -376,12 +687,9 @@ qiprog_err lpc_mwrite(uint32_t addr, uint8_t data)
 	if (!tar1_12)
 		goto skip_sync_at_lpc_write;
 
-	/* 15 - RSYNC */
-	clk_high();
-	if ((rsync = lad_read()) != 0)
-		return QIPROG_ERR_NO_RESPONSE;
-
-	clk_low();
+	/* 15 - RSYNC, and any wait clocks before it */
+	if ((ret = lpc_sync()) != QIPROG_SUCCESS)
+		return ret;
 
  skip_sync_at_lpc_write:
 
@@ -390,3 +698,126 @@ qiprog_err lpc_mwrite(uint32_t addr, uint8_t data)
 
 	return QIPROG_SUCCESS;
 }
+
+/**
+ * @brief Do an LPC memory read cycle
+ *
+ * A frame the slave does not answer is aborted, and tried again.
+ */
+qiprog_err lpc_mread(uint32_t addr, uint8_t * val8)
+{
+	qiprog_err ret;
+	uint8_t tries = 0;
+	PROFILE_START(t_start);
+
+	do {
+		ret = lpc_mread_frame(addr, val8);
+	} while (lpc_retry(ret, &tries));
+	PROFILE_END(PROFILE_LPC_MREAD, t_start);
+	return ret;
+}
+
+/**
+ * @brief Do an LPC memory write cycle
+ *
+ * A frame the slave does not answer is aborted, and tried again.
+ */
+qiprog_err lpc_mwrite(uint32_t addr, uint8_t data)
+{
+	qiprog_err ret;
+	uint8_t tries = 0;
+	PROFILE_START(t_start);
+
+	do {
+		ret = lpc_mwrite_frame(addr, data);
+	} while (lpc_retry(ret, &tries));
+	PROFILE_END(PROFILE_LPC_MWRITE, t_start);
+	return ret;
+}
+
+static qiprog_err fwh_mread_frame(uint8_t idsel, uint32_t addr, uint8_t * buf,
+				  enum fwh_msize msize, size_t len)
+{
+	uint8_t tar1_12;
+	size_t i;
+	qiprog_err ret;
+
+	/* 1-2: START, IDSEL */
+	fwh_start_frame(0xd, idsel);
+
+	/* 3-9: Address */
+	fwh_send_address(addr);
+
+	/* 10: MSIZE */
+	lad_write(msize);
+	clk_high();
+	clk_low();
+
+	/* 11-12: TAR - turn the bus to the slave */
+	tar1_12 = lpc_tar_to_slave();
+	/* Same early SYNC quirk as in lpc_mread() */
+	if (!tar1_12)
+		goto skip_sync_at_fwh_read;
+
+	/* 13 - RSYNC, and any wait clocks before it */
+	if ((ret = lpc_sync()) != QIPROG_SUCCESS)
+		return ret;
+
+ skip_sync_at_fwh_read:
+	/* Data bytes, two clocks each */
+	for (i = 0; i < len; i++)
+		buf[i] = lpc_read8();
+
+	/* TAR: turn the bus back to the host */
+	lpc_tar_to_host();
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Do an FWH memory read cycle of one or more bytes
+ *
+ * A single FWH frame transfers up to 128 bytes, so the START, address and TAR
+ * overhead is only paid once per burst instead of once per byte. The address
+ * must be aligned to the size of the burst. Not all FWH chips implement
+ * multi-byte reads; those that don't will not answer with a valid SYNC. Like
+ * other frames, a frame which is not answered is aborted, and tried again.
+ *
+ * @param[in] idsel Value of the ID straps of the chip to address
+ * @param[in] addr Address to read from. Only the lower 28 bits are used.
+ * @param[out] buf Where to store the data; must hold the full burst
+ * @param[in] msize Number of bytes to read, as an FWH MSIZE code
+ */
+qiprog_err fwh_mread(uint8_t idsel, uint32_t addr, uint8_t * buf,
+		     enum fwh_msize msize)
+{
+	size_t len;
+	uint8_t tries = 0;
+	qiprog_err ret;
+
+	switch (msize) {
+	case FWH_MSIZE_1:
+		len = 1;
+		break;
+	case FWH_MSIZE_2:
+		len = 2;
+		break;
+	case FWH_MSIZE_4:
+		len = 4;
+		break;
+	case FWH_MSIZE_16:
+		len = 16;
+		break;
+	case FWH_MSIZE_128:
+		len = 128;
+		break;
+	default:
+		return QIPROG_ERR_ARG;
+	}
+
+	do {
+		ret = fwh_mread_frame(idsel, addr, buf, msize, len);
+	} while (lpc_retry(ret, &tries));
+
+	return ret;
+}
@@ -21,10 +21,54 @@
 #define LPC_IO_H
 
 #include <qiprog.h>
+#include <stdbool.h>
 #include <stdint.h>
 
+/* FWH MSIZE field encodings for multi-byte memory reads */
+enum fwh_msize {
+	FWH_MSIZE_1 = 0x0,
+	FWH_MSIZE_2 = 0x1,
+	FWH_MSIZE_4 = 0x2,
+	FWH_MSIZE_16 = 0x4,
+	FWH_MSIZE_128 = 0x7,
+};
+
+/* Drive strength of LAD[3:0], CLK and #LFRAME */
+enum lpc_drive {
+	LPC_DRIVE_2MA = 0,
+	LPC_DRIVE_4MA,
+	LPC_DRIVE_8MA,
+	LPC_NUM_DRIVES,
+};
+
+/* Longest extra delay lpc_set_timing() takes, in loops */
+#define LPC_TIMING_MAX_DELAY	15
+
+/*
+ * How fast we run the bus. Delays are in busy loops of a few core clocks
+ * each, so they get longer as the core clock goes down.
+ */
+struct lpc_timing {
+	uint8_t settle;		/**< Extra delay before sampling LAD */
+	uint8_t stretch;	/**< Extra delay after every rising CLK edge */
+	enum lpc_drive drive;
+};
+
+/* How often slaves made us wait, or did not answer at all */
+struct lpc_bus_stats {
+	uint32_t waits;		/**< SYNC wait clocks */
+	uint32_t retries;	/**< Frames aborted, and tried again */
+	uint32_t failures;	/**< Frames which failed on every try */
+};
+
 void lpc_init(void);
+qiprog_err lpc_set_timing(const struct lpc_timing *timing);
+void lpc_get_timing(struct lpc_timing *timing);
+void lpc_scale_timing(uint32_t old_hz, uint32_t new_hz);
+void lpc_get_bus_stats(struct lpc_bus_stats *stats, bool reset);
 qiprog_err lpc_mread(uint32_t addr, uint8_t * val8);
 qiprog_err lpc_mwrite(uint32_t addr, uint8_t data);
+qiprog_err fwh_mread(uint8_t idsel, uint32_t addr, uint8_t * buf,
+		     enum fwh_msize msize);
 
 #endif				/* LPC_IO_H */
@@ -0,0 +1,173 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The pins of the LPC/FWH bus, and the primitives which drive them. This is
+ * the only place where the bus engine touches GPIO registers. Everything above
+ * it, from frames to JEDEC commands, is built on these few functions, so a
+ * different pinout, or a model of the pins, only needs a different version of
+ * this file.
+ */
+
+#ifndef LPC_PINS_H
+#define LPC_PINS_H
+
+#include <stdint.h>
+#include <libopencm3/lm4f/gpio.h>
+
+/* LAD[3:0] */
+#define LADPORT		GPIOB
+#define LADPINS		(GPIO0 | GPIO1 | GPIO2 | GPIO3)
+/* LCLK */
+#define CLKPORT		GPIOC
+#define CLKPIN		(GPIO5)
+/* #LFRAME */
+#define LFPORT		GPIOD
+#define LFPIN		(GPIO2)
+/* ID[3:0] */
+#define IDPORT		GPIOE
+#define IDPINS		(GPIO0 | GPIO1 | GPIO2 | GPIO3)
+/* MODE and #CE pins */
+#define CTLPORT		GPIOA
+#define MODEPIN		(GPIO4)
+#define CEPIN		(GPIO3)
+#define RSTPIN		(GPIO6)
+
+/*
+ * Extra delays of the bus timing, in pin_delay() loops. See lpc_set_timing().
+ * They are zero unless calibration finds the bus needs them, and then only
+ * cost a test on each edge.
+ */
+extern uint8_t lpc_settle_loops;
+extern uint8_t lpc_stretch_loops;
+
+#ifndef unlikely
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+#endif
+
+/*
+ * GPIOB[3:0] <-> LAD[3:0]
+ * GPIOC5 <-> CLK
+ * GPIOD2 <-> #LFRAME
+ */
+
+/**
+ * @brief Busy-wait for a few core clock cycles per loop
+ */
+static inline void pin_delay(uint8_t loops)
+{
+	while (loops--)
+		asm volatile("nop");
+}
+
+/**
+ * @brief Set the drive strength of the pins we drive on every clock
+ */
+static inline void pins_set_drive(enum gpio_drive_strength drive)
+{
+	gpio_set_output_config(LADPORT, GPIO_OTYPE_PP, drive, LADPINS);
+	gpio_set_output_config(CLKPORT, GPIO_OTYPE_PP, drive, CLKPIN);
+	gpio_set_output_config(LFPORT, GPIO_OTYPE_PP, drive, LFPIN);
+}
+
+/**
+ * @brief Switch LAD[3:0] pins to inputs
+ */
+static inline void lad_mode_in(void)
+{
+	GPIO_DIR(LADPORT) &= ~LADPINS;
+}
+
+/**
+ * @brief Switch LAD[3:0] pins to outputs
+ */
+static inline void lad_mode_out(void)
+{
+	GPIO_DIR(LADPORT) |= LADPINS;
+}
+
+/**
+ * @brief Write a nibble on the LAD[3:0] pins
+ */
+static inline void lad_write(uint8_t dat4)
+{
+	/*
+	 * This works without bit shifting because our LAD pins are sequential
+	 * and start from GPIO0. Thus, the lower nibble of dat4 maps to the LAD
+	 * pins without needing shifting.
+	 * The same reasoning applies in lad_read().
+	 */
+	gpio_write(LADPORT, LADPINS, dat4);
+}
+
+/**
+ * @brief Read a nibble from the LAD[3:0] pins
+ */
+static inline uint8_t lad_read(void)
+{
+	/*
+	 * Writing then reading to a GPIO port does not guarantee that the input
+	 * data is latched after the output has been driven. This effect can be
+	 * observed regardless of the clock frequency. A memory barrier does not
+	 * solve the issue; however a delay of at least four "nop" ensures that
+	 * the data is latched after the output has been written. The four "nop"
+	 * delay is independent of the core clock. Slow wiring may need more
+	 * time for LAD to settle, which calibration adds on top.
+	 */
+	asm("nop"); asm("nop");asm("nop");asm("nop");
+	if (unlikely(lpc_settle_loops))
+		pin_delay(lpc_settle_loops);
+	return gpio_read(LADPORT, LADPINS);
+}
+
+/**
+ * @brief Assert clock signal
+ */
+static inline void clk_high(void)
+{
+	gpio_set(CLKPORT, CLKPIN);
+	if (unlikely(lpc_stretch_loops))
+		pin_delay(lpc_stretch_loops);
+}
+
+/**
+ * @brief De-assert clock signal
+ */
+static inline void clk_low(void)
+{
+	gpio_clear(CLKPORT, CLKPIN);
+}
+
+/**
+ * @brief Assert #LFRAME signal
+ */
+static inline void lframe_high(void)
+{
+	gpio_set(LFPORT, LFPIN);
+}
+
+/**
+ * @brief De-assert #LFRAME signal
+ */
+static inline void lframe_low(void)
+{
+	gpio_clear(LFPORT, LFPIN);
+}
+
+#endif				/* LPC_PINS_H */
@@ -0,0 +1,182 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file lpc_wave.c Precompiled LPC waveforms
+ *
+ * Instead of working out the state of LAD[3:0] and #LFRAME while clocking the
+ * bus, a frame, or a batch of frames, is compiled into a table with one entry
+ * per LPC clock. lpc_wave_play() then replays the table without any per-frame
+ * decisions other than the SYNC check.
+ *
+ * The table is independent of the GPIO layout, and only depends on the LPC
+ * protocol. It produces exactly the same sequence of clocks as lpc_mread() and
+ * lpc_mwrite().
+ *
+ * A table is built once for each type of cycle. Only the address and data
+ * nibbles differ between two cycles of the same type, so those are patched in
+ * place with lpc_wave_patch_addr() and lpc_wave_patch_data().
+ *
+ * The table is played by the CPU, not by the uDMA. One LPC clock touches three
+ * GPIO ports, LAD on GPIOB, CLK on GPIOC and #LFRAME on GPIOD, as well as the
+ * direction of LAD at each turnaround. A uDMA channel only writes to one
+ * register per request. The SYNC clocks also need a decision on what the
+ * slave drove before the next clock can go out, which a DMA transfer can't
+ * make.
+ */
+
+#include "lpc_wave.h"
+
+static qiprog_err wave_put(struct lpc_wave *wave, uint16_t step)
+{
+	if (wave->len >= LPC_WAVE_MAX_STEPS)
+		return QIPROG_ERR_ARG;
+
+	wave->step[wave->len++] = step;
+	return QIPROG_SUCCESS;
+}
+
+/* START, cycle type and the 32-bit address */
+static qiprog_err wave_put_header(struct lpc_wave *wave, uint8_t type,
+				  uint32_t addr)
+{
+	qiprog_err ret;
+	int shift;
+
+	ret = wave_put(wave, LPC_WAVE_LFRAME | 0x0);
+	ret |= wave_put(wave, type);
+	for (shift = 28; shift >= 0; shift -= 4)
+		ret |= wave_put(wave, (addr >> shift) & LPC_WAVE_LAD);
+
+	return ret;
+}
+
+/* TAR to the slave, and the SYNC that follows it */
+static qiprog_err wave_put_tar_sync(struct lpc_wave *wave)
+{
+	qiprog_err ret;
+
+	ret = wave_put(wave, LPC_WAVE_FLOAT | 0xf);
+	ret |= wave_put(wave, LPC_WAVE_FLOAT | LPC_WAVE_TAR);
+	ret |= wave_put(wave, LPC_WAVE_FLOAT | LPC_WAVE_SYNC);
+
+	return ret;
+}
+
+/* TAR back to the host */
+static qiprog_err wave_put_tar_host(struct lpc_wave *wave)
+{
+	qiprog_err ret;
+
+	ret = wave_put(wave, LPC_WAVE_FLOAT);
+	ret |= wave_put(wave, 0xf);
+
+	return ret;
+}
+
+/**
+ * @brief Start a new, empty waveform
+ */
+void lpc_wave_init(struct lpc_wave *wave)
+{
+	wave->len = 0;
+	wave->num_reads = 0;
+}
+
+/**
+ * @brief Append an LPC memory read cycle to a waveform
+ *
+ * The byte that is read is stored in the next free location of the buffer
+ * passed to lpc_wave_play().
+ */
+qiprog_err lpc_wave_mread(struct lpc_wave *wave, uint32_t addr)
+{
+	qiprog_err ret;
+	size_t len = wave->len;
+
+	ret = wave_put_header(wave, 0x4, addr);
+	ret |= wave_put_tar_sync(wave);
+	ret |= wave_put(wave, LPC_WAVE_FLOAT | LPC_WAVE_SAMPLE);
+	ret |= wave_put(wave, LPC_WAVE_FLOAT | LPC_WAVE_SAMPLE);
+	ret |= wave_put_tar_host(wave);
+
+	/* Don't leave half a frame in the table */
+	if (ret != QIPROG_SUCCESS) {
+		wave->len = len;
+		return QIPROG_ERR_ARG;
+	}
+
+	wave->num_reads++;
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Append an LPC memory write cycle to a waveform
+ *
+ * The data byte is driven LSN first.
+ */
+qiprog_err lpc_wave_mwrite(struct lpc_wave *wave, uint32_t addr, uint8_t data)
+{
+	qiprog_err ret;
+	size_t len = wave->len;
+
+	ret = wave_put_header(wave, 0x6, addr);
+	ret |= wave_put(wave, data & LPC_WAVE_LAD);
+	ret |= wave_put(wave, (data >> 4) & LPC_WAVE_LAD);
+	ret |= wave_put_tar_sync(wave);
+	ret |= wave_put_tar_host(wave);
+
+	if (ret != QIPROG_SUCCESS) {
+		wave->len = len;
+		return QIPROG_ERR_ARG;
+	}
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Change the address of a memory cycle which is already in a waveform
+ *
+ * @param[in] wave The waveform to change
+ * @param[in] frame Step at which the cycle starts
+ * @param[in] addr The new address
+ */
+void lpc_wave_patch_addr(struct lpc_wave *wave, size_t frame, uint32_t addr)
+{
+	uint16_t *step = wave->step + frame + LPC_WAVE_ADDR_STEP;
+	int shift;
+
+	for (shift = 28; shift >= 0; shift -= 4)
+		*step++ = (addr >> shift) & LPC_WAVE_LAD;
+}
+
+/**
+ * @brief Change the data of a write cycle which is already in a waveform
+ *
+ * @param[in] wave The waveform to change
+ * @param[in] frame Step at which the write cycle starts
+ * @param[in] data The new data byte
+ */
+void lpc_wave_patch_data(struct lpc_wave *wave, size_t frame, uint8_t data)
+{
+	uint16_t *step = wave->step + frame + LPC_WAVE_DATA_STEP;
+
+	step[0] = data & LPC_WAVE_LAD;
+	step[1] = (data >> 4) & LPC_WAVE_LAD;
+}
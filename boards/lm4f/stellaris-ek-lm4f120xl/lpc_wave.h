@@ -0,0 +1,65 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LPC_WAVE_H
+#define LPC_WAVE_H
+
+#include <qiprog.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Longest waveform we can hold; enough for seven memory cycles */
+#define LPC_WAVE_MAX_STEPS	128
+
+/*
+ * One step describes one LPC clock period. The lower nibble is the value we
+ * drive on LAD[3:0], the upper bits say what else happens during the clock.
+ */
+enum lpc_wave_flags {
+	LPC_WAVE_LAD = 0x0f,	/**< Value driven on LAD[3:0] */
+	LPC_WAVE_LFRAME = 0x10,	/**< #LFRAME asserted for this clock */
+	LPC_WAVE_FLOAT = 0x20,	/**< LAD[3:0] released to the slave */
+	LPC_WAVE_SAMPLE = 0x40,	/**< Data nibble, stored LSN first */
+	LPC_WAVE_TAR = 0x80,	/**< Last TAR clock, may carry an early SYNC */
+	LPC_WAVE_SYNC = 0x100,	/**< SYNC clock, skipped after an early SYNC */
+};
+
+/*
+ * Where the address, and the data of a write, start within one memory cycle.
+ * They are the only steps which change from one cycle to the next.
+ */
+#define LPC_WAVE_ADDR_STEP	2
+#define LPC_WAVE_DATA_STEP	10
+
+struct lpc_wave {
+	size_t len;
+	size_t num_reads;
+	uint16_t step[LPC_WAVE_MAX_STEPS];
+};
+
+void lpc_wave_init(struct lpc_wave *wave);
+qiprog_err lpc_wave_mread(struct lpc_wave *wave, uint32_t addr);
+qiprog_err lpc_wave_mwrite(struct lpc_wave *wave, uint32_t addr, uint8_t data);
+void lpc_wave_patch_addr(struct lpc_wave *wave, size_t frame, uint32_t addr);
+void lpc_wave_patch_data(struct lpc_wave *wave, size_t frame, uint8_t data);
+
+/* lpc_io.c */
+qiprog_err lpc_wave_play(const struct lpc_wave *wave, uint8_t * rdata);
+
+#endif				/* LPC_WAVE_H */
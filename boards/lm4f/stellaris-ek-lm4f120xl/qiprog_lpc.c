@@ -17,30 +17,173 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "aamux.h"
 #include "led.h"
+#include "lpc_calib.h"
 #include "lpc_io.h"
+#include "stellaris.h"
 
 #include <blackbox.h>
+#include <chip_db.h>
+#include <cmd_script.h>
+#include <config.h>
+#include <jobs.h>
+#include <profile.h>
+#include <timebase.h>
 #include <qiprog_usb_dev.h>
 #include <jedec_flash.h>
 #include <stdbool.h>
+#include <string.h>
 
 static struct qiprog_driver stellaris_lpc_drv;
-static uint32_t chip_size = 0;
-static uint32_t block_size = 0;
-static uint32_t sector_size = 0;
+struct qiprog_device stellaris_lpc_dev;
 static bool auto_erase = false;
 
-static uint32_t saved_chip_size = 0;
+/*
+ * Several chips may share the LAD bus, each in its own socket. Socket n has its
+ * ID straps tied to n, so its chip only decodes the 4 MiB window with
+ * A[25:22] = ~n, and FWH cycles with IDSEL = n. Chip 0 is the boot device, at
+ * the top of the address space. Sockets are populated starting from 0.
+ *
+ * Each chip has a session, which holds its geometry, where it is mapped, and
+ * the command mask found when probing it. QiProg read() and write() use
+ * chip-relative addresses. Writes go to every chip in gang_mask, and reads come
+ * from the first of them. All chips must have the same size.
+ */
+static struct jedec_chip chips[CONFIG_MAX_CHIPS];
+static uint8_t chips_present = 1;
+/* Has read_chip_id() found a chip since the bus was set up? */
+static bool chips_probed = false;
+static uint8_t gang_mask = 1;
+/* Gang mask the host asked for, applied from the main loop */
+static volatile bool gang_pending = false;
+static volatile uint8_t gang_next;
+/*
+ * The bus engine set_bus() picked, which all chips use. A/A-Mux has no ID
+ * decoding, so it only reaches the chip in socket 0.
+ */
+static bool aamux_mode = false;
+/* Bus the host asked for, switched to from the main loop */
+static volatile bool bus_pending = false;
+static volatile enum qiprog_bus bus_next;
+static qiprog_err(*bus_read8) (uint32_t addr, uint8_t * data) = lpc_mread;
+static qiprog_err(*bus_write8) (uint32_t addr, uint8_t data) = lpc_mwrite;
+/* Custom erase and program sequences, for chips which have them */
+static struct cmd_script erase_scripts[CONFIG_MAX_CHIPS];
+static struct cmd_script program_scripts[CONFIG_MAX_CHIPS];
+/*
+ * Set while QiProg read() or write() are on the bus. They run from the main
+ * loop, which the USB interrupt may cut into at any point.
+ */
+static volatile bool bus_active = false;
+
+/* Is anything on the bus, or queued to use it? */
+static bool bus_work_busy(void)
+{
+	return bus_active || job_busy() || batch_busy() || verify_busy() ||
+	       bench_busy() || calib_busy();
+}
+
+/* read8() and friends take the chip index in the top byte of the address */
+#define ADDR_CHIP_SHIFT		24
+#define ADDR_CHIP(addr)		((addr) >> ADDR_CHIP_SHIFT)
+#define ADDR_OFFSET(addr)	((addr) & ((1UL << ADDR_CHIP_SHIFT) - 1))
+
+static void chip_set_size(uint8_t idx, uint32_t size)
+{
+	chips[idx].size = size;
+	chips[idx].window = 0xffffffff - size + 1 - (idx << 22);
+}
 
-static void push_chip_size(void) {
-	saved_chip_size = chip_size;
-	chip_size = 0;
+static void chips_init(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < CONFIG_MAX_CHIPS; i++) {
+		chips[i].read8 = bus_read8;
+		chips[i].write8 = bus_write8;
+		chips[i].cmd_mask = 0xffff;
+		chips[i].profile = NULL;
+		chips[i].erase_script = NULL;
+		chips[i].program_script = NULL;
+		chip_set_size(i, chips[i].size);
+	}
+	chips_probed = false;
 }
 
-static void pop_chip_size(void) {
-	chip_size = saved_chip_size;
-	saved_chip_size = 0;
+/* Where a read8() or write8() address is on the bus */
+static qiprog_err host_to_bus(uint32_t addr, uint32_t *bus)
+{
+	if (ADDR_CHIP(addr) >= CONFIG_MAX_CHIPS)
+		return QIPROG_ERR_ARG;
+
+	*bus = chips[ADDR_CHIP(addr)].window + ADDR_OFFSET(addr);
+	return QIPROG_SUCCESS;
+}
+
+static uint8_t gang_first(void)
+{
+	uint8_t chip;
+
+	for (chip = 0; chip < CONFIG_MAX_CHIPS - 1; chip++) {
+		if (gang_mask & (1 << chip))
+			break;
+	}
+	return chip;
+}
+
+static bool in_gang(uint8_t chip)
+{
+	return (gang_mask & (1 << chip)) ? true : false;
+}
+
+/* The chip reads come from, and whose geometry decides how we write */
+static struct jedec_chip *lead_chip(void)
+{
+	return &chips[gang_first()];
+}
+
+/*
+ * FWH multi-byte reads. Not every chip supports them, so we find out the
+ * first time read() is called. fwh_burst is the largest burst that works, or
+ * zero if we must fall back to single-byte LPC reads.
+ */
+static bool fwh_allowed = true;
+static bool fwh_probed = false;
+static uint32_t fwh_burst = 0;
+
+/*
+ * Differential writes. The sector being written is compared against what is
+ * already on the chip, and only erased and programmed if it differs. If the
+ * new data only clears bits, we program the bytes which differ without
+ * erasing. We track one sector at a time, since QiProg sends data in ascending
+ * order.
+ */
+#define DIFF_MAX_SECTOR		4096
+static enum stellaris_write_mode write_mode = STELLARIS_WRITE_NORMAL;
+static struct {
+	bool active;
+	bool erased;
+	bool programmed;
+	bool patched;
+	uint32_t base;
+} diff_sector;
+/* Blocks auto erase erased whole, which are written without comparing */
+static struct {
+	uint32_t start;
+	uint32_t end;
+} diff_blocks;
+static struct stellaris_diff_stats diff_stats;
+static uint8_t diff_buf[DIFF_MAX_SECTOR];
+
+static void diff_finish_sector(void)
+{
+	if (diff_sector.active && !diff_sector.erased &&
+	    !diff_sector.programmed)
+		diff_stats.skipped++;
+	if (diff_sector.active && !diff_sector.erased && diff_sector.patched)
+		diff_stats.patched++;
+	diff_sector.active = false;
 }
 
 /**
@@ -50,8 +193,14 @@ static qiprog_err lpc_open(struct qiprog_device *dev)
 {
 	(void)dev;
 
-	/* Configure pins for LPC master mode */
+	if (stellaris_bus_busy())
+		return QIPROG_ERR;
+
+	/* Configure pins for LPC master mode, then for A/A-Mux if selected */
 	lpc_init();
+	if (aamux_mode)
+		aamux_init();
+	chips_init();
 
 	return QIPROG_SUCCESS;
 }
@@ -65,7 +214,7 @@ static qiprog_err get_capabilities(struct qiprog_device *dev,
 	(void)dev;
 
 	caps->instruction_set = 0;
-	caps->bus_master = QIPROG_BUS_LPC;
+	caps->bus_master = QIPROG_BUS_ISA | QIPROG_BUS_LPC | QIPROG_BUS_FWH;
 	caps->max_direct_data = 0;
 	caps->voltages[0] = 3300;
 	caps->voltages[1] = 0;
@@ -74,15 +223,144 @@ static qiprog_err get_capabilities(struct qiprog_device *dev,
 
 static qiprog_err set_bus(struct qiprog_device *dev, enum qiprog_bus bus)
 {
+	const enum qiprog_bus supported =
+	    QIPROG_BUS_ISA | QIPROG_BUS_LPC | QIPROG_BUS_FWH;
+	bool want_aamux;
+
 	(void)dev;
 	/*
-	 * Don't worry about switching buses for now. If LPC is specified, and
-	 * only LPC, then we are happy.
+	 * LPC and FWH chips sit on the same pins, so there is nothing to switch.
+	 * We always use LPC frames for commands and single bytes. FWH frames
+	 * are only used for burst reads, and only if the host allows it.
+	 *
+	 * QIPROG_BUS_ISA selects the A/A-Mux interface of the same parts. The
+	 * chip has to be reset into it, so it can not be mixed with the others.
 	 */
-	if ((bus & QIPROG_BUS_LPC) && ((bus & ~QIPROG_BUS_LPC) == 0))
-		return QIPROG_SUCCESS;
-	else
+	if (!bus || (bus & ~supported))
+		return QIPROG_ERR_ARG;
+
+	want_aamux = (bus & QIPROG_BUS_ISA) ? true : false;
+	if (want_aamux && (bus != QIPROG_BUS_ISA))
 		return QIPROG_ERR_ARG;
+
+	if (bus_pending)
+		return QIPROG_ERR;
+	/* Don't pull the chip out from under anything which is using it */
+	if ((want_aamux != aamux_mode) && bus_work_busy())
+		return QIPROG_ERR;
+
+	/* Reset the chip from the main loop, not from this interrupt */
+	bus_next = bus;
+	bus_pending = true;
+	return QIPROG_SUCCESS;
+}
+
+/* Switch to the bus the host asked for. Nothing may be using the bus. */
+static void apply_bus(enum qiprog_bus bus)
+{
+	const bool want_aamux = (bus & QIPROG_BUS_ISA) ? true : false;
+
+	if (want_aamux != aamux_mode) {
+		aamux_mode = want_aamux;
+		bus_read8 = aamux_mode ? aamux_read : lpc_mread;
+		bus_write8 = aamux_mode ? aamux_write : lpc_mwrite;
+		lpc_init();
+		if (aamux_mode)
+			aamux_init();
+		/* A chip in another mode has to be probed again */
+		chips_init();
+		chips_present = 1;
+		gang_mask = 1;
+		gang_pending = false;
+		print_info("Bus engine: %s\n", aamux_mode ? "A/A-Mux" : "LPC");
+	}
+
+	fwh_allowed = (bus & QIPROG_BUS_FWH) ? true : false;
+	fwh_probed = false;
+}
+
+/*
+ * Set up a chip from what it reports through CFI, so the host does not have to
+ * send its geometry. Chips without CFI are left for the host to describe.
+ */
+static void chip_configure_cfi(uint8_t idx, uint32_t phys_base)
+{
+	struct jedec_cfi cfi;
+	struct jedec_chip *chip = &chips[idx];
+	uint32_t size, sector = 0, block = 0;
+	uint8_t i;
+
+	if (jedec_cfi_query(chip, phys_base, &cfi) != QIPROG_SUCCESS) {
+		print_spew("Chip %u does not support CFI\n", idx);
+		return;
+	}
+
+	chip_set_size(idx, cfi.size);
+
+	/*
+	 * A region which covers the whole chip is an erase size in its own
+	 * right. This is how SST lists both its sectors and blocks. Otherwise,
+	 * the regions describe a non-uniform layout, which we can't handle.
+	 */
+	for (i = 0; i < cfi.num_regions; i++) {
+		size = cfi.region[i].size;
+		if ((cfi.region[i].count * size) != cfi.size)
+			continue;
+		if (!sector || (size < sector))
+			sector = size;
+		if (size > block)
+			block = size;
+	}
+	if (block == sector)
+		block = 0;
+	if (sector) {
+		chip->sector_size = sector;
+		chip->block_size = block;
+	}
+
+	/* Timing is not per chip. Take it from the boot chip. */
+	for (i = 0; (idx == 0) && (i < JEDEC_NUM_OPS); i++) {
+		if (cfi.timing[i].typ_us)
+			jedec_set_timing(i, cfi.timing[i].typ_us,
+					 cfi.timing[i].max_us);
+	}
+
+	print_spew("Chip %u: CFI reports %u bytes, sector %u, block %u\n",
+		   idx, chip->size, chip->sector_size, chip->block_size);
+}
+
+/*
+ * Set up a chip from its entry in the chip database. Returns false if we don't
+ * know the part.
+ */
+static bool chip_configure_profile(uint8_t idx, const struct qiprog_chip_id *id)
+{
+	const struct chip_profile *prof;
+	struct jedec_chip *chip = &chips[idx];
+	uint8_t i;
+
+	prof = chip_db_find(id->vendor_id, id->device_id);
+	chip->profile = prof;
+	if (!prof)
+		return false;
+
+	chip_set_size(idx, prof->size);
+	chip->sector_size = prof->sector_size;
+	chip->block_size = prof->block_size;
+
+	/* Timing and polling are not per chip. Take them from the boot chip. */
+	for (i = 0; (idx == 0) && (i < JEDEC_NUM_OPS); i++)
+		jedec_set_timing(i, prof->timing[i].typ_us,
+				 prof->timing[i].max_us);
+	if (idx == 0)
+		jedec_set_poll_method(prof->poll_method);
+
+	if (!(prof->buses & QIPROG_BUS_LPC))
+		print_warn("%s does not decode LPC cycles\n", prof->name);
+
+	print_spew("Chip %u: %s, %u bytes, sector %u, block %u\n", idx,
+		   prof->name, chip->size, chip->sector_size, chip->block_size);
+	return true;
 }
 
 static qiprog_err read_chip_id(struct qiprog_device *dev,
@@ -90,31 +368,43 @@ static qiprog_err read_chip_id(struct qiprog_device *dev,
 {
 	qiprog_err ret = 0;
 	uint8_t mfg_id, dev_id;
-	uint32_t mask, old_size;
+	uint32_t i;
 
 	(void)dev;
 
+	if (stellaris_bus_busy())
+		return QIPROG_ERR;
+
 	led_on(LED_B);
 
 	/*
-	 * jedec_probe() uses physical addresses, so by setting chip_size to
-	 * zero, we ensure we read and write to the physical address.
+	 * Run the JEDEC probing sequence on every socket, until we find one
+	 * which is empty. Most, if not all LPC chips support it. The command
+	 * mask which worked is kept in the chip's session, and used for all
+	 * further commands. Parts in the chip database are set up from their
+	 * profile. Other chips which support CFI get their geometry from it.
 	 */
-	old_size = chip_size;
-	chip_size = 0;
+	chips_present = 0;
+	for (i = 0; i < (aamux_mode ? 1 : CONFIG_MAX_CHIPS); i++) {
+		ret |= jedec_probe(&chips[i], &ids[i], 0xffff0000 - (i << 22));
+		if (ids[i].id_method == QIPROG_ID_INVALID)
+			break;
+		chips_present |= 1 << i;
+		if (!chip_configure_profile(i, &ids[i]))
+			chip_configure_cfi(i, 0xffff0000 - (i << 22));
+	}
 
-	/*
-	 * Run the JEDEC probing sequence. Most, if not all LPC chips support
-	 * it.
-	 * TODO: Do not worry about saving the command mask for now. We do not
-	 * yet know if we want to use the mask we got from probing, or a mask
-	 * supplied by the host.
-	 */
-	ret = jedec_probe(dev, ids, 0xffff0000, &mask);
-	chip_size = old_size;
+	/* Terminate the list */
+	for (; i < 9; i++)
+		ids[i].id_method = QIPROG_ID_INVALID;
 
-	/* We only allow connecting one chip. */
-	ids[1].id_method = QIPROG_ID_INVALID;
+	/* Write to all chips we found, or to chip 0 if there are none */
+	gang_mask = chips_present ? chips_present : 1;
+	chips_probed = chips_present ? true : false;
+	gang_pending = false;
+
+	/* This may be a different chip. Find out again if it can burst. */
+	fwh_probed = false;
 
 	led_off(LED_B);
 
@@ -122,16 +412,73 @@ static qiprog_err read_chip_id(struct qiprog_device *dev,
 	return ret;
 }
 
+/**
+ * @brief Queue a change of which chips are written to
+ *
+ * Reads come from the lowest chip in the mask. The change is done from the
+ * main loop, once the QiProg write() in progress has returned. This may be
+ * called from an interrupt.
+ */
+qiprog_err stellaris_set_gang_mask(uint8_t mask)
+{
+	if (!mask || (mask & ~chips_present))
+		return QIPROG_ERR_ARG;
+
+	gang_next = mask;
+	gang_pending = true;
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Apply bus settings which were queued from the USB interrupt
+ *
+ * A new gang mask takes effect right away. A switch of the bus waits until
+ * nothing is using the bus. Call this from the main loop, outside of QiProg
+ * read() and write().
+ */
+void stellaris_bus_step(void)
+{
+	if (gang_pending) {
+		gang_pending = false;
+		/* The chips may have been probed again since it was queued */
+		if (!(gang_next & ~chips_present)) {
+			/* The sector being tracked belongs to the old lead chip */
+			diff_finish_sector();
+			gang_mask = gang_next;
+		}
+	}
+
+	if (!bus_pending || bus_work_busy())
+		return;
+
+	apply_bus(bus_next);
+	bus_pending = false;
+}
+
 static qiprog_err set_chip_size(struct qiprog_device *dev, uint8_t chip_idx,
 				uint32_t size)
 {
+	uint8_t i;
+
 	(void) dev;
 
-	/* Only one chip suported */
-	if (chip_idx != 0)
+	if (chip_idx >= CONFIG_MAX_CHIPS)
 		return QIPROG_ERR_ARG;
 
-	chip_size = size;
+	/* Writes go to the same addresses on every chip */
+	if (chip_idx && (size != chips[0].size)) {
+		print_err("All chips must have the same size\n");
+		return QIPROG_ERR_ARG;
+	}
+
+	/* Chip 0 sets the default for the others */
+	for (i = chip_idx; i < CONFIG_MAX_CHIPS; i++) {
+		chip_set_size(i, size);
+		if (chip_idx)
+			break;
+	}
+
+	fwh_probed = false;
 	return QIPROG_SUCCESS;
 }
 
@@ -140,37 +487,61 @@ static qiprog_err set_erase_size(struct qiprog_device *dev, uint8_t chip_idx,
 				 size_t num_sizes)
 {
 	size_t i;
+	uint8_t idx;
+	uint32_t block = 0, sector = 0;
 
 	(void)dev;
 
-	/* We only support one connected chip */
-	if (chip_idx > 0)
+	if (chip_idx >= CONFIG_MAX_CHIPS)
 		return QIPROG_ERR_ARG;
 
-	/* Reset any previous values */
-	block_size = sector_size = 0;
 	/* Find the block and/or sector sizes */
 	for (i = 0; i < num_sizes; i++) {
 		if (types[i] == QIPROG_ERASE_TYPE_SECTOR) {
-			sector_size = sizes[i];
-			print_spew("Sector size set to %u\n", sector_size);
+			sector = sizes[i];
 			continue;
 		}
 		if (types[i] == QIPROG_ERASE_TYPE_BLOCK) {
-			block_size = sizes[i];
-			print_spew("Block size set to %u\n", block_size);
+			block = sizes[i];
 			continue;
 		}
 	}
 
-	if (!sector_size && !block_size) {
+	if (!sector && !block) {
 		print_err("No sector or block size specified\n");
 		return QIPROG_ERR_ARG;
 	}
 
+	/* Chip 0 sets the default for the others */
+	for (idx = chip_idx; idx < CONFIG_MAX_CHIPS; idx++) {
+		chips[idx].sector_size = sector;
+		chips[idx].block_size = block;
+		if (chip_idx)
+			break;
+	}
+	print_spew("Sector size set to %u\n", sector);
+	print_spew("Block size set to %u\n", block);
+
 	return QIPROG_SUCCESS;
 }
 
+/* Use 'script' for erasing or programming. NULL means the JEDEC sequences. */
+static void set_script(uint8_t chip_idx, const struct cmd_script *script,
+		       bool erase)
+{
+	uint8_t i;
+
+	/* Chip 0 sets the default for the others */
+	for (i = chip_idx; i < CONFIG_MAX_CHIPS; i++) {
+		if (erase)
+			chips[i].erase_script = script;
+		else
+			chips[i].program_script = script;
+		if (chip_idx)
+			break;
+	}
+}
+
 static qiprog_err set_erase_command(struct qiprog_device *dev, uint8_t chip_idx,
 				    enum qiprog_erase_cmd cmd,
 				    enum qiprog_erase_subcmd subcmd,
@@ -178,11 +549,15 @@ static qiprog_err set_erase_command(struct qiprog_device *dev, uint8_t chip_idx,
 {
 	(void)dev;
 
-	/* We only support one connected chip */
-	if (chip_idx > 0)
+	if (chip_idx >= CONFIG_MAX_CHIPS)
 		return QIPROG_ERR_ARG;
 
-	/* We only support JEDEC_ISA sequences at the moment */
+	/* Custom sequences come with set_custom_erase_command() */
+	if (cmd == QIPROG_ERASE_CMD_CUSTOM) {
+		auto_erase = (flags & QIPROG_ERASE_BEFORE_WRITE) ? true : false;
+		return QIPROG_SUCCESS;
+	}
+
 	if ((cmd != QIPROG_ERASE_CMD_JEDEC_ISA) ||
 	    (subcmd != QIPROG_ERASE_SUBCMD_DEFAULT)) {
 		print_err("Unsupported erase command %u:%u\n", cmd, subcmd);
@@ -190,28 +565,53 @@ static qiprog_err set_erase_command(struct qiprog_device *dev, uint8_t chip_idx,
 	}
 
 	auto_erase = (flags & QIPROG_ERASE_BEFORE_WRITE) ? true : false;
+	set_script(chip_idx, NULL, true);
 
 	print_spew("Using JEDEC ISA erase sequence %s\n", (auto_erase) ?
 		   "with auto erase":"");
 	return QIPROG_SUCCESS;
 }
 
+/*
+ * Load a custom erase or program script for a chip. The script of chip 0 is
+ * also used by the others, unless they get their own.
+ */
+static qiprog_err load_script(uint8_t chip_idx, enum cmd_script_type type,
+			      uint32_t *addr, uint8_t *data, size_t num_ops)
+{
+	struct cmd_script *script;
+	qiprog_err ret;
+	const bool erase = (type == CMD_SCRIPT_ERASE);
+
+	if (chip_idx >= CONFIG_MAX_CHIPS)
+		return QIPROG_ERR_ARG;
+
+	/* Queued jobs may be running the script we are about to replace */
+	if (job_busy())
+		return QIPROG_ERR;
+
+	script = erase ? &erase_scripts[chip_idx] : &program_scripts[chip_idx];
+	ret = cmd_script_load(script, type, addr, data, num_ops);
+	if (ret != QIPROG_SUCCESS) {
+		print_err("Invalid custom %s sequence\n",
+			  erase ? "erase" : "write");
+		set_script(chip_idx, NULL, erase);
+		return ret;
+	}
+
+	set_script(chip_idx, script, erase);
+	print_spew("Using custom %s sequence of %u ops\n",
+		   erase ? "erase" : "write", script->num_ops);
+	return QIPROG_SUCCESS;
+}
+
 static qiprog_err set_custom_erase_command(struct qiprog_device *dev,
 					   uint8_t chip_idx, uint32_t *addr,
 					   uint8_t *data, size_t num_bytes)
 {
 	(void)dev;
 
-	/* FIXME: This is a stub */
-	(void)addr;
-	(void)data;
-	(void)num_bytes;
-
-	/* We only support one connected chip */
-	if (chip_idx > 0)
-		return QIPROG_ERR_ARG;
-
-	return QIPROG_ERR;
+	return load_script(chip_idx, CMD_SCRIPT_ERASE, addr, data, num_bytes);
 }
 
 static qiprog_err set_write_command(struct qiprog_device *dev, uint8_t chip_idx,
@@ -220,17 +620,20 @@ static qiprog_err set_write_command(struct qiprog_device *dev, uint8_t chip_idx,
 {
 	(void)dev;
 
-	/* We only support one connected chip */
-	if (chip_idx > 0)
+	if (chip_idx >= CONFIG_MAX_CHIPS)
 		return QIPROG_ERR_ARG;
 
-	/* We only support JEDEC_ISA sequences at the moment */
+	/* Custom sequences come with set_custom_write_command() */
+	if (cmd == QIPROG_WRITE_CMD_CUSTOM)
+		return QIPROG_SUCCESS;
+
 	if ((cmd != QIPROG_WRITE_CMD_JEDEC_ISA) ||
 	    (subcmd != QIPROG_WRITE_SUBCMD_DEFAULT)) {
 		print_err("Unsupported write command %u:%u\n", cmd, subcmd);
 		return QIPROG_ERR_ARG;
 	}
 
+	set_script(chip_idx, NULL, false);
 	print_spew("Using JEDEC ISA byte-program sequence\n");
 
 	return QIPROG_SUCCESS;
@@ -242,16 +645,8 @@ static qiprog_err set_custom_write_command(struct qiprog_device *dev,
 {
 	(void)dev;
 
-	/* FIXME: This is a stub */
-	(void)addr;
-	(void)data;
-	(void)num_bytes;
-
-	/* We only support one connected chip */
-	if (chip_idx > 0)
-		return QIPROG_ERR_ARG;
-
-	return QIPROG_ERR;
+	return load_script(chip_idx, CMD_SCRIPT_PROGRAM, addr, data,
+			   num_bytes);
 }
 
 static qiprog_err read8(struct qiprog_device *dev, uint32_t addr,
@@ -262,10 +657,13 @@ static qiprog_err read8(struct qiprog_device *dev, uint32_t addr,
 
 	(void)dev;
 
-	base = 0xffffffff - chip_size + 1 + addr;
+	if (stellaris_bus_busy())
+		return QIPROG_ERR;
+	if (host_to_bus(addr, &base) != QIPROG_SUCCESS)
+		return QIPROG_ERR_ARG;
 
 	led_on(LED_B);
-	ret = lpc_mread(base, data);
+	ret = bus_read8(base, data);
 	led_off(LED_B);
 
 	return ret;
@@ -280,12 +678,15 @@ static qiprog_err read16(struct qiprog_device *dev, uint32_t addr,
 
 	(void)dev;
 
-	base = 0xffffffff - chip_size + 1 + addr;
+	if (stellaris_bus_busy())
+		return QIPROG_ERR;
+	if (host_to_bus(addr, &base) != QIPROG_SUCCESS)
+		return QIPROG_ERR_ARG;
 
 	led_on(LED_B);
 	/* Read in little-endian order. FIXME: is this the final answer? */
-	ret |= lpc_mread(base + 0, raw);
-	ret |= lpc_mread(base + 1, raw + 1);
+	ret |= bus_read8(base + 0, raw);
+	ret |= bus_read8(base + 1, raw + 1);
 	led_off(LED_B);
 
 	return ret;
@@ -300,17 +701,20 @@ static qiprog_err read32(struct qiprog_device *dev, uint32_t addr,
 
 	(void)dev;
 
-	base = 0xffffffff - chip_size + 1 + addr;
+	if (stellaris_bus_busy())
+		return QIPROG_ERR;
+	if (host_to_bus(addr, &base) != QIPROG_SUCCESS)
+		return QIPROG_ERR_ARG;
 
 	led_on(LED_B);
 	/* Read in little-endian order. FIXME: is this the final answer? */
-	ret |= lpc_mread(base + 0, raw + 0);
-	ret |= lpc_mread(base + 1, raw + 1);
-	ret |= lpc_mread(base + 2, raw + 2);
-	ret |= lpc_mread(base + 3, raw + 3);
+	ret |= bus_read8(base + 0, raw + 0);
+	ret |= bus_read8(base + 1, raw + 1);
+	ret |= bus_read8(base + 2, raw + 2);
+	ret |= bus_read8(base + 3, raw + 3);
 	led_off(LED_B);
 
-	return QIPROG_SUCCESS;
+	return ret;
 }
 
 static qiprog_err write8(struct qiprog_device *dev, uint32_t addr, uint8_t data)
@@ -320,10 +724,13 @@ static qiprog_err write8(struct qiprog_device *dev, uint32_t addr, uint8_t data)
 
 	(void)dev;
 
-	base = 0xffffffff - chip_size + 1 + addr;
+	if (stellaris_bus_busy())
+		return QIPROG_ERR;
+	if (host_to_bus(addr, &base) != QIPROG_SUCCESS)
+		return QIPROG_ERR_ARG;
 
 	led_on(LED_R);
-	ret = lpc_mwrite(base, data);
+	ret = bus_write8(base, data);
 	led_off(LED_R);
 
 	return ret;
@@ -337,12 +744,15 @@ static qiprog_err write16(struct qiprog_device *dev, uint32_t addr,
 
 	(void)dev;
 
-	base = 0xffffffff - chip_size + 1 + addr;
+	if (stellaris_bus_busy())
+		return QIPROG_ERR;
+	if (host_to_bus(addr, &base) != QIPROG_SUCCESS)
+		return QIPROG_ERR_ARG;
 
 	led_on(LED_R);
 	/* Write in little-endian order. FIXME: is this the final answer? */
-	ret |= lpc_mwrite(base + 0, (data >> 0) & 0xff);
-	ret |= lpc_mwrite(base + 1, (data >> 8) & 0xff);
+	ret |= bus_write8(base + 0, (data >> 0) & 0xff);
+	ret |= bus_write8(base + 1, (data >> 8) & 0xff);
 	led_off(LED_R);
 
 	return ret;
@@ -356,133 +766,712 @@ static qiprog_err write32(struct qiprog_device *dev, uint32_t addr,
 
 	(void)dev;
 
-	base = 0xffffffff - chip_size + 1 + addr;
+	if (stellaris_bus_busy())
+		return QIPROG_ERR;
+	if (host_to_bus(addr, &base) != QIPROG_SUCCESS)
+		return QIPROG_ERR_ARG;
 
 	led_on(LED_R);
 	/* Write in little-endian order. FIXME: is this the final answer? */
-	ret |= lpc_mwrite(base + 0, (data >> 0) & 0xff);
-	ret |= lpc_mwrite(base + 1, (data >> 8) & 0xff);
-	ret |= lpc_mwrite(base + 2, (data >> 16) & 0xff);
-	ret |= lpc_mwrite(base + 3, (data >> 24) & 0xff);
+	ret |= bus_write8(base + 0, (data >> 0) & 0xff);
+	ret |= bus_write8(base + 1, (data >> 8) & 0xff);
+	ret |= bus_write8(base + 2, (data >> 16) & 0xff);
+	ret |= bus_write8(base + 3, (data >> 24) & 0xff);
 	led_off(LED_R);
 
 	return ret;
 }
 
+/**
+ * @brief Read 'len' bytes, one bus cycle each, like read8() to read32()
+ *
+ * The chip index is in the top byte of 'addr', as for read8(). Values wider
+ * than one byte are stored little-endian. Only call this from the main loop.
+ */
+qiprog_err stellaris_bus_read(uint32_t addr, uint8_t *buf, uint8_t len)
+{
+	uint32_t base;
+	qiprog_err ret = 0;
+	uint8_t i;
+
+	if (host_to_bus(addr, &base) != QIPROG_SUCCESS)
+		return QIPROG_ERR_ARG;
+
+	for (i = 0; i < len; i++)
+		ret |= bus_read8(base + i, buf + i);
+
+	return ret;
+}
+
+/**
+ * @brief Write 'len' bytes, one bus cycle each, like write8() to write32()
+ *
+ * See stellaris_bus_read().
+ */
+qiprog_err stellaris_bus_write(uint32_t addr, const uint8_t *buf, uint8_t len)
+{
+	uint32_t base;
+	qiprog_err ret = 0;
+	uint8_t i;
+
+	if (host_to_bus(addr, &base) != QIPROG_SUCCESS)
+		return QIPROG_ERR_ARG;
+
+	for (i = 0; i < len; i++)
+		ret |= bus_write8(base + i, buf[i]);
+
+	return ret;
+}
+
 static qiprog_err set_address(struct qiprog_device *dev, uint32_t start,
 			      uint32_t end)
 {
 	print_spew("Setting address range 0x%.8lx -> 0x%.8lx\n", start, end);
 	dev->addr.end = end;
+	diff_finish_sector();
 	/* Read and write pointers are reset when setting a new range */
 	dev->addr.pread = dev->addr.pwrite = dev->addr.start = start;
 	return QIPROG_SUCCESS;
 }
 
-static qiprog_err read(struct qiprog_device *dev, uint32_t where, void *dest,
-		       uint32_t n)
+/**
+ * @brief Find out the largest FWH burst the chip supports
+ *
+ * Read the burst-aligned area containing 'base' with an FWH burst, and compare
+ * it with what single-byte LPC reads return. Chips that don't understand a
+ * given MSIZE either don't respond at all, or return garbage.
+ */
+static void fwh_probe_burst(uint8_t idsel, uint32_t base)
+{
+	static const struct {
+		uint32_t len;
+		enum fwh_msize msize;
+	} bursts[] = {
+		{128, FWH_MSIZE_128},
+		{16, FWH_MSIZE_16},
+	};
+	uint8_t burst[128], byte;
+	uint32_t addr, i, j;
+	bool match;
+	const struct chip_profile *prof = chips[idsel].profile;
+
+	fwh_probed = true;
+	fwh_burst = 0;
+
+	/* FWH frames are an LPC engine feature */
+	if (!fwh_allowed || aamux_mode)
+		return;
+
+	/* We know what the part can do. No need to ask the bus. */
+	if (prof) {
+		if (prof->buses & QIPROG_BUS_FWH)
+			fwh_burst = prof->fwh_burst;
+		return;
+	}
+
+	for (i = 0; i < sizeof(bursts) / sizeof(bursts[0]); i++) {
+		addr = base & ~(bursts[i].len - 1);
+		if (fwh_mread(idsel, addr, burst, bursts[i].msize) !=
+		    QIPROG_SUCCESS)
+			continue;
+
+		match = true;
+		for (j = 0; j < bursts[i].len; j++) {
+			if ((lpc_mread(addr + j, &byte) != QIPROG_SUCCESS) ||
+			    (byte != burst[j])) {
+				match = false;
+				break;
+			}
+		}
+
+		if (match) {
+			fwh_burst = bursts[i].len;
+			break;
+		}
+	}
+
+	print_spew("FWH burst reads %s (%u bytes)\n",
+		   fwh_burst ? "enabled" : "not supported", fwh_burst);
+}
+
+/*
+ * Read n bytes starting at chip-relative address 'where'. Uses FWH bursts when
+ * the chip supports them. The caller must make sure no jobs are touching the
+ * chip.
+ */
+static qiprog_err read_range(const struct jedec_chip *chip, uint32_t where,
+			     uint8_t *data, uint32_t n)
 {
 	int ret = 0;
 	size_t i;
-	uint32_t req_len, base;
+	uint32_t base, left;
+	uint8_t idsel = chip - chips;
+	enum fwh_msize msize;
 
-	/* Halt on overflow */
-	if (chip_size < (where + n))
-		return QIPROG_ERR;
+	base = chip->window + where;
 
-	base = 0xffffffff - chip_size + 1 + where;
+	led_on(LED_B);
 
-	(void)dev;
+	if (!fwh_probed)
+		fwh_probe_burst(idsel, base);
+
+	for (i = 0; i < n; ) {
+		left = n - i;
+		/*
+		 * Use the largest burst which is aligned and still fits in the
+		 * request, and fall back to single-byte LPC reads at the edges.
+		 */
+		if ((fwh_burst >= 128) && !(base & 127) && (left >= 128)) {
+			msize = FWH_MSIZE_128;
+			left = 128;
+		} else if ((fwh_burst >= 16) && !(base & 15) && (left >= 16)) {
+			msize = FWH_MSIZE_16;
+			left = 16;
+		} else {
+			ret |= bus_read8(base++, data + i++);
+			continue;
+		}
+
+		if (fwh_mread(idsel, base, data + i, msize) != QIPROG_SUCCESS) {
+			/* Don't bother with bursts again. Retry as LPC. */
+			print_warn("FWH burst failed. Using LPC reads.\n");
+			fwh_burst = 0;
+			continue;
+		}
+		base += left;
+		i += left;
+	}
+	led_off(LED_B);
+
+	return ret;
+}
+
+/**
+ * @brief Read from the chip outside of QiProg transfers
+ *
+ * Addresses are relative to the chip. Like QiProg reads, this reads from the
+ * first chip in the gang. This does not move the QiProg read pointer. Only call
+ * this from the main loop.
+ */
+qiprog_err stellaris_read(uint32_t where, uint8_t *buf, uint32_t n)
+{
+	const struct jedec_chip *chip = lead_chip();
+
+	if ((where > chip->size) || (n > chip->size - where))
+		return QIPROG_ERR_ARG;
+
+	job_flush();
+	return read_range(chip, where, buf, n);
+}
+
+/**
+ * @brief Is the bus in use, or is there work queued which will use it?
+ *
+ * QiProg control requests are handled in the USB interrupt, which may have cut
+ * into the main loop while it is on the bus. Requests which touch the bus must
+ * fail while this is true.
+ */
+bool stellaris_bus_busy(void)
+{
+	return bus_pending || bus_work_busy();
+}
+
+/**
+ * @brief Is the LPC engine driving the bus?
+ *
+ * Bus timing, calibration, benchmarks and FWH bursts only apply to it. A switch
+ * to another bus which is still queued counts as not active.
+ */
+bool stellaris_lpc_active(void)
+{
+	return !aamux_mode && !bus_pending;
+}
+
+/**
+ * @brief Has a chip been found by probing?
+ */
+bool stellaris_chip_probed(void)
+{
+	return chips_probed;
+}
+
+/**
+ * @brief Size of the first chip in the gang, which reads come from
+ */
+uint32_t stellaris_chip_size(void)
+{
+	return lead_chip()->size;
+}
+
+/**
+ * @brief Read the ID of the first chip in the gang again
+ *
+ * The chip must have been probed. Only call this from the main loop.
+ */
+qiprog_err stellaris_read_id(struct qiprog_chip_id *id)
+{
+	const uint8_t idx = gang_first();
+
+	if (!(chips_present & (1 << idx)))
+		return QIPROG_ERR_ARG;
+
+	job_flush();
+	return jedec_read_id(&chips[idx], id, 0xffff0000 - (idx << 22));
+}
+
+static qiprog_err read(struct qiprog_device *dev, uint32_t where, void *dest,
+		       uint32_t n)
+{
+	qiprog_err ret;
+	uint32_t req_len;
+	uint32_t t_start = timebase_us();
+	const struct jedec_chip *chip = lead_chip();
+	PROFILE_START(cyc_start);
+
+	/* Halt on overflow */
+	if (chip->size < (where + n))
+		return QIPROG_ERR;
 
 	req_len = dev->addr.end - where;
 	n = (req_len > n) ? n : req_len;
 
-	led_on(LED_B);
-	for (i = 0; i < n; i++)
-		ret |= lpc_mread(base++, dest + i);
-	led_off(LED_B);
+	bus_active = true;
+	/* Whatever was being written must be on the chip before reading back */
+	job_flush();
 
+	ret = read_range(chip, where, dest, n);
+	bus_active = false;
+
+	usb_stream_bus_time(USB_STREAM_IN, timebase_us() - t_start);
 	/* Update the read pointer */
 	dev->addr.pread += n;
 
+	PROFILE_END(PROFILE_READ, cyc_start);
 	return ret;
 }
 
-static void erase(struct qiprog_device *dev, uint32_t start, uint32_t end)
+/* Queue erasing of [start, end) with units of 'size', if there is anything */
+static qiprog_err erase_units(const struct jedec_chip *chip, enum jedec_op op,
+			      uint32_t start, uint32_t end, uint32_t size)
+{
+	if (end <= start)
+		return QIPROG_SUCCESS;
+
+	print_spew("Erasing 0x%x -> 0x%x in units of 0x%x\n", start, end, size);
+	return job_submit_erase(chip, op, start, end - start, size);
+}
+
+/* Parts we don't know are assumed to take the chip erase command */
+static bool chip_can_erase_chip(const struct jedec_chip *chip)
+{
+	const uint8_t bus = aamux_mode ? QIPROG_BUS_ISA : QIPROG_BUS_LPC;
+
+	/* Custom erase scripts erase one unit at a time */
+	if (chip->erase_script)
+		return false;
+	if (!chip->profile)
+		return true;
+
+	return (chip->profile->chip_erase_buses & bus) ? true : false;
+}
+
+/*
+ * Queue erasing of all erase units of one chip which start within
+ * [start, end).
+ *
+ * We use as few erase commands as we can: a chip erase if the whole chip is
+ * covered and the part supports it, blocks where they fit, and sectors at the
+ * unaligned edges.
+ */
+static qiprog_err erase_chip(const struct jedec_chip *chip, uint32_t start,
+			     uint32_t end)
 {
-	uint32_t erase_size, i, erase_base, i_start, i_end;
+	qiprog_err ret;
+	uint32_t small, first, last, blk_first, blk_last;
+	const uint32_t block_size = chip->block_size;
+	const uint32_t sector_size = chip->sector_size;
+	enum jedec_op small_op;
 
 	if (!block_size && !sector_size) {
 		print_err("Erase size not specified. Skipping auto erase.\n");
 		auto_erase = false;
-		return;
+		return QIPROG_ERR_ARG;
 	}
 
-	/* Prefer block erasers over sector erasers */
-	erase_size = block_size ? block_size : sector_size;
-
-	/* Convert address range to block/sector numbers */
-	i_start = start / erase_size;
-	i_end = (end - 1) / erase_size;
-
-	/* See if the start address falls within our range */
-	for (i = i_start; i <= i_end; i++) {
-		erase_base = i * erase_size;
-		if (erase_base >= start) {
-			if (block_size) {
-				print_err("Block eraser not implemented\n");
-				return;
-				/* jedec_block_erase(dev, erase_base, 0xffff);*/
-				print_spew("Erasing block @ %u\n", erase_base);
-			} else {
-				jedec_sector_erase(dev, erase_base, 0xffff);
-				print_spew("Erasing sector at 0x%x\n",
-					   erase_base);
-			}
+	if (!start && (end >= chip->size) && chip_can_erase_chip(chip))
+		return erase_units(chip, JEDEC_OP_CHIP_ERASE, 0, chip->size,
+				   chip->size);
+
+	/* The smallest unit decides what gets erased */
+	small = sector_size ? sector_size : block_size;
+	small_op = sector_size ? JEDEC_OP_SECTOR_ERASE : JEDEC_OP_BLOCK_ERASE;
+
+	/* Only erase units which start within our range */
+	first = ((start + small - 1) / small) * small;
+	last = ((end + small - 1) / small) * small;
+	if (first >= last)
+		return QIPROG_SUCCESS;
+
+	if (!block_size || !sector_size || (block_size <= sector_size) ||
+	    chip->erase_script)
+		return erase_units(chip, small_op, first, last, small);
+
+	/* Blocks which lie entirely within [first, last) */
+	blk_first = ((first + block_size - 1) / block_size) * block_size;
+	blk_last = (last / block_size) * block_size;
+	if (blk_first >= blk_last)
+		return erase_units(chip, small_op, first, last, small);
+
+	ret = erase_units(chip, JEDEC_OP_SECTOR_ERASE, first, blk_first,
+			  sector_size);
+	ret |= erase_units(chip, JEDEC_OP_BLOCK_ERASE, blk_first, blk_last,
+			   block_size);
+	ret |= erase_units(chip, JEDEC_OP_SECTOR_ERASE, blk_last, last,
+			   sector_size);
+	return ret;
+}
+
+/*
+ * Queue erasing of [start, end) on every chip in the gang. Addresses are
+ * relative to the chip.
+ */
+static qiprog_err erase(struct qiprog_device *dev, uint32_t start, uint32_t end)
+{
+	qiprog_err ret = 0;
+	uint8_t i;
+	PROFILE_START(t_start);
+
+	(void)dev;
+
+	for (i = 0; (start < end) && (i < CONFIG_MAX_CHIPS); i++) {
+		if (in_gang(i))
+			ret |= erase_chip(&chips[i], start, end);
+	}
+
+	PROFILE_END(PROFILE_ERASE, t_start);
+	return ret;
+}
+
+/**
+ * @brief Queue erasing of a range of the chip, in the background
+ *
+ * This does not touch the bus, so it can be used from USB interrupts. Progress
+ * is reported through the job status.
+ */
+qiprog_err stellaris_erase_async(uint32_t start, uint32_t end)
+{
+	if ((end > lead_chip()->size) || (start >= end))
+		return QIPROG_ERR_ARG;
+
+	return erase(&stellaris_lpc_dev, start, end);
+}
+
+/**
+ * @brief Select between plain and differential writes
+ */
+qiprog_err stellaris_set_write_mode(enum stellaris_write_mode mode)
+{
+	if ((mode != STELLARIS_WRITE_NORMAL) && (mode != STELLARIS_WRITE_DIFF))
+		return QIPROG_ERR_ARG;
+
+	write_mode = mode;
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Get the differential write counters
+ *
+ * @param[out] stats Where to store the counters
+ * @param[in] reset Clear the counters after reading them
+ */
+void stellaris_get_diff_stats(struct stellaris_diff_stats *stats, bool reset)
+{
+	*stats = diff_stats;
+	if (reset) {
+		diff_stats.skipped = 0;
+		diff_stats.erased = 0;
+		diff_stats.programmed = 0;
+		diff_stats.patched = 0;
+	}
+}
+
+/* Queue programming of n bytes, in as many jobs as needed */
+static qiprog_err program(const struct jedec_chip *chip, uint32_t where,
+			  const uint8_t *data, uint32_t n)
+{
+	qiprog_err ret = 0;
+	uint32_t i, len;
+
+	for (i = 0; i < n; i += len) {
+		len = ((n - i) > JOB_DATA_SIZE) ? JOB_DATA_SIZE : (n - i);
+		ret |= job_submit_program(chip, where + i, data + i, len);
+	}
+	return ret;
+}
+
+static qiprog_err diff_program(const struct jedec_chip *chip, uint32_t where,
+			       const uint8_t *data, uint32_t n)
+{
+	if (!n)
+		return QIPROG_SUCCESS;
+
+	if (!diff_sector.programmed) {
+		diff_sector.programmed = true;
+		diff_stats.programmed++;
+	}
+
+	return program(chip, where, data, n);
+}
+
+/* Can we go from 'old' to 'new' by only clearing bits? */
+static bool diff_is_bit_subset(const uint8_t *old, const uint8_t *new,
+			       uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		if (new[i] & ~old[i])
+			return false;
+	}
+	return true;
+}
+
+/* Program only the bytes which differ from 'old' */
+static qiprog_err diff_patch(const struct jedec_chip *chip, uint32_t where,
+			     const uint8_t *old, const uint8_t *new,
+			     uint32_t n)
+{
+	qiprog_err ret = 0;
+	uint32_t i, run;
+
+	for (i = 0; i < n; i += run) {
+		if (old[i] == new[i]) {
+			run = 1;
+			continue;
 		}
+		for (run = 1; (i + run) < n; run++) {
+			if (old[i + run] == new[i + run])
+				break;
+		}
+		ret |= diff_program(chip, where + i, new + i, run);
 	}
+
+	diff_sector.patched = true;
+	return ret;
 }
 
+/*
+ * Write a piece of data which does not cross a sector boundary. 'end' is the
+ * end of the QiProg address range.
+ */
+static qiprog_err diff_write_sector(const struct jedec_chip *chip,
+				    uint32_t where, const uint8_t *data,
+				    uint32_t n, uint32_t end)
+{
+	qiprog_err ret;
+	uint32_t base, sector_end;
+	const uint32_t sector_size = chip->sector_size;
+
+	base = where - (where % sector_size);
+	sector_end = base + sector_size;
+
+	if (!diff_sector.active || (diff_sector.base != base)) {
+		diff_finish_sector();
+		diff_sector.active = true;
+		diff_sector.erased = false;
+		diff_sector.programmed = false;
+		diff_sector.patched = false;
+		diff_sector.base = base;
+	}
+
+	/* Already erased. Anything we get from now on must be programmed. */
+	if (diff_sector.erased)
+		return diff_program(chip, where, data, n);
+
+	/* Compare with what is on the chip */
+	job_flush();
+	ret = read_range(chip, where, diff_buf, n);
+	if (ret != QIPROG_SUCCESS)
+		return ret;
+	if (!memcmp(diff_buf, data, n))
+		return QIPROG_SUCCESS;
+
+	/* Programming can clear bits on its own. No need to erase for that. */
+	if (diff_is_bit_subset(diff_buf, data, n))
+		return diff_patch(chip, where, diff_buf, data, n);
+
+	/*
+	 * The sector differs. Everything before 'where' either matched, or is
+	 * outside the range being written, and so is everything after 'end'.
+	 * Keep a copy of those, so we can put them back after the erase.
+	 */
+	ret = read_range(chip, base, diff_buf, sector_size);
+	if (ret != QIPROG_SUCCESS)
+		return ret;
+
+	ret = job_submit_erase(chip, JEDEC_OP_SECTOR_ERASE, base, sector_size,
+			       sector_size);
+	if (ret != QIPROG_SUCCESS)
+		return ret;
+	diff_sector.erased = true;
+	diff_stats.erased++;
+
+	ret |= diff_program(chip, base, diff_buf, where - base);
+	if (end < sector_end)
+		ret |= diff_program(chip, end, diff_buf + (end - base),
+				    sector_end - end);
+	ret |= diff_program(chip, where, data, n);
+
+	return ret;
+}
+
+/*
+ * With auto erase, blocks which lie entirely within [start, end) are erased
+ * whole, like erase_chip() would, rather than one sector at a time. Nothing on
+ * them needs to be kept, so they are not compared either. Only the sectors at
+ * the unaligned edges of the range go through diff_write_sector().
+ */
+static qiprog_err diff_erase_blocks(const struct jedec_chip *chip,
+				    uint32_t start, uint32_t end)
+{
+	qiprog_err ret;
+	uint32_t first, last;
+	const uint32_t block_size = chip->block_size;
+
+	diff_blocks.start = diff_blocks.end = 0;
+	if (!auto_erase || (write_mode != STELLARIS_WRITE_NORMAL))
+		return QIPROG_SUCCESS;
+	if (!block_size || (block_size <= chip->sector_size) ||
+	    chip->erase_script)
+		return QIPROG_SUCCESS;
+
+	end = (end > chip->size) ? chip->size : end;
+	first = ((start + block_size - 1) / block_size) * block_size;
+	last = (end / block_size) * block_size;
+	if (first >= last)
+		return QIPROG_SUCCESS;
+
+	/* Blocks which won't be erased must be compared like the rest */
+	ret = erase_units(chip, JEDEC_OP_BLOCK_ERASE, first, last, block_size);
+	if (ret != QIPROG_SUCCESS)
+		return ret;
+
+	diff_blocks.start = first;
+	diff_blocks.end = last;
+	diff_stats.erased += (last - first) / chip->sector_size;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err diff_write(struct qiprog_device *dev,
+			     const struct jedec_chip *chip, uint32_t where,
+			     const uint8_t *data, uint32_t n)
+{
+	qiprog_err ret = 0;
+	uint32_t i, len;
+
+	if (where == dev->addr.start)
+		ret |= diff_erase_blocks(chip, dev->addr.start, dev->addr.end);
+
+	for (i = 0; i < n; i += len) {
+		len = chip->sector_size - ((where + i) % chip->sector_size);
+		len = ((n - i) > len) ? len : (n - i);
+		if (((where + i) >= diff_blocks.start) &&
+		    ((where + i) < diff_blocks.end)) {
+			diff_finish_sector();
+			ret |= program(chip, where + i, data + i, len);
+			continue;
+		}
+		ret |= diff_write_sector(chip, where + i, data + i, len,
+					 dev->addr.end);
+	}
+
+	/* Nothing more is coming for the last sector */
+	if ((where + n) >= dev->addr.end)
+		diff_finish_sector();
+
+	return ret;
+}
+
+/*
+ * Programming is queued to the job engine, and happens while QiProg receives
+ * the next buffer. Errors are reported by the next write(), and by the job
+ * status.
+ */
 static qiprog_err write(struct qiprog_device *dev, uint32_t where, void *src,
 			uint32_t n)
 {
-	int ret = 0;
-	size_t i;
-	uint32_t req_len, base;
+	qiprog_err ret;
+	uint32_t req_len, i, len;
 	uint8_t *data = src;
+	uint32_t t_start = timebase_us();
+	const struct jedec_chip *chip = lead_chip();
+	uint8_t idx;
+	bool whole_chip;
+	PROFILE_START(cyc_start);
 
 	/* Halt on overflow */
-	if (chip_size < (where + n))
+	if (chip->size < (where + n))
 		return QIPROG_ERR;
 
-	base = 0xffffffff - chip_size + 1 + where;
+	whole_chip = !dev->addr.start && (dev->addr.end >= chip->size) &&
+		     chip_can_erase_chip(chip);
 
 	req_len = dev->addr.end - where;
 	n = (req_len > n) ? n : req_len;
 
-	/* JEDEC commands work with absolute addresses */
-	push_chip_size();
+	bus_active = true;
+	/*
+	 * The erase for a new range is queued with its first buffer. Jobs
+	 * left over from the last range could have the queue full by then.
+	 */
+	if (where == dev->addr.start)
+		job_flush();
 
-	/* Erase if needed */
-	if (auto_erase)
-		erase(dev, base, base + n);
+	/* Report failures from previous buffers */
+	ret = job_clear_error();
 
 	/*
-	 * A few things to note:
-	 * We may want to optimize the loop to reduce the number of function
-	 * calls and the bus idle time.
-	 * We currently use a mask of 0xffff, but we may want to detect the
-	 * correct mask and use that instead.
+	 * Differential writes take care of erasing on their own, and only
+	 * erase sectors which need it. That's what auto erase wants too, so
+	 * use them for it, unless the whole chip is rewritten and the part
+	 * has a chip erase, which is faster. Blocks which the range covers
+	 * are still erased whole, see diff_erase_blocks(). We need to keep a
+	 * copy of the sector in RAM, so very large sectors are written the
+	 * normal way. We only track one chip, so gang writes are also done
+	 * the normal way.
 	 */
-	led_on(LED_R);
-	for (i = 0; i < n; i++)
-		ret |= jedec_program_byte(dev, base++, data[i], 0xffff);
-	led_off(LED_R);
+	if (((write_mode == STELLARIS_WRITE_DIFF) ||
+	     (auto_erase && !whole_chip)) &&
+	    (gang_mask == (1 << gang_first())) && chip->sector_size &&
+	    (chip->sector_size <= DIFF_MAX_SECTOR)) {
+		ret |= diff_write(dev, chip, where, data, n);
+		goto done;
+	}
+
+	/* Erase the whole range with the first buffer, so erase() can plan */
+	if (auto_erase && (where == dev->addr.start))
+		ret |= erase(dev, dev->addr.start, dev->addr.end);
+
+	/*
+	 * Every chip gets its own jobs for the same data, so the job engine
+	 * can program one chip while the others are busy.
+	 */
+	for (i = 0; i < n; i += len) {
+		len = ((n - i) > JOB_DATA_SIZE) ? JOB_DATA_SIZE : (n - i);
+		for (idx = 0; idx < CONFIG_MAX_CHIPS; idx++) {
+			if (in_gang(idx))
+				ret |= program(&chips[idx], where + i,
+					       data + i, len);
+		}
+	}
 
-	pop_chip_size();
+ done:
+	bus_active = false;
+	usb_stream_bus_time(USB_STREAM_OUT, timebase_us() - t_start);
 	/* Update the write pointer */
 	dev->addr.pwrite += n;
 
+	PROFILE_END(PROFILE_WRITE, cyc_start);
 	return ret;
 }
 
@@ -18,10 +18,14 @@
  */
 
 #include "stellaris.h"
+#include "aamux.h"
 #include "led.h"
+#include "lpc_calib.h"
+#include "lpc_io.h"
 
 #include <qiprog_usb_dev.h>
 
+#include <libopencm3/cm3/cortex.h>
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/lm4f/systemcontrol.h>
 #include <libopencm3/lm4f/rcc.h>
@@ -32,6 +36,9 @@
 #include <stdio.h>
 
 #include <blackbox.h>
+#include <jobs.h>
+#include <profile.h>
+#include <timebase.h>
 
 /* This is how the user switches are connected to GPIOF */
 enum {
@@ -48,6 +55,7 @@ enum {
 	PLL_DIV_16MHZ = 25,
 };
 
+/* In the order of enum stellaris_clock */
 static const uint8_t plldiv[] = {
 	PLL_DIV_80MHZ,
 	PLL_DIV_57MHZ,
@@ -61,6 +69,9 @@ static const uint8_t plldiv[] = {
 static size_t ipll = 0;
 /* Are we bypassing the PLL, or not? */
 static bool bypass = false;
+/* Clock change requested by the buttons or the host, done from the main loop */
+static volatile bool clock_pending = false;
+static volatile enum stellaris_clock clock_next;
 
 /*
  * Clock setup:
@@ -70,6 +81,92 @@ static bool bypass = false;
 static void clock_setup(void)
 {
 	rcc_sysclk_config(OSCSRC_MOSC, XTAL_16M, PLL_DIV_80MHZ);
+	timebase_init(400000000 / PLL_DIV_80MHZ);
+}
+
+/**
+ * @brief The core clock we are currently running at, in Hz
+ */
+uint32_t stellaris_core_hz(void)
+{
+	if (bypass)
+		return 16000000;
+
+	return 400000000 / plldiv[ipll];
+}
+
+/**
+ * @brief The core clock we are currently running at
+ */
+enum stellaris_clock stellaris_get_clock(void)
+{
+	return bypass ? STELLARIS_CLOCK_16MHZ_MOSC : ipll;
+}
+
+/**
+ * @brief Queue a change of the core clock
+ *
+ * The change is done from the main loop, between bus operations. This may be
+ * called from an interrupt.
+ */
+qiprog_err stellaris_set_clock(enum stellaris_clock clk)
+{
+	if (clk >= STELLARIS_NUM_CLOCKS)
+		return QIPROG_ERR_ARG;
+
+	clock_next = clk;
+	clock_pending = true;
+	return QIPROG_SUCCESS;
+}
+
+/*
+ * Switch to the clock which was asked for
+ *
+ * Everything derived from the core clock follows: the SysTick timebase, and
+ * the bus delays of both engines, so a calibrated bus timing stays safe. The
+ * UART runs from the PIOSC, so its baud rate does not change. Bus operations
+ * are timed in core clocks, so the switch waits until nothing uses the bus.
+ */
+static void handle_clock(void)
+{
+	enum stellaris_clock clk;
+	uint32_t old_hz, new_hz, irq_mask;
+
+	if (!clock_pending || stellaris_bus_busy())
+		return;
+
+	clk = clock_next;
+	clock_pending = false;
+	if (clk == stellaris_get_clock())
+		return;
+
+	old_hz = stellaris_core_hz();
+
+	irq_mask = cm_mask_interrupts(1);
+	if (clk == STELLARIS_CLOCK_16MHZ_MOSC) {
+		bypass = true;
+		rcc_pll_bypass_enable();
+		/*
+		 * The divisor is still applied to the raw clock.
+		 * Disable the divisor, or we'll divide the raw clock.
+		 */
+		SYSCTL_RCC &= ~SYSCTL_RCC_USESYSDIV;
+	} else {
+		bypass = false;
+		ipll = clk;
+		rcc_change_pll_divisor(plldiv[ipll]);
+	}
+	new_hz = stellaris_core_hz();
+	timebase_set_clock(new_hz);
+	lpc_scale_timing(old_hz, new_hz);
+	aamux_set_clock(new_hz);
+	cm_mask_interrupts(irq_mask);
+
+	if (bypass)
+		print_info("Changing system clock to 16MHz MOSC\n");
+	else
+		print_info("Changing system clock to %iMHz\n",
+			   400 / plldiv[ipll]);
 }
 
 /*
@@ -146,10 +243,49 @@ static void handle_led(void)
 	}
 }
 
+/*
+ * Process QiProg transfers queued by the USB interrupt
+ */
+static void handle_events(void)
+{
+	PROFILE_START(t_start);
+
+	qiprog_handle_events();
+	PROFILE_END(PROFILE_HANDLE_EVENTS, t_start);
+}
+
+/*
+ * Advance background erase/program jobs by one step
+ *
+ * The red LED is lit for as long as there is work queued.
+ */
+static void handle_jobs(void)
+{
+	uint32_t t_start;
+
+	if (!job_busy()) {
+		led_off(LED_R);
+		/* Register lists and checksums wait for pending writes */
+		batch_step();
+		verify_step();
+		bench_step();
+		calib_step();
+		return;
+	}
+
+	led_on(LED_R);
+	t_start = timebase_us();
+	job_step();
+	usb_stream_bus_time(USB_STREAM_OUT, timebase_us() - t_start);
+}
+
 int main(void)
 {
 	gpio_enable_ahb_aperture();
 	clock_setup();
+#if CONFIG_PROFILE
+	profile_init();
+#endif
 	/* Must be called before any printf() */
 	blackbox_init();
 	print_info("\nVultureprog: QiProg for the Stellaris Launchpad\n");
@@ -163,7 +299,10 @@ int main(void)
 
 	/* The magic that doesn't happen in USB interrupts, happens here */
 	while (1) {
-		qiprog_handle_events();
+		handle_events();
+		stellaris_bus_step();
+		handle_jobs();
+		handle_clock();
 		handle_led();
 	}
 
@@ -174,20 +313,10 @@ void gpiof_isr(void)
 {
 	if (gpio_is_interrupt_source(GPIOF, USR_SW1)) {
 		/* SW1 was just depressed */
-		bypass = !bypass;
-		if (bypass) {
-			rcc_pll_bypass_enable();
-			/*
-			 * The divisor is still applied to the raw clock.
-			 * Disable the divisor, or we'll divide the raw clock.
-			 */
-			print_info("Changing system clock to 16MHz MOSC\n");
-			SYSCTL_RCC &= ~SYSCTL_RCC_USESYSDIV;
-		} else {
-			print_info("Changing system clock to %iMHz\n",
-				   400 / plldiv[ipll]);
-			rcc_change_pll_divisor(plldiv[ipll]);
-		}
+		if (bypass)
+			stellaris_set_clock(ipll);
+		else
+			stellaris_set_clock(STELLARIS_CLOCK_16MHZ_MOSC);
 		/* Clear interrupt source */
 		gpio_clear_interrupt_flag(GPIOF, USR_SW1);
 	}
@@ -195,11 +324,10 @@ void gpiof_isr(void)
 	if (gpio_is_interrupt_source(GPIOF, USR_SW2)) {
 		/* SW2 was just depressed */
 		if (!bypass) {
-			if (plldiv[++ipll] == 0)
-				ipll = 0;
-			print_info("Changing system clock to %iMHz\n",
-				   400 / plldiv[ipll]);
-			rcc_change_pll_divisor(plldiv[ipll]);
+			if (plldiv[ipll + 1] == 0)
+				stellaris_set_clock(0);
+			else
+				stellaris_set_clock(ipll + 1);
 		}
 		/* Clear interrupt source */
 		gpio_clear_interrupt_flag(GPIOF, USR_SW2);
@@ -20,7 +20,145 @@
 #ifndef STELLARIS_H
 #define STELLARIS_H
 
+#include <qiprog.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Core clocks the host can select. All but the last run from the PLL. */
+enum stellaris_clock {
+	STELLARIS_CLOCK_80MHZ = 0,
+	STELLARIS_CLOCK_57MHZ,
+	STELLARIS_CLOCK_40MHZ,
+	STELLARIS_CLOCK_20MHZ,
+	STELLARIS_CLOCK_16MHZ,
+	STELLARIS_CLOCK_16MHZ_MOSC,	/**< PLL bypassed */
+	STELLARIS_NUM_CLOCKS,
+};
+
+enum usb_stream_dir {
+	USB_STREAM_IN = 0,	/**< Bulk IN, reading the chip */
+	USB_STREAM_OUT = 1,	/**< Bulk OUT, writing the chip */
+};
+
+struct usb_stream_stats {
+	uint32_t bytes;
+	uint32_t start_us;
+	uint32_t elapsed_us;
+	uint32_t bus_us;	/**< Time the driver spent on the bus */
+};
+
+enum stellaris_write_mode {
+	STELLARIS_WRITE_NORMAL = 0,	/**< Program everything we're given */
+	STELLARIS_WRITE_DIFF = 1,	/**< Skip sectors which already match */
+};
+
+struct stellaris_diff_stats {
+	uint32_t skipped;	/**< Sectors which already matched */
+	uint32_t erased;	/**< Sectors which had to be erased */
+	uint32_t programmed;	/**< Sectors where bytes were programmed */
+	uint32_t patched;	/**< Sectors programmed without an erase */
+};
+
+enum verify_algo {
+	VERIFY_CRC32 = 0,
+	VERIFY_SHA256 = 1,
+};
+
+enum verify_state {
+	VERIFY_IDLE = 0,
+	VERIFY_BUSY = 1,
+	VERIFY_DONE = 2,
+	VERIFY_FAILED = 3,
+};
+
+enum batch_state {
+	BATCH_IDLE = 0,
+	BATCH_BUSY = 1,
+	BATCH_DONE = 2,
+	BATCH_FAILED = 3,
+};
+
+enum bench_state {
+	BENCH_IDLE = 0,
+	BENCH_BUSY = 1,
+	BENCH_DONE = 2,
+	BENCH_FAILED = 3,
+};
+
+/* What bench.c times */
+enum bench_metric {
+	BENCH_LPC_MREAD = 0,	/**< lpc_mread(), one byte per cycle */
+	BENCH_LPC_MWRITE,	/**< lpc_mwrite(), one byte per cycle */
+	BENCH_READ,		/**< stellaris_read(), as QiProg read() does */
+	BENCH_NUM_METRICS,
+};
+
+struct bench_result {
+	uint32_t bytes;
+	uint32_t cycles;	/**< Core clock cycles for all bytes */
+};
+
+struct bench_status {
+	enum bench_state state;
+	qiprog_err error;
+	uint32_t core_hz;	/**< Core clock the run was done at */
+	uint32_t flags;		/**< Build options which change the numbers */
+	struct bench_result result[BENCH_NUM_METRICS];
+};
+
+struct verify_status {
+	enum verify_state state;
+	qiprog_err error;
+	uint32_t digests;	/**< Digests computed so far */
+	uint32_t total;		/**< Digests which will be computed */
+};
+
+/* stellaris.c */
+uint32_t stellaris_core_hz(void);
+enum stellaris_clock stellaris_get_clock(void);
+qiprog_err stellaris_set_clock(enum stellaris_clock clk);
+
 /* usb_dev.c */
 void stellaris_usb_init(void);
+void usb_set_read_pipeline(bool enable);
+void usb_get_stream_stats(enum usb_stream_dir dir,
+			  struct usb_stream_stats *stats);
+void usb_reset_stream_stats(void);
+void usb_stream_bus_time(enum usb_stream_dir dir, uint32_t us);
+
+/* qiprog_lpc.c */
+qiprog_err stellaris_erase_async(uint32_t start, uint32_t end);
+qiprog_err stellaris_read(uint32_t where, uint8_t *buf, uint32_t n);
+qiprog_err stellaris_read_id(struct qiprog_chip_id *id);
+bool stellaris_bus_busy(void);
+bool stellaris_lpc_active(void);
+bool stellaris_chip_probed(void);
+uint32_t stellaris_chip_size(void);
+qiprog_err stellaris_bus_read(uint32_t addr, uint8_t *buf, uint8_t len);
+qiprog_err stellaris_bus_write(uint32_t addr, const uint8_t *buf, uint8_t len);
+qiprog_err stellaris_set_gang_mask(uint8_t mask);
+void stellaris_bus_step(void);
+qiprog_err stellaris_set_write_mode(enum stellaris_write_mode mode);
+void stellaris_get_diff_stats(struct stellaris_diff_stats *stats, bool reset);
+
+/* batch.c */
+qiprog_err batch_submit(const uint8_t *ops, uint16_t len);
+bool batch_busy(void);
+void batch_step(void);
+const uint8_t *batch_get_result(uint16_t *len);
+
+/* bench.c */
+qiprog_err bench_submit(void);
+bool bench_busy(void);
+void bench_step(void);
+void bench_get_status(struct bench_status *stat);
+
+/* verify.c */
+qiprog_err verify_submit(enum verify_algo algo, uint32_t start, uint32_t end,
+			 uint32_t unit);
+bool verify_busy(void);
+void verify_step(void);
+void verify_get_status(struct verify_status *stat);
+const uint8_t *verify_get_digest(uint32_t idx, uint16_t *len);
 
 #endif				/* STELLARIS_H */
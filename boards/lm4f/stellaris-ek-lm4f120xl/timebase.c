@@ -0,0 +1,131 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file timebase.c SysTick-based microsecond timebase
+ *
+ * SysTick interrupts once every millisecond, and the sub-millisecond part is
+ * taken from the SysTick counter itself. It is scaled from ticks to the whole
+ * period, rather than divided by whole ticks per microsecond, so the end of a
+ * period never reads as more than a millisecond at clocks which are not a
+ * whole number of MHz. When the core clock changes, the time since the last
+ * interrupt is carried over, so the count does not jump back.
+ */
+
+#include <timebase.h>
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/systick.h>
+
+/* Microseconds up to the start of the current SysTick period */
+static volatile uint32_t base_us = 0;
+/* Rounded up, so delays are never short */
+static uint32_t ticks_per_us = 0;
+
+/* Microseconds into the current SysTick period */
+static uint32_t period_us(uint32_t value)
+{
+	const uint32_t period = systick_get_reload() + 1;
+
+	return (period - 1 - value) * 1000 / period;
+}
+
+/**
+ * \brief Set the SysTick period according to the core clock
+ *
+ * Call this with interrupts masked.
+ */
+void timebase_set_clock(uint32_t core_hz)
+{
+	systick_counter_disable();
+	/* Clearing the counter starts a new period. Keep what this one had. */
+	if (ticks_per_us)
+		base_us += period_us(systick_get_value());
+	ticks_per_us = (core_hz + 999999) / 1000000;
+	systick_set_reload(core_hz / 1000 - 1);
+	systick_clear();
+	systick_counter_enable();
+}
+
+/**
+ * \brief Start the timebase
+ */
+void timebase_init(uint32_t core_hz)
+{
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	timebase_set_clock(core_hz);
+	systick_interrupt_enable();
+}
+
+/**
+ * \brief Microseconds since timebase_init()
+ *
+ * This may be called with interrupts masked, or from an interrupt handler.
+ * Time keeps going there as long as the SysTick interrupt is not held off for
+ * more than a period.
+ */
+uint32_t timebase_us(void)
+{
+	uint32_t base, value, irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	base = base_us;
+	value = systick_get_value();
+	/*
+	 * SysTick rolled over, but its interrupt has not run yet. The counter
+	 * may have been read before or after that, so read it again.
+	 */
+	if (SCB_ICSR & SCB_ICSR_PENDSTSET) {
+		base += 1000;
+		value = systick_get_value();
+	}
+	cm_mask_interrupts(irq_mask);
+
+	return base + period_us(value);
+}
+
+/**
+ * \brief Wait for at least 'us' microseconds
+ *
+ * This counts SysTick ticks itself, rather than going by timebase_us(). That
+ * also works with interrupts masked, or in an interrupt handler, where SysTick
+ * interrupts do not get to run.
+ */
+void timebase_delay_us(uint32_t us)
+{
+	const uint32_t period = systick_get_reload() + 1;
+	uint32_t left = us * ticks_per_us;
+	uint32_t now, last, elapsed;
+
+	last = systick_get_value();
+	while (left) {
+		now = systick_get_value();
+		/* The counter counts down, and starts over after reaching 0 */
+		elapsed = (last >= now) ? last - now : last + period - now;
+		last = now;
+		left = (elapsed >= left) ? 0 : left - elapsed;
+	}
+}
+
+void sys_tick_handler(void)
+{
+	base_us += 1000;
+}
@@ -18,16 +18,22 @@
  */
 
 #include "stellaris.h"
+#include "usb_vendor.h"
 #include <blackbox.h>
+#include <profile.h>
+#include <timebase.h>
 
 #include <qiprog_usb_dev.h>
 
+#include <libopencm3/cm3/cortex.h>
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/lm4f/nvic.h>
 #include <libopencm3/lm4f/rcc.h>
 #include <libopencm3/lm4f/gpio.h>
 #include <libopencm3/lm4f/usb.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 /**
  * @file usb_dev.c Hardware-specific USB peripheral functionality
@@ -40,7 +46,8 @@ typedef void (**usb_complete_cb) (usbd_device * usbd_dev,
 				  struct usb_setup_data * req);
 
 usbd_device *qiprog_dev;
-uint8_t usbd_control_buffer[128];
+/* Large enough for the longest vultureprog batch list */
+uint8_t usbd_control_buffer[256];
 extern usbd_driver lm4f_usb_driver;
 
 /* =============================================================================
@@ -131,18 +138,235 @@ static const char *usb_strings[] = {
  * = USB "glue"
  * ---------------------------------------------------------------------------*/
 
+/*
+ * Packets waiting to go out on EP 0x81
+ *
+ * QiProg hands us the contents of qiprog_buf one packet at a time, and only
+ * reads the next buffer from the chip once all packets are accepted. Instead
+ * of waiting for the host to pick up each packet, we queue them here, and let
+ * the endpoint interrupt drain the queue. The main loop can then clock the
+ * next buffer from the bus while the previous one is still going out.
+ */
+#define TX_RING_PACKETS		8
+#define EP_PACKET_SIZE		64
+
+static struct {
+	uint8_t data[EP_PACKET_SIZE];
+	uint16_t len;
+} tx_ring[TX_RING_PACKETS];
+/* Written by the main loop only */
+static volatile uint8_t tx_head = 0;
+/* Written by the USB interrupt, or with USB interrupts masked */
+static volatile uint8_t tx_tail = 0;
+static volatile bool tx_busy = false;
+static bool read_pipeline = true;
+static volatile bool read_pipeline_req = true;
+
+static struct usb_stream_stats in_stats;
+static struct usb_stream_stats out_stats;
+
+static void stream_account(struct usb_stream_stats *stats, uint16_t len)
+{
+	uint32_t now = timebase_us();
+
+	if (!stats->bytes)
+		stats->start_us = now;
+	stats->bytes += len;
+	stats->elapsed_us = now - stats->start_us;
+}
+
+/* Queue the next packet on EP 0x81. Called with USB interrupts masked. */
+static void tx_ring_kick(void)
+{
+	uint8_t slot;
+
+	if (tx_tail == tx_head) {
+		tx_busy = false;
+		return;
+	}
+
+	slot = tx_tail % TX_RING_PACKETS;
+	if (!usbd_ep_write_packet(qiprog_dev, 0x81, tx_ring[slot].data,
+				  tx_ring[slot].len)) {
+		/* FIFO is still busy. We'll be back on the next interrupt. */
+		return;
+	}
+
+	tx_busy = true;
+	stream_account(&in_stats, tx_ring[slot].len);
+	tx_tail++;
+}
+
+/* EP 0x81 finished sending a packet */
+static void tx_complete(usbd_device * usbd_dev, uint8_t ep)
+{
+	(void)usbd_dev;
+	(void)ep;
+
+	tx_ring_kick();
+}
+
 static uint16_t send_packet(void *data, uint16_t len)
 {
-	/* Only send the packet if we receive an IN token */
-	if (USB_TXCSRL(1) & USB_TXCSRL_UNDRN)
-		return usbd_ep_write_packet(qiprog_dev, 0x81, data, len);
-	else
+	uint8_t slot;
+	uint32_t irq_mask;
+
+	/* Only switch modes once everything queued has gone out */
+	if ((read_pipeline != read_pipeline_req) && (tx_head == tx_tail))
+		read_pipeline = read_pipeline_req;
+
+	if (!read_pipeline) {
+		/* Only send the packet if we receive an IN token */
+		if (!(USB_TXCSRL(1) & USB_TXCSRL_UNDRN))
+			return 0;
+		len = usbd_ep_write_packet(qiprog_dev, 0x81, data, len);
+		if (len)
+			stream_account(&in_stats, len);
+		return len;
+	}
+
+	/* Ring is full. QiProg will try again later. */
+	if ((uint8_t)(tx_head - tx_tail) >= TX_RING_PACKETS)
 		return 0;
+
+	slot = tx_head % TX_RING_PACKETS;
+	memcpy(tx_ring[slot].data, data, len);
+	tx_ring[slot].len = len;
+	tx_head++;
+
+	irq_mask = cm_mask_interrupts(1);
+	if (!tx_busy)
+		tx_ring_kick();
+	cm_mask_interrupts(irq_mask);
+
+	return len;
+}
+
+/**
+ * @brief Turn overlapping of bus reads and bulk IN transfers on or off
+ *
+ * The switch happens once all packets still queued have been sent.
+ */
+void usb_set_read_pipeline(bool enable)
+{
+	read_pipeline_req = enable;
+}
+
+/**
+ * @brief Get the bulk transfer statistics since the last reset
+ */
+void usb_get_stream_stats(enum usb_stream_dir dir,
+			  struct usb_stream_stats *stats)
+{
+	uint32_t irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	*stats = (dir == USB_STREAM_IN) ? in_stats : out_stats;
+	cm_mask_interrupts(irq_mask);
+}
+
+/**
+ * @brief Account time the driver spent on the bus for a bulk transfer
+ *
+ * Comparing this with the elapsed time of the transfer shows how much of the
+ * time the bus was kept busy.
+ */
+void usb_stream_bus_time(enum usb_stream_dir dir, uint32_t us)
+{
+	uint32_t irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	if (dir == USB_STREAM_IN)
+		in_stats.bus_us += us;
+	else
+		out_stats.bus_us += us;
+	cm_mask_interrupts(irq_mask);
+}
+
+/**
+ * @brief Clear the bulk transfer statistics
+ */
+void usb_reset_stream_stats(void)
+{
+	uint32_t irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	memset(&in_stats, 0, sizeof(in_stats));
+	memset(&out_stats, 0, sizeof(out_stats));
+	cm_mask_interrupts(irq_mask);
+}
+
+/*
+ * Packets received on EP 0x01, waiting for QiProg
+ *
+ * QiProg only asks for the next packet once write() has programmed the whole
+ * buffer. Receiving from the endpoint interrupt instead lets the host keep
+ * streaming while the chip is being programmed. When the ring is full, the
+ * packet is left in the endpoint FIFO. The hardware NAKs any further OUT
+ * tokens until we unload it, so the host is throttled without losing data.
+ */
+#define RX_RING_PACKETS		8
+
+static struct {
+	uint8_t data[EP_PACKET_SIZE];
+	uint16_t len;
+} rx_ring[RX_RING_PACKETS];
+/* Written by the USB interrupt, or with USB interrupts masked */
+static volatile uint8_t rx_head = 0;
+/* Written by the main loop only */
+static volatile uint8_t rx_tail = 0;
+/* A packet is waiting in the FIFO because the ring was full */
+static volatile bool rx_pending = false;
+
+/* Move a packet from the EP 0x01 FIFO to the ring, if there's room */
+static void rx_ring_fill(void)
+{
+	uint8_t slot;
+
+	if ((uint8_t)(rx_head - rx_tail) >= RX_RING_PACKETS) {
+		rx_pending = true;
+		return;
+	}
+
+	slot = rx_head % RX_RING_PACKETS;
+	rx_ring[slot].len = usbd_ep_read_packet(qiprog_dev, 0x01,
+						rx_ring[slot].data,
+						EP_PACKET_SIZE);
+	rx_pending = false;
+	stream_account(&out_stats, rx_ring[slot].len);
+	rx_head++;
+}
+
+/* EP 0x01 received a packet */
+static void rx_complete(usbd_device * usbd_dev, uint8_t ep)
+{
+	(void)usbd_dev;
+	(void)ep;
+
+	rx_ring_fill();
 }
 
 static uint16_t read_packet(void *data, uint16_t len)
 {
-	return usbd_ep_read_packet(qiprog_dev, 0x01, data, len);
+	uint8_t slot;
+	uint32_t irq_mask;
+
+	if (rx_head == rx_tail)
+		return 0;
+
+	slot = rx_tail % RX_RING_PACKETS;
+	if (len > rx_ring[slot].len)
+		len = rx_ring[slot].len;
+	memcpy(data, rx_ring[slot].data, len);
+	rx_tail++;
+
+	/* We just made room. Unload the FIFO, and stop NAKing the host. */
+	irq_mask = cm_mask_interrupts(1);
+	if (rx_pending)
+		rx_ring_fill();
+	cm_mask_interrupts(irq_mask);
+
+	return len;
 }
 
 static uint8_t qiprog_buf[256];
@@ -170,9 +394,12 @@ static int qiprog_control_request(usbd_device * usbd_dev,
 	 */
 	print_spew("bRequest: 0x%.2x\n", req->bRequest);
 
-	ret = qiprog_handle_control_request(req->bRequest, req->wValue,
-					    req->wIndex, req->wLength,
-					    buf, len);
+	if (req->bRequest >= VULTUREPROG_REQ_BASE)
+		ret = usb_vendor_request(req, buf, len);
+	else
+		ret = qiprog_handle_control_request(req->bRequest, req->wValue,
+						    req->wIndex, req->wLength,
+						    buf, len);
 
 	if (ret != QIPROG_SUCCESS) {
 		print_err("Request was not handled, code %i\n", ret);
@@ -191,8 +418,8 @@ static void set_config(usbd_device * usbd_dev, uint16_t wValue)
 {
 	(void)wValue;
 	print_info("Configuring endpoints.\n\r");
-	usbd_ep_setup(usbd_dev, 0x01, USB_ENDPOINT_ATTR_BULK, 64, NULL);
-	usbd_ep_setup(usbd_dev, 0x81, USB_ENDPOINT_ATTR_BULK, 64, NULL);
+	usbd_ep_setup(usbd_dev, 0x01, USB_ENDPOINT_ATTR_BULK, 64, rx_complete);
+	usbd_ep_setup(usbd_dev, 0x81, USB_ENDPOINT_ATTR_BULK, 64, tx_complete);
 
 	usbd_register_control_callback(usbd_dev,
 				       USB_REQ_TYPE_VENDOR,
@@ -227,8 +454,8 @@ static void usb_ints_setup(void)
 	/* Gimme some interrupts */
 	usbints = USB_INT_RESET | USB_INT_DISCON | USB_INT_RESUME |
 	    USB_INT_SUSPEND;
-	/* Do not enable TX or RX callback interrupts */
-	usb_enable_interrupts(usbints, 0, 0);
+	/* EP 0x01 and EP 0x81 are serviced from their own interrupts */
+	usb_enable_interrupts(usbints, USB_EP1_INT, USB_EP1_INT);
 	nvic_enable_irq(NVIC_USB0_IRQ);
 }
 
@@ -251,5 +478,8 @@ void stellaris_usb_init(void)
  */
 void usb0_isr(void)
 {
+	PROFILE_START(t_start);
+
 	usbd_poll(qiprog_dev);
+	PROFILE_END(PROFILE_USB_ISR, t_start);
 }
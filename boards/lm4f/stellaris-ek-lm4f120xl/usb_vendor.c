@@ -0,0 +1,423 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file usb_vendor.c Vultureprog-specific vendor requests
+ *
+ * These requests are not part of the QiProg protocol. They expose features and
+ * diagnostics specific to this firmware. Like all control requests, they are
+ * handled from the USB interrupt, so they must not touch the LPC bus. Anything
+ * that needs the bus is only scheduled here, and done from the main loop.
+ */
+
+#include "lpc_calib.h"
+#include "lpc_io.h"
+#include "stellaris.h"
+#include "usb_vendor.h"
+
+#include <blackbox.h>
+#include <byteorder.h>
+#include <jedec_flash.h>
+#include <jobs.h>
+#include <profile.h>
+
+/* Response for IN requests. Must outlive the control transfer. */
+static uint32_t response[6 + PROFILE_HIST_BINS];
+
+/*
+ * Requests which take data from the host must have come with it. After an IN
+ * request, the buffer holds whatever an earlier request left there.
+ */
+static bool is_out(const struct usb_setup_data *req)
+{
+	return !(req->bmRequestType & USB_REQ_TYPE_IN);
+}
+
+static qiprog_err get_stream_stats(struct usb_setup_data *req, uint8_t ** buf,
+				   uint16_t * len)
+{
+	struct usb_stream_stats stats;
+	uint8_t *data = (void *)response;
+	uint32_t rate;
+
+	if (req->wIndex > USB_STREAM_OUT)
+		return QIPROG_ERR_ARG;
+
+	usb_get_stream_stats(req->wIndex, &stats);
+
+	rate = 0;
+	if (stats.elapsed_us)
+		rate = (uint64_t) stats.bytes * 1000000 / stats.elapsed_us;
+
+	put_le32(data + 0, stats.bytes);
+	put_le32(data + 4, stats.elapsed_us);
+	put_le32(data + 8, rate);
+	put_le32(data + 12, stats.bus_us);
+
+	*buf = data;
+	*len = (req->wLength < 16) ? req->wLength : 16;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err submit_erase(struct usb_setup_data *req, uint8_t ** buf,
+			       uint16_t * len)
+{
+	uint32_t start, end;
+
+	if (!is_out(req) || (req->wLength < 8) || (*len < 8))
+		return QIPROG_ERR_ARG;
+
+	start = get_le32(*buf + 0);
+	end = get_le32(*buf + 4);
+
+	return stellaris_erase_async(start, end);
+}
+
+static qiprog_err get_job_status(struct usb_setup_data *req, uint8_t ** buf,
+				 uint16_t * len)
+{
+	struct job_status stat;
+	uint8_t *data = (void *)response;
+
+	job_get_status(&stat);
+
+	put_le32(data + 0, stat.submitted);
+	put_le32(data + 4, stat.completed);
+	put_le32(data + 8, stat.failed);
+	put_le32(data + 12, stat.last_error);
+	put_le32(data + 16, stat.pending);
+
+	*buf = data;
+	*len = (req->wLength < 20) ? req->wLength : 20;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err get_poll_stats(struct usb_setup_data *req, uint8_t ** buf,
+				 uint16_t * len)
+{
+	struct jedec_poll_stats stats;
+	uint8_t *data = (void *)response;
+
+	if (req->wIndex >= JEDEC_NUM_OPS)
+		return QIPROG_ERR_ARG;
+
+	jedec_get_poll_stats(req->wIndex, &stats);
+	if (req->wValue)
+		jedec_reset_poll_stats();
+
+	put_le32(data + 0, stats.ops);
+	put_le32(data + 4, stats.polls);
+	put_le32(data + 8, stats.max_polls);
+	put_le32(data + 12, stats.timeouts);
+
+	*buf = data;
+	*len = (req->wLength < 16) ? req->wLength : 16;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err get_diff_stats(struct usb_setup_data *req, uint8_t ** buf,
+				 uint16_t * len)
+{
+	struct stellaris_diff_stats stats;
+	uint8_t *data = (void *)response;
+
+	stellaris_get_diff_stats(&stats, req->wValue ? true : false);
+
+	put_le32(data + 0, stats.skipped);
+	put_le32(data + 4, stats.erased);
+	put_le32(data + 8, stats.programmed);
+	put_le32(data + 12, stats.patched);
+
+	*buf = data;
+	*len = (req->wLength < 16) ? req->wLength : 16;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err submit_checksum(struct usb_setup_data *req, uint8_t ** buf,
+				  uint16_t * len)
+{
+	uint32_t start, end, unit, algo;
+
+	if (!is_out(req) || (req->wLength < 16) || (*len < 16))
+		return QIPROG_ERR_ARG;
+
+	start = get_le32(*buf + 0);
+	end = get_le32(*buf + 4);
+	unit = get_le32(*buf + 8);
+	algo = get_le32(*buf + 12);
+
+	return verify_submit(algo, start, end, unit);
+}
+
+static qiprog_err get_checksum_status(struct usb_setup_data *req,
+				      uint8_t ** buf, uint16_t * len)
+{
+	struct verify_status stat;
+	uint8_t *data = (void *)response;
+
+	verify_get_status(&stat);
+
+	put_le32(data + 0, stat.state);
+	put_le32(data + 4, stat.error);
+	put_le32(data + 8, stat.digests);
+	put_le32(data + 12, stat.total);
+
+	*buf = data;
+	*len = (req->wLength < 16) ? req->wLength : 16;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err get_checksum(struct usb_setup_data *req, uint8_t ** buf,
+			       uint16_t * len)
+{
+	const uint8_t *digest;
+	uint16_t size;
+
+	if (!(digest = verify_get_digest(req->wIndex, &size)))
+		return QIPROG_ERR_ARG;
+
+	*buf = (uint8_t *)digest;
+	*len = (req->wLength < size) ? req->wLength : size;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err submit_batch(struct usb_setup_data *req, uint8_t ** buf,
+			       uint16_t * len)
+{
+	if (!is_out(req) || (*len < req->wLength))
+		return QIPROG_ERR_ARG;
+
+	return batch_submit(*buf, req->wLength);
+}
+
+static qiprog_err get_batch_result(struct usb_setup_data *req, uint8_t ** buf,
+				   uint16_t * len)
+{
+	const uint8_t *result;
+	uint16_t size;
+
+	result = batch_get_result(&size);
+
+	*buf = (uint8_t *)result;
+	*len = (req->wLength < size) ? req->wLength : size;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err get_console_drops(struct usb_setup_data *req,
+				    uint8_t ** buf, uint16_t * len)
+{
+	uint8_t *data = (void *)response;
+
+	put_le32(data, blackbox_get_dropped());
+
+	*buf = data;
+	*len = (req->wLength < 4) ? req->wLength : 4;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err get_bench_result(struct usb_setup_data *req, uint8_t ** buf,
+				   uint16_t * len)
+{
+	struct bench_status stat;
+	uint8_t *data = (void *)response;
+	uint16_t i, size;
+
+	bench_get_status(&stat);
+
+	put_le32(data + 0, stat.state);
+	put_le32(data + 4, stat.error);
+	put_le32(data + 8, stat.core_hz);
+	put_le32(data + 12, stat.flags);
+	for (i = 0; i < BENCH_NUM_METRICS; i++) {
+		put_le32(data + 16 + 8 * i, stat.result[i].bytes);
+		put_le32(data + 20 + 8 * i, stat.result[i].cycles);
+	}
+
+	size = 16 + 8 * BENCH_NUM_METRICS;
+	*buf = data;
+	*len = (req->wLength < size) ? req->wLength : size;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err get_calibration(struct usb_setup_data *req, uint8_t ** buf,
+				  uint16_t * len)
+{
+	struct calib_status stat;
+	uint8_t *data = (void *)response;
+
+	calib_get_status(&stat);
+
+	put_le32(data + 0, stat.state);
+	put_le32(data + 4, stat.error);
+	put_le32(data + 8, stat.tried);
+	put_le32(data + 12, stat.core_hz);
+	put_le32(data + 16, stat.timing.settle);
+	put_le32(data + 20, stat.timing.stretch);
+	put_le32(data + 24, stat.timing.drive);
+
+	*buf = data;
+	*len = (req->wLength < 28) ? req->wLength : 28;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err set_bus_timing(struct usb_setup_data *req)
+{
+	struct lpc_timing timing;
+
+	timing.settle = req->wValue & 0xff;
+	timing.stretch = req->wValue >> 8;
+	timing.drive = req->wIndex;
+
+	return calib_set_timing(&timing);
+}
+
+static qiprog_err get_clock(struct usb_setup_data *req, uint8_t ** buf,
+			    uint16_t * len)
+{
+	uint8_t *data = (void *)response;
+
+	put_le32(data + 0, stellaris_get_clock());
+	put_le32(data + 4, stellaris_core_hz());
+
+	*buf = data;
+	*len = (req->wLength < 8) ? req->wLength : 8;
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err get_bus_stats(struct usb_setup_data *req, uint8_t ** buf,
+				uint16_t * len)
+{
+	struct lpc_bus_stats stats;
+	uint8_t *data = (void *)response;
+
+	lpc_get_bus_stats(&stats, req->wValue ? true : false);
+
+	put_le32(data + 0, stats.waits);
+	put_le32(data + 4, stats.retries);
+	put_le32(data + 8, stats.failures);
+
+	*buf = data;
+	*len = (req->wLength < 12) ? req->wLength : 12;
+	return QIPROG_SUCCESS;
+}
+
+#if CONFIG_PROFILE
+static qiprog_err get_profile(struct usb_setup_data *req, uint8_t ** buf,
+			      uint16_t * len)
+{
+	struct profile_stats stats;
+	uint8_t *data = (void *)response;
+	uint16_t i, size;
+
+	if (req->wIndex >= PROFILE_NUM_SITES)
+		return QIPROG_ERR_ARG;
+
+	profile_get(req->wIndex, &stats);
+
+	put_le32(data + 0, stats.calls);
+	put_le32(data + 4, stats.total);
+	put_le32(data + 8, stats.total >> 32);
+	put_le32(data + 12, stats.calls ? stats.min : 0);
+	put_le32(data + 16, stats.max);
+	for (i = 0; i < PROFILE_HIST_BINS; i++)
+		put_le32(data + 20 + 4 * i, stats.hist[i]);
+
+	size = 20 + 4 * PROFILE_HIST_BINS;
+	*buf = data;
+	*len = (req->wLength < size) ? req->wLength : size;
+	return QIPROG_SUCCESS;
+}
+#endif				/* CONFIG_PROFILE */
+
+/**
+ * @brief Handle a vultureprog-specific control request
+ */
+qiprog_err usb_vendor_request(struct usb_setup_data *req, uint8_t ** buf,
+			      uint16_t * len)
+{
+	switch (req->bRequest) {
+	case VULTUREPROG_GET_STREAM_STATS:
+		return get_stream_stats(req, buf, len);
+	case VULTUREPROG_SET_READ_PIPELINE:
+		usb_set_read_pipeline(req->wValue ? true : false);
+		print_spew("Read pipeline %s\n", req->wValue ? "on" : "off");
+		return QIPROG_SUCCESS;
+	case VULTUREPROG_RESET_STREAM_STATS:
+		usb_reset_stream_stats();
+		return QIPROG_SUCCESS;
+	case VULTUREPROG_SUBMIT_ERASE:
+		return submit_erase(req, buf, len);
+	case VULTUREPROG_GET_JOB_STATUS:
+		return get_job_status(req, buf, len);
+	case VULTUREPROG_GET_POLL_STATS:
+		return get_poll_stats(req, buf, len);
+	case VULTUREPROG_SET_POLL_METHOD:
+		if (req->wValue > JEDEC_POLL_DQ7)
+			return QIPROG_ERR_ARG;
+		jedec_set_poll_method(req->wValue);
+		return QIPROG_SUCCESS;
+	case VULTUREPROG_SET_WRITE_MODE:
+		return stellaris_set_write_mode(req->wValue);
+	case VULTUREPROG_GET_DIFF_STATS:
+		return get_diff_stats(req, buf, len);
+	case VULTUREPROG_SUBMIT_CHECKSUM:
+		return submit_checksum(req, buf, len);
+	case VULTUREPROG_GET_CHECKSUM_STATUS:
+		return get_checksum_status(req, buf, len);
+	case VULTUREPROG_GET_CHECKSUM:
+		return get_checksum(req, buf, len);
+	case VULTUREPROG_SET_GANG_MASK:
+		if (req->wValue > 0xff)
+			return QIPROG_ERR_ARG;
+		return stellaris_set_gang_mask(req->wValue);
+	case VULTUREPROG_SUBMIT_BATCH:
+		return submit_batch(req, buf, len);
+	case VULTUREPROG_GET_BATCH_RESULT:
+		return get_batch_result(req, buf, len);
+	case VULTUREPROG_GET_CONSOLE_DROPS:
+		return get_console_drops(req, buf, len);
+#if CONFIG_PROFILE
+	case VULTUREPROG_GET_PROFILE:
+		return get_profile(req, buf, len);
+	case VULTUREPROG_RESET_PROFILE:
+		profile_reset();
+		return QIPROG_SUCCESS;
+#endif
+	case VULTUREPROG_RUN_BENCH:
+		return bench_submit();
+	case VULTUREPROG_GET_BENCH_RESULT:
+		return get_bench_result(req, buf, len);
+	case VULTUREPROG_RUN_CALIBRATION:
+		if (req->wValue > 0xff)
+			return QIPROG_ERR_ARG;
+		return calib_submit(req->wValue);
+	case VULTUREPROG_GET_CALIBRATION:
+		return get_calibration(req, buf, len);
+	case VULTUREPROG_SET_BUS_TIMING:
+		return set_bus_timing(req);
+	case VULTUREPROG_SET_CLOCK:
+		return stellaris_set_clock(req->wValue);
+	case VULTUREPROG_GET_CLOCK:
+		return get_clock(req, buf, len);
+	case VULTUREPROG_GET_BUS_STATS:
+		return get_bus_stats(req, buf, len);
+	default:
+		return QIPROG_ERR_ARG;
+	}
+}
@@ -0,0 +1,165 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef USB_VENDOR_H
+#define USB_VENDOR_H
+
+#include <qiprog.h>
+#include <libopencm3/usb/usbd.h>
+
+/*
+ * Vendor requests handled by vultureprog itself, rather than by QiProg.
+ * All multi-byte fields in the data stage are little-endian.
+ */
+#define VULTUREPROG_REQ_BASE		0xc0
+
+enum vultureprog_request {
+	/*
+	 * IN, wIndex = enum usb_stream_dir
+	 * Returns bytes, elapsed_us, bytes/s and the time the bus was busy in
+	 * microseconds, as four 32-bit words.
+	 */
+	VULTUREPROG_GET_STREAM_STATS = 0xc0,
+	/* wValue = 0 to serialize reads, 1 to overlap them with USB */
+	VULTUREPROG_SET_READ_PIPELINE = 0xc1,
+	/* Clears the statistics returned by VULTUREPROG_GET_STREAM_STATS */
+	VULTUREPROG_RESET_STREAM_STATS = 0xc2,
+	/*
+	 * OUT, 8 bytes: start and end address, relative to the chip
+	 * Queues erasing of the range as a background job.
+	 */
+	VULTUREPROG_SUBMIT_ERASE = 0xc3,
+	/*
+	 * IN, returns five 32-bit words: jobs submitted, completed and failed,
+	 * the error code of the last failed job, and jobs still pending.
+	 */
+	VULTUREPROG_GET_JOB_STATUS = 0xc4,
+	/*
+	 * IN, wIndex = enum jedec_op
+	 * Returns operations, polls, most polls for one operation and
+	 * timeouts, as four 32-bit words. wValue = 1 clears all counters once
+	 * they are read.
+	 */
+	VULTUREPROG_GET_POLL_STATS = 0xc5,
+	/* wValue = enum jedec_poll_method */
+	VULTUREPROG_SET_POLL_METHOD = 0xc6,
+	/* wValue = enum stellaris_write_mode */
+	VULTUREPROG_SET_WRITE_MODE = 0xc7,
+	/*
+	 * IN, returns the number of sectors skipped, erased, programmed, and
+	 * programmed without an erase by differential writes, as four 32-bit
+	 * words. wValue = 1 clears the counters once they are read.
+	 */
+	VULTUREPROG_GET_DIFF_STATS = 0xc8,
+	/*
+	 * OUT, 16 bytes: start and end address relative to the chip, unit size
+	 * and enum verify_algo
+	 * Queues computing one digest for every unit in the range, or a single
+	 * one if the unit size is zero.
+	 */
+	VULTUREPROG_SUBMIT_CHECKSUM = 0xc9,
+	/*
+	 * IN, returns enum verify_state, the error code, and the number of
+	 * digests computed and expected, as four 32-bit words.
+	 */
+	VULTUREPROG_GET_CHECKSUM_STATUS = 0xca,
+	/*
+	 * IN, wIndex = digest number
+	 * Returns a CRC32 as a 32-bit word, or a SHA-256 digest as 32 bytes.
+	 */
+	VULTUREPROG_GET_CHECKSUM = 0xcb,
+	/*
+	 * wValue = bitmask of the chips written to. Reads come from the lowest
+	 * chip in the mask. Takes effect once the bulk write in progress has
+	 * returned. Probing the chips selects all chips found.
+	 */
+	VULTUREPROG_SET_GANG_MASK = 0xcc,
+	/*
+	 * OUT, up to 256 bytes: a list of reads and writes, see batch.c
+	 * Queues the list, to be done back to back.
+	 */
+	VULTUREPROG_SUBMIT_BATCH = 0xcd,
+	/*
+	 * IN, returns enum batch_state, the error code and the number of ops
+	 * done, as three 32-bit words, then the values read, once the list is
+	 * done.
+	 */
+	VULTUREPROG_GET_BATCH_RESULT = 0xce,
+	/*
+	 * IN, returns the number of console messages dropped because the
+	 * console could not keep up, as a 32-bit word.
+	 */
+	VULTUREPROG_GET_CONSOLE_DROPS = 0xcf,
+	/*
+	 * IN, wIndex = enum profile_site
+	 * Returns calls, the total cycles as a 64-bit word, the fewest and
+	 * most cycles of one call, then PROFILE_HIST_BINS histogram bins, as
+	 * 32-bit words. Only with CONFIG_PROFILE.
+	 */
+	VULTUREPROG_GET_PROFILE = 0xd0,
+	/* Clears the statistics of all profiling sites */
+	VULTUREPROG_RESET_PROFILE = 0xd1,
+	/* Queues timing the LPC bus primitives, see bench.c. LPC bus only. */
+	VULTUREPROG_RUN_BENCH = 0xd2,
+	/*
+	 * IN, returns enum bench_state, the error code, the core clock in Hz
+	 * and the build flags, then bytes and cycles for each enum
+	 * bench_metric, as 32-bit words.
+	 */
+	VULTUREPROG_GET_BENCH_RESULT = 0xd3,
+	/*
+	 * wValue = passes every setting must read back correctly, or 0 for
+	 * the default. Queues finding the fastest bus timing which works, see
+	 * lpc_calib.c. A chip must have been probed. LPC bus only.
+	 */
+	VULTUREPROG_RUN_CALIBRATION = 0xd4,
+	/*
+	 * IN, returns enum calib_state, the error code, settings tried and
+	 * the core clock in Hz of the last calibration, then the settle delay,
+	 * clock stretch and enum lpc_drive in effect, as 32-bit words.
+	 */
+	VULTUREPROG_GET_CALIBRATION = 0xd5,
+	/*
+	 * wValue = settle delay | clock stretch << 8, wIndex = enum lpc_drive
+	 * Sets the bus timing by hand, in place of calibration. LPC bus only.
+	 */
+	VULTUREPROG_SET_BUS_TIMING = 0xd6,
+	/*
+	 * wValue = enum stellaris_clock
+	 * Queues a change of the core clock. The bus timing is scaled to take
+	 * as long at the new clock. The change waits until nothing uses the bus.
+	 */
+	VULTUREPROG_SET_CLOCK = 0xd7,
+	/*
+	 * IN, returns the enum stellaris_clock in effect, and the core clock
+	 * in Hz, as two 32-bit words.
+	 */
+	VULTUREPROG_GET_CLOCK = 0xd8,
+	/*
+	 * IN, returns SYNC wait clocks, frames tried again and frames which
+	 * failed on every try, as three 32-bit words. wValue = 1 clears the
+	 * counters once they are read.
+	 */
+	VULTUREPROG_GET_BUS_STATS = 0xd9,
+};
+
+qiprog_err usb_vendor_request(struct usb_setup_data *req, uint8_t ** buf,
+			      uint16_t * len);
+
+#endif				/* USB_VENDOR_H */
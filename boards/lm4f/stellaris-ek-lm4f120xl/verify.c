@@ -0,0 +1,203 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file verify.c Checksums of the chip contents, computed on the device
+ *
+ * Rather than reading the whole chip back over USB, the host asks for the
+ * checksum of a range, and only reads back the digest. The range can be split
+ * in equal units, with one digest per unit, so the host can find out which
+ * sectors differ.
+ *
+ * Requests come in from the USB interrupt, and are worked on from the main
+ * loop, one chunk at a time, after any pending jobs have finished.
+ */
+
+#include "stellaris.h"
+
+#include <blackbox.h>
+#include <byteorder.h>
+#include <crc32.h>
+#include <sha256.h>
+
+/* How much we read from the chip in one step */
+#define VERIFY_CHUNK		256
+/* Room for 256 CRC32 digests or 32 SHA-256 digests */
+#define VERIFY_DIGEST_BUF	1024
+
+static struct {
+	volatile enum verify_state state;
+	qiprog_err error;
+	enum verify_algo algo;
+	uint32_t start;
+	uint32_t end;
+	uint32_t unit;
+	uint32_t pos;
+	uint32_t digests;
+	uint32_t total;
+	union {
+		uint32_t crc;
+		struct sha256_ctx sha;
+	} ctx;
+} verify;
+
+static uint8_t digest_buf[VERIFY_DIGEST_BUF];
+static uint8_t chunk[VERIFY_CHUNK];
+static bool tables_ready = false;
+
+static uint16_t digest_size(enum verify_algo algo)
+{
+	return (algo == VERIFY_SHA256) ? SHA256_DIGEST_SIZE : sizeof(uint32_t);
+}
+
+/**
+ * @brief Queue a checksum of the range [start, end)
+ *
+ * One digest is computed for every 'unit' bytes, or a single one for the whole
+ * range if 'unit' is zero or larger than the range. The range must lie within
+ * the first chip in the gang. This may be called from an interrupt.
+ */
+qiprog_err verify_submit(enum verify_algo algo, uint32_t start, uint32_t end,
+			 uint32_t unit)
+{
+	uint32_t total;
+
+	if (verify.state == VERIFY_BUSY)
+		return QIPROG_ERR;
+
+	if ((algo != VERIFY_CRC32) && (algo != VERIFY_SHA256))
+		return QIPROG_ERR_ARG;
+	if ((start >= end) || (end > stellaris_chip_size()))
+		return QIPROG_ERR_ARG;
+
+	if (!unit || (unit > end - start))
+		unit = end - start;
+	/* Rounding up, without overflowing when end - start is near 4 GiB */
+	total = (end - start) / unit + (((end - start) % unit) ? 1 : 0);
+	if (total > VERIFY_DIGEST_BUF / digest_size(algo))
+		return QIPROG_ERR_ARG;
+
+	verify.algo = algo;
+	verify.start = start;
+	verify.end = end;
+	verify.unit = unit;
+	verify.pos = start;
+	verify.digests = 0;
+	verify.total = total;
+	verify.error = QIPROG_SUCCESS;
+	verify.state = VERIFY_BUSY;
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Is a checksum being computed?
+ */
+bool verify_busy(void)
+{
+	return verify.state == VERIFY_BUSY;
+}
+
+/**
+ * @brief Checksum the next chunk of the range
+ *
+ * Call this from the main loop.
+ */
+void verify_step(void)
+{
+	uint32_t unit_start, unit_end, len;
+	uint8_t *digest;
+	qiprog_err ret;
+
+	if (verify.state != VERIFY_BUSY)
+		return;
+
+	if (!tables_ready) {
+		crc32_init();
+		tables_ready = true;
+	}
+
+	unit_start = verify.start + verify.digests * verify.unit;
+	unit_end = unit_start + verify.unit;
+	unit_end = (unit_end > verify.end) ? verify.end : unit_end;
+
+	if (verify.pos == unit_start) {
+		if (verify.algo == VERIFY_SHA256)
+			sha256_init(&verify.ctx.sha);
+		else
+			verify.ctx.crc = 0;
+	}
+
+	len = unit_end - verify.pos;
+	len = (len > VERIFY_CHUNK) ? VERIFY_CHUNK : len;
+
+	ret = stellaris_read(verify.pos, chunk, len);
+	if (ret != QIPROG_SUCCESS) {
+		print_err("Checksum: read failed at 0x%lx\n", verify.pos);
+		verify.error = ret;
+		verify.state = VERIFY_FAILED;
+		return;
+	}
+
+	if (verify.algo == VERIFY_SHA256)
+		sha256_update(&verify.ctx.sha, chunk, len);
+	else
+		verify.ctx.crc = crc32_update(verify.ctx.crc, chunk, len);
+	verify.pos += len;
+
+	if (verify.pos < unit_end)
+		return;
+
+	digest = digest_buf + verify.digests * digest_size(verify.algo);
+	if (verify.algo == VERIFY_SHA256) {
+		sha256_final(&verify.ctx.sha, digest);
+	} else {
+		/* Little-endian, like everything else we send */
+		put_le32(digest, verify.ctx.crc);
+	}
+	verify.digests++;
+
+	if (verify.pos >= verify.end)
+		verify.state = VERIFY_DONE;
+}
+
+/**
+ * @brief Get the progress of the current checksum
+ */
+void verify_get_status(struct verify_status *stat)
+{
+	stat->state = verify.state;
+	stat->error = verify.error;
+	stat->digests = verify.digests;
+	stat->total = verify.total;
+}
+
+/**
+ * @brief Get a digest which has already been computed
+ *
+ * @return pointer to the digest, or NULL if it is not available yet
+ */
+const uint8_t *verify_get_digest(uint32_t idx, uint16_t *len)
+{
+	if (idx >= verify.digests)
+		return NULL;
+
+	*len = digest_size(verify.algo);
+	return digest_buf + idx * (*len);
+}
@@ -0,0 +1,144 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file chip_db.c Built-in table of supported parts
+ *
+ * Sizes, erase layouts and timings are from the datasheets. Typical times are
+ * when we first poll the chip, and maximum times when we give up on it. Chip
+ * erase, where the part has it at all, is only available in A/A-Mux mode.
+ */
+
+#include <chip_db.h>
+
+#include <stdlib.h>
+
+#define KiB(x)		((x) * 1024UL)
+#define MiB(x)		((x) * 1024UL * 1024UL)
+
+#define LPC		QIPROG_BUS_LPC
+#define FWH		QIPROG_BUS_FWH
+#define AAMUX		QIPROG_BUS_ISA
+
+/* SST49LF0xx and SST49LF0xxA */
+#define SST_TIMING {							\
+	[JEDEC_OP_PROGRAM] = {.typ_us = 14, .max_us = 20},		\
+	[JEDEC_OP_SECTOR_ERASE] = {.typ_us = 18000, .max_us = 25000},	\
+	[JEDEC_OP_BLOCK_ERASE] = {.typ_us = 18000, .max_us = 25000},	\
+	[JEDEC_OP_CHIP_ERASE] = {.typ_us = 70000, .max_us = 100000},	\
+}
+
+/* SST49LF016C and SST49LF160C */
+#define SST_C_TIMING {							\
+	[JEDEC_OP_PROGRAM] = {.typ_us = 14, .max_us = 20},		\
+	[JEDEC_OP_SECTOR_ERASE] = {.typ_us = 18000, .max_us = 25000},	\
+	[JEDEC_OP_BLOCK_ERASE] = {.typ_us = 18000, .max_us = 25000},	\
+	[JEDEC_OP_CHIP_ERASE] = {.typ_us = 40000, .max_us = 50000},	\
+}
+
+#define PMC_TIMING {							\
+	[JEDEC_OP_PROGRAM] = {.typ_us = 9, .max_us = 50},		\
+	[JEDEC_OP_SECTOR_ERASE] = {.typ_us = 55000, .max_us = 100000},	\
+	[JEDEC_OP_BLOCK_ERASE] = {.typ_us = 55000, .max_us = 100000},	\
+	[JEDEC_OP_CHIP_ERASE] = {.typ_us = 55000, .max_us = 100000},	\
+}
+
+#define WINBOND_TIMING {						\
+	[JEDEC_OP_PROGRAM] = {.typ_us = 35, .max_us = 50},		\
+	[JEDEC_OP_SECTOR_ERASE] = {.typ_us = 25000, .max_us = 200000},	\
+	[JEDEC_OP_BLOCK_ERASE] = {.typ_us = 25000, .max_us = 200000},	\
+	[JEDEC_OP_CHIP_ERASE] = {.typ_us = 50000, .max_us = 200000},	\
+}
+
+/*
+ * Sorted by vendor ID, then device ID, so chip_db_find() can do a binary
+ * search. Keep it that way when adding parts.
+ */
+static const struct chip_profile chip_db[] = {
+	{0x9d, 0x6d, "Pm49FL002", KiB(256), KiB(4), KiB(16),
+	 LPC | FWH | AAMUX, AAMUX, 0, CHIP_LOCK_FWH, KiB(16),
+	 JEDEC_POLL_DQ7, PMC_TIMING},
+	{0x9d, 0x6e, "Pm49FL004", KiB(512), KiB(4), KiB(64),
+	 LPC | FWH | AAMUX, AAMUX, 0, CHIP_LOCK_FWH, KiB(64),
+	 JEDEC_POLL_DQ7, PMC_TIMING},
+	{0xbf, 0x1b, "SST49LF003A/B", KiB(384), KiB(4), KiB(64),
+	 FWH | AAMUX, AAMUX, 0, CHIP_LOCK_FWH, KiB(64),
+	 JEDEC_POLL_DQ7, SST_TIMING},
+	{0xbf, 0x4c, "SST49LF160C", MiB(2), KiB(4), KiB(64),
+	 LPC, 0, 0, CHIP_LOCK_FWH, KiB(64),
+	 JEDEC_POLL_DQ7, SST_C_TIMING},
+	{0xbf, 0x50, "SST49LF040B", KiB(512), KiB(4), KiB(64),
+	 LPC | AAMUX, AAMUX, 0, CHIP_LOCK_NONE, 0,
+	 JEDEC_POLL_DQ7, SST_TIMING},
+	{0xbf, 0x51, "SST49LF040", KiB(512), KiB(4), KiB(64),
+	 LPC | AAMUX, AAMUX, 0, CHIP_LOCK_NONE, 0,
+	 JEDEC_POLL_DQ7, SST_TIMING},
+	{0xbf, 0x52, "SST49LF020A", KiB(256), KiB(4), KiB(16),
+	 LPC | AAMUX, AAMUX, 0, CHIP_LOCK_NONE, 0,
+	 JEDEC_POLL_DQ7, SST_TIMING},
+	{0xbf, 0x5a, "SST49LF008A", MiB(1), KiB(4), KiB(64),
+	 FWH | AAMUX, AAMUX, 0, CHIP_LOCK_FWH, KiB(64),
+	 JEDEC_POLL_DQ7, SST_TIMING},
+	{0xbf, 0x5b, "SST49LF080A", MiB(1), KiB(4), KiB(64),
+	 LPC | AAMUX, AAMUX, 0, CHIP_LOCK_NONE, 0,
+	 JEDEC_POLL_DQ7, SST_TIMING},
+	{0xbf, 0x5c, "SST49LF016C", MiB(2), KiB(4), KiB(64),
+	 LPC, 0, 0, CHIP_LOCK_FWH, KiB(64),
+	 JEDEC_POLL_DQ7, SST_C_TIMING},
+	{0xbf, 0x60, "SST49LF004A/B", KiB(512), KiB(4), KiB(64),
+	 FWH | AAMUX, AAMUX, 0, CHIP_LOCK_FWH, KiB(64),
+	 JEDEC_POLL_DQ7, SST_TIMING},
+	{0xbf, 0x61, "SST49LF020", KiB(256), KiB(4), KiB(16),
+	 LPC | AAMUX, AAMUX, 0, CHIP_LOCK_NONE, 0,
+	 JEDEC_POLL_DQ7, SST_TIMING},
+	{0xda, 0x34, "W39V040FA", KiB(512), KiB(4), KiB(64),
+	 FWH | AAMUX, AAMUX, 0, CHIP_LOCK_FWH, KiB(64),
+	 JEDEC_POLL_DQ7, WINBOND_TIMING},
+	{0xda, 0xd3, "W39V080FA", MiB(1), KiB(4), KiB(64),
+	 FWH | AAMUX, AAMUX, 0, CHIP_LOCK_FWH, KiB(64),
+	 JEDEC_POLL_DQ7, WINBOND_TIMING},
+};
+
+/** @private */
+static int chip_db_cmp(const void *key, const void *elem)
+{
+	const struct chip_profile *a = key, *b = elem;
+
+	if (a->vendor_id != b->vendor_id)
+		return (a->vendor_id < b->vendor_id) ? -1 : 1;
+	if (a->device_id != b->device_id)
+		return (a->device_id < b->device_id) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * \brief Find the profile of a part from its JEDEC ID
+ *
+ * @return the profile, or NULL if we don't know the part
+ */
+const struct chip_profile *chip_db_find(uint16_t vendor_id, uint16_t device_id)
+{
+	struct chip_profile key;
+
+	key.vendor_id = vendor_id;
+	key.device_id = device_id;
+
+	return bsearch(&key, chip_db, sizeof(chip_db) / sizeof(chip_db[0]),
+		       sizeof(chip_db[0]), chip_db_cmp);
+}
@@ -0,0 +1,245 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file cmd_script.c Interpreter for custom command scripts
+ */
+
+#include <cmd_script.h>
+#include <timebase.h>
+
+/* Chips decode at most 4 MiB, so that's as far as WRITE and READ can go */
+#define CMD_MAX_OFFSET		(1UL << 22)
+/* Polls give up after 2^16 ms, a bit over a minute */
+#define CMD_MAX_POLL_LOG2	16
+#define CMD_MAX_DELAY_US	1000000
+
+/**
+ * \brief Check a script from the host, and keep it
+ *
+ * Erase scripts erase one unit at the target, and program scripts program one
+ * byte. Only program scripts may use WRITE_VALUE, and they must use it. If the
+ * script is not valid, 'script' is left empty.
+ *
+ * @return QIPROG_SUCCESS, or QIPROG_ERR_ARG if the script is not valid
+ */
+qiprog_err cmd_script_load(struct cmd_script *script,
+			   enum cmd_script_type type, const uint32_t *addr,
+			   const uint8_t *data, size_t num_ops)
+{
+	size_t i;
+	uint8_t opcode;
+	uint32_t operand;
+	bool in_loop = false, has_value = false;
+
+	script->num_ops = 0;
+
+	if (!num_ops || (num_ops > CMD_SCRIPT_MAX_OPS))
+		return QIPROG_ERR_ARG;
+
+	for (i = 0; i < num_ops; i++) {
+		opcode = addr[i] >> 24;
+		operand = addr[i] & 0xffffff;
+
+		switch (opcode) {
+		case CMD_OP_WRITE:
+		case CMD_OP_READ:
+			if (operand >= CMD_MAX_OFFSET)
+				return QIPROG_ERR_ARG;
+			break;
+		case CMD_OP_WRITE_TARGET:
+			break;
+		case CMD_OP_WRITE_VALUE:
+			if (type != CMD_SCRIPT_PROGRAM)
+				return QIPROG_ERR_ARG;
+			has_value = true;
+			break;
+		case CMD_OP_POLL_TOGGLE:
+		case CMD_OP_POLL_DQ7:
+			if (data[i] > CMD_MAX_POLL_LOG2)
+				return QIPROG_ERR_ARG;
+			break;
+		case CMD_OP_DELAY:
+			if (operand > CMD_MAX_DELAY_US)
+				return QIPROG_ERR_ARG;
+			break;
+		case CMD_OP_LOOP:
+			/* Loops don't nest */
+			if (in_loop || !data[i])
+				return QIPROG_ERR_ARG;
+			in_loop = true;
+			break;
+		case CMD_OP_END_LOOP:
+			if (!in_loop)
+				return QIPROG_ERR_ARG;
+			in_loop = false;
+			break;
+		default:
+			return QIPROG_ERR_ARG;
+		}
+
+		script->ops[i].opcode = opcode;
+		script->ops[i].operand = operand;
+		script->ops[i].data = data[i];
+	}
+
+	if (in_loop || ((type == CMD_SCRIPT_PROGRAM) && !has_value))
+		return QIPROG_ERR_ARG;
+
+	script->num_ops = num_ops;
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * \brief Get ready to run a script
+ *
+ * @param[in] target Chip-relative address of the erase unit or byte
+ * @param[in] value Byte to program. Use 0xff for erase scripts, which is what
+ *		    DQ7 reads as once the erase is done.
+ */
+void cmd_script_start(struct cmd_script_run *run,
+		      const struct cmd_script *script, uint32_t target,
+		      uint8_t value)
+{
+	run->script = script;
+	run->target = target;
+	run->value = value;
+	run->pc = 0;
+	run->loop_pc = 0;
+	run->loops_left = 0;
+	run->loop_offset = 0;
+	run->waiting = false;
+	run->error = QIPROG_SUCCESS;
+}
+
+/** @private */
+static enum cmd_script_state cmd_script_poll(const struct jedec_chip *chip,
+					     struct cmd_script_run *run,
+					     const struct cmd_script_op *op,
+					     uint32_t addr)
+{
+	uint8_t val;
+	bool busy;
+
+	if (!run->waiting) {
+		run->waiting = true;
+		run->t_start = timebase_us();
+		chip->read8(chip->window + addr, &run->last);
+	}
+
+	chip->read8(chip->window + addr, &val);
+	if (op->opcode == CMD_OP_POLL_TOGGLE) {
+		busy = ((val ^ run->last) & 0x40) ? true : false;
+		run->last = val;
+	} else {
+		busy = ((val ^ run->value) & 0x80) ? true : false;
+	}
+
+	if (!busy) {
+		run->waiting = false;
+		return CMD_SCRIPT_DONE;
+	}
+
+	if ((timebase_us() - run->t_start) > (1000UL << op->data)) {
+		run->error = QIPROG_ERR_TIMEOUT;
+		return CMD_SCRIPT_FAILED;
+	}
+
+	return CMD_SCRIPT_BUSY;
+}
+
+/**
+ * \brief Run a script until it has to wait for the chip
+ *
+ * Bus accesses are done back to back. When a poll finds the chip busy, or a
+ * delay has not run out, this returns, and the next call picks up from there.
+ *
+ * @return CMD_SCRIPT_BUSY until the script is done, then CMD_SCRIPT_DONE or
+ *	   CMD_SCRIPT_FAILED
+ */
+enum cmd_script_state cmd_script_step(const struct jedec_chip *chip,
+				      struct cmd_script_run *run)
+{
+	const struct cmd_script_op *op;
+	enum cmd_script_state state;
+	uint32_t target;
+	qiprog_err ret;
+	uint8_t val;
+
+	while (run->pc < run->script->num_ops) {
+		op = &run->script->ops[run->pc];
+		target = run->target + run->loop_offset + op->operand;
+		ret = QIPROG_SUCCESS;
+
+		switch (op->opcode) {
+		case CMD_OP_WRITE:
+			ret = chip->write8(chip->window + op->operand, op->data);
+			break;
+		case CMD_OP_WRITE_TARGET:
+			ret = chip->write8(chip->window + target, op->data);
+			break;
+		case CMD_OP_WRITE_VALUE:
+			ret = chip->write8(chip->window + target, run->value);
+			break;
+		case CMD_OP_READ:
+			ret = chip->read8(chip->window + op->operand, &val);
+			break;
+		case CMD_OP_POLL_TOGGLE:
+		case CMD_OP_POLL_DQ7:
+			state = cmd_script_poll(chip, run, op, target);
+			if (state != CMD_SCRIPT_DONE)
+				return state;
+			break;
+		case CMD_OP_DELAY:
+			if (!run->waiting) {
+				run->waiting = true;
+				run->t_start = timebase_us();
+			}
+			if ((timebase_us() - run->t_start) < op->operand)
+				return CMD_SCRIPT_BUSY;
+			run->waiting = false;
+			break;
+		case CMD_OP_LOOP:
+			run->loop_pc = run->pc;
+			run->loops_left = op->data;
+			run->loop_offset = 0;
+			break;
+		case CMD_OP_END_LOOP:
+			if (--run->loops_left) {
+				op = &run->script->ops[run->loop_pc];
+				run->loop_offset += op->operand;
+				run->pc = run->loop_pc + 1;
+				continue;
+			}
+			run->loop_offset = 0;
+			break;
+		default:
+			ret = QIPROG_ERR_ARG;
+			break;
+		}
+
+		if (ret != QIPROG_SUCCESS) {
+			run->error = ret;
+			return CMD_SCRIPT_FAILED;
+		}
+		run->pc++;
+	}
+
+	return CMD_SCRIPT_DONE;
+}
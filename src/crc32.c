@@ -0,0 +1,87 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file crc32.c Table-driven CRC32
+ */
+
+#include <crc32.h>
+
+#define CRC32_POLY		0xedb88320
+
+static uint32_t crc_table[4][256];
+
+/**
+ * \brief Build the lookup tables
+ */
+void crc32_init(void)
+{
+	uint32_t i, j, crc;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLY : 0);
+		crc_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++) {
+		crc = crc_table[0][i];
+		for (j = 1; j < 4; j++) {
+			crc = (crc >> 8) ^ crc_table[0][crc & 0xff];
+			crc_table[j][i] = crc;
+		}
+	}
+}
+
+/**
+ * \brief Add data to a CRC
+ *
+ * Start with a crc of 0. The result can be fed back in to continue the CRC
+ * with more data. Results are identical to zlib's crc32().
+ */
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t word;
+
+	crc = ~crc;
+
+	/* Get to a word boundary */
+	while (len && ((uintptr_t)p & 3)) {
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xff];
+		len--;
+	}
+
+	/* This is little-endian only, which the Cortex-M is */
+	while (len >= 4) {
+		word = crc ^ *(const uint32_t *)p;
+		crc = crc_table[3][word & 0xff] ^
+		      crc_table[2][(word >> 8) & 0xff] ^
+		      crc_table[1][(word >> 16) & 0xff] ^
+		      crc_table[0][word >> 24];
+		p += 4;
+		len -= 4;
+	}
+
+	while (len--)
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xff];
+
+	return ~crc;
+}
@@ -43,9 +43,27 @@
 
 /** @{ */
 #include <stdio.h>
+#include <stdint.h>
 #include <config.h>
 
-#if CONFIG_ENABLE_CONSOLE
+#if CONFIG_ENABLE_CONSOLE && CONFIG_BINARY_LOG
+/*
+ * Only send the address of the format string, a timestamp and the arguments.
+ * The format strings stay in flash, in their own section, and the host reads
+ * them from the ELF file. Arguments must be 32 bits wide, and %s only works
+ * for strings in flash.
+ */
+#define printk(LEVEL, fmt, ...)					\
+	do {							\
+		if (CONFIG_LOGLEVEL >= LEVEL) {			\
+			static const char blackbox_fmt[]	\
+			__attribute__((section(".rodata.logstr"))) = fmt; \
+			print_binary(blackbox_fmt,		\
+				     BLACKBOX_NARGS(__VA_ARGS__),	\
+				     ##__VA_ARGS__);		\
+		}						\
+	} while(0)
+#elif CONFIG_ENABLE_CONSOLE
 #define printk(LEVEL, fmt, ...)					\
 	do {							\
 		if (CONFIG_LOGLEVEL >= LEVEL)			\
@@ -57,6 +75,13 @@
 	do { } while(0)
 #endif				/* CONFIG_ENABLE_CONSOLE */
 
+/* Most arguments a binary log message can carry */
+#define BLACKBOX_MAX_ARGS	8
+/* Count the arguments of printk(), up to BLACKBOX_MAX_ARGS */
+#define BLACKBOX_NARGS(...)						\
+	BLACKBOX_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define BLACKBOX_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...)	N
+
 #define print_emerg(x, ...)		printk(LOG_EMERG,  x,	##__VA_ARGS__)
 #define print_alert(x, ...)		printk(LOG_ALERT,  x,	##__VA_ARGS__)
 #define print_crit(x, ...)		printk(LOG_CRIT,   x,	##__VA_ARGS__)
@@ -82,6 +107,8 @@ enum log_level {
 /* Initialize the debugging subsystem */
 void blackbox_init(void);
 void print_blackbox(const char *format, ...);
+void print_binary(const char *format, unsigned int nargs, ...);
+uint32_t blackbox_get_dropped(void);
 /** @} */
 
 #endif				/* BLACKBOX_H */
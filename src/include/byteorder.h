@@ -0,0 +1,47 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @defgroup byteorder Byte order
+ *
+ * \brief Packing of the little-endian words we exchange with the host
+ */
+
+#ifndef BYTEORDER_H
+#define BYTEORDER_H
+
+/** @{ */
+#include <stdint.h>
+
+static inline void put_le32(uint8_t *dest, uint32_t val)
+{
+	dest[0] = val >> 0;
+	dest[1] = val >> 8;
+	dest[2] = val >> 16;
+	dest[3] = val >> 24;
+}
+
+static inline uint32_t get_le32(const uint8_t *src)
+{
+	return (uint32_t)src[0] | ((uint32_t)src[1] << 8) |
+	       ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+/** @} */
+
+#endif				/* BYTEORDER_H */
@@ -0,0 +1,67 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @defgroup chip_db Chip database
+ *
+ * \brief What we know about the parts we support, keyed by their JEDEC ID
+ *
+ * Everything here comes from datasheets, so a part found in the table needs no
+ * geometry from the host, and no CFI query. The table lives in flash.
+ */
+
+#ifndef CHIP_DB_H
+#define CHIP_DB_H
+
+/** @{ */
+#include <jedec_flash.h>
+#include <stdint.h>
+
+/* How the blocks of a part are write-protected */
+enum chip_lock_type {
+	CHIP_LOCK_NONE = 0,	/**< No lock registers. #WP/#TBL pins only. */
+	/**
+	 * FWH-style block locking registers. There is one register per
+	 * 'lock_size' bytes, at offset 2 into the register space of that
+	 * block. The register space sits 4 MiB below the memory window.
+	 */
+	CHIP_LOCK_FWH,
+};
+
+struct chip_profile {
+	uint16_t vendor_id;
+	uint16_t device_id;
+	const char *name;
+	uint32_t size;
+	uint32_t sector_size;	/**< Zero if there is no sector eraser */
+	uint32_t block_size;	/**< Zero if there is no block eraser */
+	uint8_t buses;		/**< enum qiprog_bus flags the part supports */
+	uint8_t chip_erase_buses;	/**< Buses on which chip erase works */
+	uint8_t fwh_burst;	/**< Largest FWH read burst, or zero */
+	uint8_t lock_type;	/**< enum chip_lock_type */
+	uint32_t lock_size;	/**< Bytes covered by one lock register */
+	uint8_t poll_method;	/**< enum jedec_poll_method to use */
+	struct jedec_op_timing timing[JEDEC_NUM_OPS];
+};
+
+const struct chip_profile *chip_db_find(uint16_t vendor_id,
+					uint16_t device_id);
+/** @} */
+
+#endif				/* CHIP_DB_H */
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @defgroup cmd_script Custom command scripts
+ *
+ * \brief Erase and program sequences for parts which are not JEDEC-compliant
+ *
+ * The host describes the sequence as the (addr, data) pairs of the QiProg
+ * set_custom_erase_command() and set_custom_write_command() requests. The top
+ * byte of each address is the opcode, and the lower 24 bits its operand:
+ *
+ * - WRITE: write 'data' to chip offset 'operand'
+ * - WRITE_TARGET: write 'data' to the target, plus 'operand'
+ * - WRITE_VALUE: write the byte being programmed to the target, plus 'operand'
+ * - READ: read chip offset 'operand', and throw the result away
+ * - POLL_TOGGLE: wait until DQ6 at the target, plus 'operand', stops toggling
+ * - POLL_DQ7: wait until DQ7 at the target, plus 'operand', reads as expected
+ * - DELAY: wait 'operand' microseconds
+ * - LOOP: run the ops up to the matching END_LOOP 'data' times, moving the
+ *   target by 'operand' bytes each time
+ *
+ * The target is the erase unit, or the byte being programmed. Polls give up
+ * after 2^'data' milliseconds. Scripts are checked once, when they are loaded,
+ * and then run by the job engine, one poll at a time.
+ */
+
+#ifndef CMD_SCRIPT_H
+#define CMD_SCRIPT_H
+
+/** @{ */
+#include <jedec_flash.h>
+#include <qiprog.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CMD_SCRIPT_MAX_OPS	16
+
+enum cmd_script_opcode {
+	CMD_OP_WRITE = 0,
+	CMD_OP_WRITE_TARGET,
+	CMD_OP_WRITE_VALUE,
+	CMD_OP_READ,
+	CMD_OP_POLL_TOGGLE,
+	CMD_OP_POLL_DQ7,
+	CMD_OP_DELAY,
+	CMD_OP_LOOP,
+	CMD_OP_END_LOOP,
+	CMD_NUM_OPCODES,
+};
+
+enum cmd_script_type {
+	CMD_SCRIPT_ERASE = 0,
+	CMD_SCRIPT_PROGRAM,
+};
+
+struct cmd_script_op {
+	uint32_t operand;
+	uint8_t opcode;
+	uint8_t data;
+};
+
+struct cmd_script {
+	uint8_t num_ops;
+	struct cmd_script_op ops[CMD_SCRIPT_MAX_OPS];
+};
+
+/* Where a script is in its run. Filled by cmd_script_start(). */
+struct cmd_script_run {
+	const struct cmd_script *script;
+	uint32_t target;
+	uint8_t value;
+	uint8_t pc;
+	uint8_t loop_pc;	/**< The LOOP op of the loop we are in */
+	uint8_t loops_left;
+	uint32_t loop_offset;
+	bool waiting;
+	uint32_t t_start;
+	uint8_t last;
+	qiprog_err error;
+};
+
+enum cmd_script_state {
+	CMD_SCRIPT_BUSY = 0,
+	CMD_SCRIPT_DONE,
+	CMD_SCRIPT_FAILED,	/**< The reason is in cmd_script_run.error */
+};
+
+qiprog_err cmd_script_load(struct cmd_script *script,
+			   enum cmd_script_type type, const uint32_t *addr,
+			   const uint8_t *data, size_t num_ops);
+void cmd_script_start(struct cmd_script_run *run,
+		      const struct cmd_script *script, uint32_t target,
+		      uint8_t value);
+enum cmd_script_state cmd_script_step(const struct jedec_chip *chip,
+				      struct cmd_script_run *run);
+/** @} */
+
+#endif				/* CMD_SCRIPT_H */
@@ -30,8 +30,16 @@
 
 /* Enable console logging - Where the console logs is hardware-specific */
 #define CONFIG_ENABLE_CONSOLE 1
+/* Send log messages as format string IDs, decoded by tools/decode_log.py */
+#define CONFIG_BINARY_LOG 0
 /* Debug level */
 #define CONFIG_LOGLEVEL LOG_SPEW
+/* Clock single LPC cycles from precompiled waveform tables (lpc_wave.c) */
+#define CONFIG_LPC_WAVE_PLAYBACK 0
+/* Count cycles spent in hot paths with the DWT, readable over USB */
+#define CONFIG_PROFILE 0
+/* Number of chips which may share the LPC bus, with ID straps 0 to N-1 */
+#define CONFIG_MAX_CHIPS 4
 
 /** @} */
 #endif				/* CONFIG_H */
@@ -0,0 +1,41 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @defgroup crc32 CRC32
+ *
+ * \brief The CRC32 used by zlib and Ethernet
+ *
+ * Slicing-by-4: four bytes are folded in with four table lookups, instead of
+ * one lookup per byte. The tables are built by crc32_init(), which must be
+ * called before the first crc32_update().
+ */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+/** @{ */
+#include <stddef.h>
+#include <stdint.h>
+
+void crc32_init(void);
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len);
+/** @} */
+
+#endif				/* CRC32_H */
@@ -17,13 +17,121 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifndef JEDEC_FLASH_H
+#define JEDEC_FLASH_H
+
+#include <qiprog.h>
+#include <stdbool.h>
+
+/* Operations which have to wait for the chip, each with its own timing */
+enum jedec_op {
+	JEDEC_OP_PROGRAM = 0,	/**< tBP */
+	JEDEC_OP_SECTOR_ERASE,	/**< tSE */
+	JEDEC_OP_BLOCK_ERASE,	/**< tBE */
+	JEDEC_OP_CHIP_ERASE,	/**< tSCE */
+	JEDEC_NUM_OPS,
+};
+
+/* How to find out the chip finished an operation */
+enum jedec_poll_method {
+	JEDEC_POLL_TOGGLE = 0,	/**< DQ6 toggle bit, two reads per poll */
+	JEDEC_POLL_DQ7,		/**< DQ7 data polling, one read per poll */
+};
+
+struct jedec_op_timing {
+	uint32_t typ_us;	/**< Typical time; the first poll happens here */
+	uint32_t max_us;	/**< Maximum time, after which we give up */
+};
+
+struct jedec_poll_stats {
+	uint32_t ops;		/**< Operations completed or timed out */
+	uint32_t polls;		/**< Polls over all operations */
+	uint32_t max_polls;	/**< Most polls needed by a single operation */
+	uint32_t timeouts;	/**< Operations which timed out */
+};
+
+struct chip_profile;
+struct cmd_script;
+
+/*
+ * A chip we talk to. Everything we need to know to operate it is worked out
+ * once, and kept here, rather than on every access. The bus accessors take
+ * addresses on the bus the chip sits on. All other addresses passed to the
+ * jedec_*() functions are relative to the chip.
+ */
+struct jedec_chip {
+	qiprog_err(*read8) (uint32_t addr, uint8_t * data);
+	qiprog_err(*write8) (uint32_t addr, uint8_t data);
+	uint32_t window;	/**< Bus address of the first byte of the chip */
+	uint32_t cmd_mask;	/**< Command mask which jedec_probe() found */
+	uint32_t size;
+	uint32_t block_size;	/**< Zero if there is no block eraser */
+	uint32_t sector_size;	/**< Zero if there is no sector eraser */
+	const struct chip_profile *profile;	/**< NULL for unknown parts */
+	/* Custom sequences, used by the job engine. NULL for JEDEC ones. */
+	const struct cmd_script *erase_script;
+	const struct cmd_script *program_script;
+};
+
+#define JEDEC_CFI_MAX_REGIONS	4
+
+/* A run of equally sized erase units, as described by CFI */
+struct jedec_cfi_region {
+	uint32_t count;
+	uint32_t size;
+};
+
+/*
+ * What the CFI query told us about a chip. Timings the chip did not report
+ * are left at zero.
+ */
+struct jedec_cfi {
+	uint32_t size;
+	uint8_t num_regions;
+	struct jedec_cfi_region region[JEDEC_CFI_MAX_REGIONS];
+	struct jedec_op_timing timing[JEDEC_NUM_OPS];
+};
+
+/* State of an operation we are waiting on. Filled by jedec_wait_start(). */
+struct jedec_wait {
+	enum jedec_op op;
+	uint32_t addr;
+	uint8_t expected;
+	uint32_t t_start;
+	uint32_t polls;
+};
+
+enum jedec_wait_state {
+	JEDEC_WAIT_BUSY = 0,
+	JEDEC_WAIT_READY,
+	JEDEC_WAIT_TIMEOUT,
+};
 
 qiprog_err jedec_write_co3eb007(struct qiprog_device *dev);
-qiprog_err jedec_probe(struct qiprog_device *dev, struct qiprog_chip_id *id,
-		       uint32_t phys_base, uint32_t *cmd_mask);
-qiprog_err jedec_chip_erase(struct qiprog_device *dev, uint32_t phys_base,
-			    uint32_t cmd_mask);
-qiprog_err jedec_sector_erase(struct qiprog_device *dev, uint32_t sector,
-			      uint32_t cmd_mask);
-qiprog_err jedec_program_byte(struct qiprog_device *dev, uint32_t addr,
-				     uint8_t val, uint32_t mask);
+qiprog_err jedec_probe(struct jedec_chip *chip, struct qiprog_chip_id *id,
+		       uint32_t phys_base);
+qiprog_err jedec_read_id(const struct jedec_chip *chip,
+			 struct qiprog_chip_id *id, uint32_t phys_base);
+qiprog_err jedec_cfi_query(const struct jedec_chip *chip, uint32_t phys_base,
+			   struct jedec_cfi *cfi);
+
+/* Operations are started here. Poll jedec_wait_poll() until they are done. */
+qiprog_err jedec_program_byte_start(const struct jedec_chip *chip,
+				    uint32_t addr, uint8_t val);
+qiprog_err jedec_chip_erase_start(const struct jedec_chip *chip);
+qiprog_err jedec_sector_erase_start(const struct jedec_chip *chip,
+				    uint32_t sector);
+qiprog_err jedec_block_erase_start(const struct jedec_chip *chip,
+				   uint32_t block);
+bool jedec_is_busy(const struct jedec_chip *chip, uint32_t addr);
+void jedec_wait_start(struct jedec_wait *wait, enum jedec_op op,
+		      uint32_t addr, uint8_t expected);
+enum jedec_wait_state jedec_wait_poll(const struct jedec_chip *chip,
+				      struct jedec_wait *wait);
+
+void jedec_set_timing(enum jedec_op op, uint32_t typ_us, uint32_t max_us);
+void jedec_set_poll_method(enum jedec_poll_method method);
+void jedec_get_poll_stats(enum jedec_op op, struct jedec_poll_stats *stats);
+void jedec_reset_poll_stats(void);
+
+#endif				/* JEDEC_FLASH_H */
@@ -0,0 +1,71 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @defgroup jobs Background jobs
+ *
+ * \brief Erase and program operations that run from the main loop
+ *
+ * Erasing or programming spends most of its time waiting for the chip. Rather
+ * than spinning inside the driver, these operations are queued as jobs. Each
+ * call to job_step() does a small piece of work on the job at the head of the
+ * queue, and returns. The main loop stays responsive, and new jobs can be
+ * queued while one is in progress. Jobs complete in the order they were
+ * submitted.
+ *
+ * Each job operates on one chip, and addresses are relative to that chip. Jobs
+ * for one chip are done in order, but jobs for different chips are
+ * interleaved: while one chip is busy erasing or programming, the others get
+ * their next command.
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+/** @{ */
+#include <jedec_flash.h>
+#include <qiprog.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Number of jobs which may be queued at once. Must be a power of two. */
+#define JOB_QUEUE_LEN		16
+/* Largest amount of data a program job can hold */
+#define JOB_DATA_SIZE		256
+
+struct job_status {
+	uint32_t submitted;	/**< Jobs accepted since reset */
+	uint32_t completed;	/**< Jobs finished, successfully or not */
+	uint32_t failed;	/**< Jobs which finished with an error */
+	uint8_t pending;	/**< Jobs queued or in progress */
+	qiprog_err last_error;	/**< Error of the last failed job */
+};
+
+qiprog_err job_submit_erase(const struct jedec_chip *chip, enum jedec_op op,
+			    uint32_t start, uint32_t len, uint32_t unit);
+qiprog_err job_submit_program(const struct jedec_chip *chip, uint32_t addr,
+			      const uint8_t *data, uint32_t len);
+void job_step(void);
+bool job_busy(void);
+void job_flush(void);
+qiprog_err job_clear_error(void);
+void job_get_status(struct job_status *status);
+/** @} */
+
+#endif				/* JOBS_H */
@@ -0,0 +1,83 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @defgroup profile Cycle-count profiling
+ *
+ * \brief Where the time goes, measured with the DWT cycle counter
+ *
+ * Hot paths are bracketed with PROFILE_START() and PROFILE_END(). For each
+ * site, we count the calls, and keep the total, shortest and longest time in
+ * core clock cycles, and a histogram of log2 of the time. With CONFIG_PROFILE
+ * off, the macros are empty, and nothing of this is built.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/** @{ */
+#include <config.h>
+#include <stdint.h>
+
+enum profile_site {
+	PROFILE_LPC_MREAD = 0,
+	PROFILE_LPC_MWRITE,
+	PROFILE_JEDEC_WAIT_POLL,
+	PROFILE_JEDEC_PROGRAM_START,
+	PROFILE_ERASE,
+	PROFILE_READ,
+	PROFILE_WRITE,
+	PROFILE_HANDLE_EVENTS,
+	PROFILE_USB_ISR,
+	PROFILE_JOB_STEP,
+	PROFILE_NUM_SITES,
+};
+
+/* Bin n counts calls which took [2^n, 2^(n+1)) cycles. Bin 0 also has 0. */
+#define PROFILE_HIST_BINS	32
+
+struct profile_stats {
+	uint32_t calls;
+	uint64_t total;		/**< Cycles over all calls */
+	uint32_t min;
+	uint32_t max;
+	uint32_t hist[PROFILE_HIST_BINS];
+};
+
+#if CONFIG_PROFILE
+
+#include <libopencm3/cm3/dwt.h>
+
+#define PROFILE_START(t_start)	uint32_t t_start = DWT_CYCCNT
+#define PROFILE_END(site, t_start)	profile_end(site, t_start)
+
+void profile_init(void);
+void profile_end(enum profile_site site, uint32_t t_start);
+void profile_get(enum profile_site site, struct profile_stats *stats);
+void profile_reset(void);
+
+#else				/* CONFIG_PROFILE */
+
+#define PROFILE_START(t_start)	do { } while (0)
+#define PROFILE_END(site, t_start)	do { } while (0)
+
+#endif				/* CONFIG_PROFILE */
+/** @} */
+
+#endif				/* PROFILE_H */
@@ -0,0 +1,45 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @defgroup timebase Monotonic timebase
+ *
+ * \brief Free-running microsecond counter
+ *
+ * Hardware-specific code should implement these functions. The counter starts
+ * at zero when timebase_init() is called, and wraps around after 2^32
+ * microseconds. Always compare timestamps by subtracting them.
+ *
+ * The timebase is independent of the core clock, but whoever changes the core
+ * clock must tell it with timebase_set_clock().
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+/** @{ */
+#include <stdint.h>
+
+void timebase_init(uint32_t core_hz);
+void timebase_set_clock(uint32_t core_hz);
+uint32_t timebase_us(void);
+void timebase_delay_us(uint32_t us);
+/** @} */
+
+#endif				/* TIMEBASE_H */
@@ -26,7 +26,11 @@
  */
 #include <qiprog.h>
 #include <jedec_flash.h>
+#include <profile.h>
+#include <timebase.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 /** @private */
 enum jedec_cmd {
@@ -37,8 +41,42 @@ enum jedec_cmd {
 	JEDEC_CMD_ERASE_CHIP = 0x10,
 	JEDEC_CMD_ENTER_ID_READ = 0x90,
 	JEDEC_CMD_EXIT_ID_READ = 0xF0,
+	JEDEC_CMD_CFI_QUERY = 0x98,
 };
 
+/* Offsets of the fields in the CFI query structure */
+/** @private */
+enum cfi_offset {
+	CFI_QRY = 0x10,
+	CFI_TYP_PROGRAM = 0x1f,		/* 2^n us */
+	CFI_TYP_ERASE = 0x21,		/* 2^n ms */
+	CFI_TYP_CHIP_ERASE = 0x22,	/* 2^n ms */
+	CFI_MAX_PROGRAM = 0x23,		/* 2^n times typical */
+	CFI_MAX_ERASE = 0x25,		/* 2^n times typical */
+	CFI_MAX_CHIP_ERASE = 0x26,	/* 2^n times typical */
+	CFI_DEVICE_SIZE = 0x27,		/* 2^n bytes */
+	CFI_NUM_REGIONS = 0x2c,
+	CFI_REGIONS = 0x2d,		/* 4 bytes per region */
+	CFI_END = CFI_REGIONS + 4 * JEDEC_CFI_MAX_REGIONS,
+};
+
+/*
+ * Conservative defaults, loose enough for any LPC/FWH part we know of. The
+ * typical times are those of the SST49LF series.
+ */
+/** @private */
+static struct jedec_op_timing op_timing[JEDEC_NUM_OPS] = {
+	[JEDEC_OP_PROGRAM] = {.typ_us = 14, .max_us = 1000},
+	[JEDEC_OP_SECTOR_ERASE] = {.typ_us = 18000, .max_us = 1000000},
+	[JEDEC_OP_BLOCK_ERASE] = {.typ_us = 18000, .max_us = 2000000},
+	[JEDEC_OP_CHIP_ERASE] = {.typ_us = 70000, .max_us = 10000000},
+};
+
+/** @private */
+static enum jedec_poll_method poll_method = JEDEC_POLL_TOGGLE;
+/** @private */
+static struct jedec_poll_stats poll_stats[JEDEC_NUM_OPS];
+
 /* Check one byte for odd parity */
 /** @private */
 static bool is_odd_parity(uint8_t val)
@@ -48,31 +86,159 @@ static bool is_odd_parity(uint8_t val)
 	return (val ^ (val >> 1)) & 0x1;
 }
 
-/** @private */
-static qiprog_err jedec_wait_ready(struct qiprog_device *dev, uint32_t addr)
+/**
+ * @brief Check if the chip is still busy with a program or erase operation
+ *
+ * While an embedded operation is in progress, DQ6 toggles on every read. Two
+ * consecutive reads returning the same DQ6 mean the chip is done.
+ *
+ * @param[in] chip Chip to operate on
+ * @param[in] addr Any address within the chip
+ *
+ * @return true if the chip is still busy, false otherwise
+ */
+bool jedec_is_busy(const struct jedec_chip *chip, uint32_t addr)
 {
-	unsigned int i = 0;
 	uint8_t tmp1, tmp2;
 
-	qiprog_read8(dev, addr, &tmp1);
-	tmp1 &= 0x40;
+	addr += chip->window;
+	chip->read8(addr, &tmp1);
+	chip->read8(addr, &tmp2);
+
+	return ((tmp1 ^ tmp2) & 0x40) ? true : false;
+}
+
+/**
+ * @brief Start waiting on an operation which was just issued
+ *
+ * @param[out] wait Context to pass to jedec_wait_poll()
+ * @param[in] op Type of operation, which determines the timing
+ * @param[in] addr Address which was programmed, or any address in the erased
+ *		   range
+ * @param[in] expected Value the chip returns at addr once done. This is the
+ *		       programmed value, or 0xff after an erase.
+ */
+void jedec_wait_start(struct jedec_wait *wait, enum jedec_op op,
+		      uint32_t addr, uint8_t expected)
+{
+	wait->op = op;
+	wait->addr = addr;
+	wait->expected = expected;
+	wait->polls = 0;
+	wait->t_start = timebase_us();
+}
+
+/** @private */
+static void jedec_account_wait(struct jedec_wait *wait, bool timeout)
+{
+	struct jedec_poll_stats *stats = &poll_stats[wait->op];
+
+	stats->ops++;
+	stats->polls += wait->polls;
+	if (wait->polls > stats->max_polls)
+		stats->max_polls = wait->polls;
+	if (timeout)
+		stats->timeouts++;
+}
+
+/**
+ * @brief Check, without blocking, if the chip finished an operation
+ *
+ * The bus is left alone until the typical time of the operation has elapsed.
+ * Polling a chip that can't possibly be done yet only wastes bus cycles.
+ *
+ * @param[in] chip Chip to operate on
+ * @param[in] wait Context set up by jedec_wait_start()
+ *
+ * @return JEDEC_WAIT_BUSY while the operation is in progress, then either
+ *	   JEDEC_WAIT_READY or JEDEC_WAIT_TIMEOUT
+ */
+enum jedec_wait_state jedec_wait_poll(const struct jedec_chip *chip,
+				      struct jedec_wait *wait)
+{
+	const struct jedec_op_timing *timing = &op_timing[wait->op];
+	uint32_t elapsed;
+	uint8_t val;
+	bool busy;
+	PROFILE_START(t_start);
 
-	while (i++ < 0xFFFFFFF) {
-		qiprog_read8(dev, addr, &tmp2);
-		tmp2 &= 0x40;
-		if (tmp1 == tmp2) {
-			break;
-		}
-		tmp1 = tmp2;
+	elapsed = timebase_us() - wait->t_start;
+	if (elapsed < timing->typ_us)
+		return JEDEC_WAIT_BUSY;
+
+	/* Only polls which go out on the bus are counted */
+	wait->polls++;
+	if (poll_method == JEDEC_POLL_DQ7) {
+		/* DQ7 reads as the complement of the final value until done */
+		chip->read8(chip->window + wait->addr, &val);
+		busy = ((val ^ wait->expected) & 0x80) ? true : false;
+	} else {
+		busy = jedec_is_busy(chip, wait->addr);
 	}
-	if (i > 0x100000) {
-		return QIPROG_ERR_TIMEOUT;
+	PROFILE_END(PROFILE_JEDEC_WAIT_POLL, t_start);
+
+	if (!busy) {
+		jedec_account_wait(wait, false);
+		return JEDEC_WAIT_READY;
 	}
-	return QIPROG_SUCCESS;
+
+	if (elapsed > timing->max_us) {
+		jedec_account_wait(wait, true);
+		return JEDEC_WAIT_TIMEOUT;
+	}
+
+	return JEDEC_WAIT_BUSY;
+}
+
+/**
+ * @brief Set the typical and maximum duration of an operation
+ *
+ * Take these from the datasheet of the chip (tBP, tSE, tBE, tSCE).
+ */
+void jedec_set_timing(enum jedec_op op, uint32_t typ_us, uint32_t max_us)
+{
+	if (op >= JEDEC_NUM_OPS)
+		return;
+
+	op_timing[op].typ_us = typ_us;
+	op_timing[op].max_us = max_us;
+}
+
+/**
+ * @brief Select how to poll for completion of an operation
+ */
+void jedec_set_poll_method(enum jedec_poll_method method)
+{
+	poll_method = method;
 }
 
+/**
+ * @brief Get the polling statistics of one type of operation
+ */
+void jedec_get_poll_stats(enum jedec_op op, struct jedec_poll_stats *stats)
+{
+	if (op >= JEDEC_NUM_OPS) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	*stats = poll_stats[op];
+}
+
+/**
+ * @brief Clear the polling statistics of all operations
+ */
+void jedec_reset_poll_stats(void)
+{
+	memset(poll_stats, 0, sizeof(poll_stats));
+}
+
+/*
+ * Send a command sequence. 'base' is a bus address, with the bits covered by
+ * the command mask cleared.
+ */
 /** @private */
-static qiprog_err jedec_send_cmd(struct qiprog_device *dev, uint32_t base,
+static qiprog_err jedec_send_cmd(const struct jedec_chip *chip, uint32_t base,
 				 uint32_t mask, enum jedec_cmd cmd)
 {
 	qiprog_err ret;
@@ -80,9 +246,9 @@ static qiprog_err jedec_send_cmd(struct qiprog_device *dev, uint32_t base,
 	const uint32_t offset2 = 0x2aaa;
 
 	/* Send the entire sequence at once, even if one transfer fails */
-	ret = qiprog_write8(dev, base | (offset1 & mask), 0xaa);
-	ret |= qiprog_write8(dev, base | (offset2 & mask), 0x55);
-	ret |= qiprog_write8(dev, base | (offset1 & mask), cmd);
+	ret = chip->write8(base | (offset1 & mask), 0xaa);
+	ret |= chip->write8(base | (offset2 & mask), 0x55);
+	ret |= chip->write8(base | (offset1 & mask), cmd);
 	return ret;
 }
 
@@ -98,27 +264,25 @@ static qiprog_err jedec_send_cmd(struct qiprog_device *dev, uint32_t base,
  * Different chips will respond to different length commands. For example, some
  * need the command sent at base + 0x5555, while others expect it at base +
  * 0x555. To accommodate a variety of chips, the command is masked until the
- * chip responds with its ID. This mask is returned in cmd_mask, and needs to be
- * passed to other jedec_*() functions for the chip to be operated correctly.
+ * chip responds with its ID. This mask is stored in chip->cmd_mask, where the
+ * other jedec_*() functions pick it up.
  *
  * This function returns QIPROG_SUCCESS when something on the bus responds. It
  * does not necessarily indicate a JEDEC-compliant chip was found. When a chip
  * can not be detected id->id_method will be set to QIPROG_ID_INVALID.
  *
- * @param[in] dev Device to operate on
+ * @param[in] chip Chip to operate on. Only the bus accessors need to be set.
  * @param[out] id Location where to store device id, if found.
  * @param[in] phys_base Where, in the chip address space to probe
- * @param[out] cmd_mask The mask that was found to work when probing this chip
  *
  * @return QIPROG_SUCCESS on success, or a QIPROG_ERR code otherwise.
  */
-qiprog_err jedec_probe(struct qiprog_device *dev, struct qiprog_chip_id *id,
-		       uint32_t phys_base, uint32_t *cmd_mask)
+qiprog_err jedec_probe(struct jedec_chip *chip, struct qiprog_chip_id *id,
+		       uint32_t phys_base)
 {
 	int i;
 	qiprog_err ret;
 	uint8_t vid, pid;
-	uint16_t id16;
 	uint32_t mask, base;
 
 	/*
@@ -132,18 +296,17 @@ qiprog_err jedec_probe(struct qiprog_device *dev, struct qiprog_chip_id *id,
 		mask = (1 << i) - 1;
 		/* Mask off those bits from our base */
 		base = phys_base & ~mask;
-		ret = jedec_send_cmd(dev, base, mask, JEDEC_CMD_ENTER_ID_READ);
+		ret = jedec_send_cmd(chip, base, mask, JEDEC_CMD_ENTER_ID_READ);
 		if (ret != QIPROG_SUCCESS)
 			continue;
 
 		/* Try to extract the ID */
-		ret = qiprog_read16(dev, base, &id16);
+		ret = chip->read8(base + 0, &vid);
+		ret |= chip->read8(base + 1, &pid);
 		if (ret != QIPROG_SUCCESS)
 			continue;
 
 		/* And see if it's valid */
-		vid = id16 & 0xff;
-		pid = (id16 >> 8) & 0xff;
 		if (!is_odd_parity(vid) || !is_odd_parity(pid))
 			continue;
 
@@ -159,10 +322,10 @@ qiprog_err jedec_probe(struct qiprog_device *dev, struct qiprog_chip_id *id,
 	 */
 	id->vendor_id = vid;
 	id->device_id = pid;
-	*cmd_mask = mask;
+	chip->cmd_mask = mask;
 
 	/* We MUST reach this line to get the chip out of read ID mode */
-	jedec_send_cmd(dev, base, mask, JEDEC_CMD_EXIT_ID_READ);
+	jedec_send_cmd(chip, base, mask, JEDEC_CMD_EXIT_ID_READ);
 
 	/*
 	 * Irrespective of having found a chip, We should always return
@@ -173,68 +336,238 @@ qiprog_err jedec_probe(struct qiprog_device *dev, struct qiprog_chip_id *id,
 }
 
 /**
- * @brief Program (write) a byte to a  JEDEC-compliant chip
+ * @brief Read the ID of a chip which was already probed
  *
- * @param[in] dev Device to operate on
- * @param[in] addr Address to program
- * @param[in] val Value to write
- * @param[in] mask The mask that was found to work when probing this chip
+ * Unlike jedec_probe(), this only uses the command mask found by the probe, and
+ * changes nothing in 'chip'. It is cheap enough to read the ID over and over,
+ * for instance to check that the bus works.
  *
- * @return QIPROG_SUCCESS on success, or a QIPROG_ERR code otherwise.
+ * @param[in] chip Chip to operate on
+ * @param[out] id Location where to store device id
+ * @param[in] phys_base Where, in the chip address space to read the ID
+ *
+ * @return QIPROG_SUCCESS on success, QIPROG_ERR_NO_RESPONSE if the ID is not
+ * valid, or another QIPROG_ERR code otherwise.
  */
-qiprog_err jedec_program_byte(struct qiprog_device *dev, uint32_t addr,
-				     uint8_t val, uint32_t mask)
+qiprog_err jedec_read_id(const struct jedec_chip *chip,
+			 struct qiprog_chip_id *id, uint32_t phys_base)
 {
 	qiprog_err ret;
-	uint32_t base = addr & ~mask;
+	uint8_t vid = 0, pid = 0;
+	const uint32_t mask = chip->cmd_mask;
+	const uint32_t base = phys_base & ~mask;
 
-	ret = jedec_send_cmd(dev, base, mask, JEDEC_CMD_BYTE_PROGRAM);
+	ret = jedec_send_cmd(chip, base, mask, JEDEC_CMD_ENTER_ID_READ);
+	if (ret == QIPROG_SUCCESS) {
+		ret = chip->read8(base + 0, &vid);
+		ret |= chip->read8(base + 1, &pid);
+	}
+
+	/* We MUST reach this line to get the chip out of read ID mode */
+	ret |= jedec_send_cmd(chip, base, mask, JEDEC_CMD_EXIT_ID_READ);
 	if (ret != QIPROG_SUCCESS)
 		return ret;
 
-	ret = qiprog_write8(dev, addr, val);
-	return ret | jedec_wait_ready(dev, base);
+	if (!is_odd_parity(vid) || !is_odd_parity(pid))
+		return QIPROG_ERR_NO_RESPONSE;
+
+	id->id_method = QIPROG_ID_METH_JEDEC;
+	id->vendor_id = vid;
+	id->device_id = pid;
+	return QIPROG_SUCCESS;
+}
+
+/** @private */
+static bool cfi_is_query_mode(const struct jedec_chip *chip, uint32_t base)
+{
+	uint8_t qry[3];
+	qiprog_err ret;
+
+	ret = chip->read8(base + CFI_QRY + 0, &qry[0]);
+	ret |= chip->read8(base + CFI_QRY + 1, &qry[1]);
+	ret |= chip->read8(base + CFI_QRY + 2, &qry[2]);
+
+	return (ret == QIPROG_SUCCESS) && !memcmp(qry, "QRY", 3);
+}
+
+/* Typical and maximum time from a pair of CFI exponents, in microseconds */
+/** @private */
+static void cfi_timing(struct jedec_op_timing *timing, uint8_t typ,
+		       uint8_t max, uint32_t unit_us)
+{
+	uint64_t max_us;
+
+	/* Zero means the chip does not tell */
+	if (!typ || (typ > 20) || (max > 10))
+		return;
+
+	timing->typ_us = (1UL << typ) * unit_us;
+	max_us = (uint64_t)timing->typ_us << max;
+	timing->max_us = (max_us > UINT32_MAX) ? UINT32_MAX : max_us;
+}
+
+/**
+ * @brief Read the Common Flash Interface (CFI) query structure of a chip
+ *
+ * Chips which implement CFI describe their size, erase layout and timings in a
+ * table that can be read after a query command. Both the plain query at offset
+ * 0x55, and the unlock-sequence query used by SST parts are tried.
+ *
+ * @param[in] chip Chip to operate on. Only the bus accessors and command mask
+ *		   need to be set.
+ * @param[in] phys_base Where, in the chip address space to query
+ * @param[out] cfi What the chip reported
+ *
+ * @return QIPROG_SUCCESS if the chip answered the query, or
+ *	   QIPROG_ERR_NO_RESPONSE if it does not support CFI.
+ */
+qiprog_err jedec_cfi_query(const struct jedec_chip *chip, uint32_t phys_base,
+			   struct jedec_cfi *cfi)
+{
+	uint8_t raw[CFI_END];
+	uint32_t base, mask = chip->cmd_mask;
+	uint8_t i, *reg;
+	bool found;
+
+	/* The table starts on a 256-byte boundary */
+	base = phys_base & ~0xff;
+
+	chip->write8(base | 0x55, JEDEC_CMD_CFI_QUERY);
+	found = cfi_is_query_mode(chip, base);
+	if (!found) {
+		jedec_send_cmd(chip, base & ~mask, mask, JEDEC_CMD_CFI_QUERY);
+		found = cfi_is_query_mode(chip, base);
+	}
+
+	for (i = 0; found && (i < CFI_END); i++) {
+		if (chip->read8(base + i, &raw[i]) != QIPROG_SUCCESS)
+			found = false;
+	}
+
+	/* We MUST reach this line to get the chip back to read mode */
+	chip->write8(base, JEDEC_CMD_EXIT_ID_READ);
+	jedec_send_cmd(chip, base & ~mask, mask, JEDEC_CMD_EXIT_ID_READ);
+
+	if (!found || (raw[CFI_DEVICE_SIZE] > 26))
+		return QIPROG_ERR_NO_RESPONSE;
+
+	memset(cfi, 0, sizeof(*cfi));
+	cfi->size = 1UL << raw[CFI_DEVICE_SIZE];
+
+	cfi->num_regions = raw[CFI_NUM_REGIONS];
+	if (cfi->num_regions > JEDEC_CFI_MAX_REGIONS)
+		cfi->num_regions = JEDEC_CFI_MAX_REGIONS;
+	for (i = 0; i < cfi->num_regions; i++) {
+		reg = raw + CFI_REGIONS + 4 * i;
+		cfi->region[i].count = (reg[0] | (reg[1] << 8)) + 1;
+		/* Units of 256 bytes, where zero means 128 bytes */
+		cfi->region[i].size = (reg[2] | (reg[3] << 8)) * 256;
+		if (!cfi->region[i].size)
+			cfi->region[i].size = 128;
+	}
+
+	cfi_timing(&cfi->timing[JEDEC_OP_PROGRAM], raw[CFI_TYP_PROGRAM],
+		   raw[CFI_MAX_PROGRAM], 1);
+	cfi_timing(&cfi->timing[JEDEC_OP_SECTOR_ERASE], raw[CFI_TYP_ERASE],
+		   raw[CFI_MAX_ERASE], 1000);
+	cfi_timing(&cfi->timing[JEDEC_OP_BLOCK_ERASE], raw[CFI_TYP_ERASE],
+		   raw[CFI_MAX_ERASE], 1000);
+	cfi_timing(&cfi->timing[JEDEC_OP_CHIP_ERASE], raw[CFI_TYP_CHIP_ERASE],
+		   raw[CFI_MAX_CHIP_ERASE], 1000);
+
+	return QIPROG_SUCCESS;
 }
 
 /**
- * @brief Perform a chip-erase on a JEDEC-compliant chip
+ * @brief Start programming a byte on a JEDEC-compliant chip
  *
- * @param[in] dev Device to operate on
- * @param[in] base Base address of the chip
- * @param[in] mask The mask that was found to work when probing this chip
+ * This only sends the command. Use jedec_wait_start() and jedec_wait_poll() to
+ * find out when the chip is done.
+ *
+ * @param[in] chip Chip to operate on
+ * @param[in] addr Address to program
+ * @param[in] val Value to write
  *
  * @return QIPROG_SUCCESS on success, or a QIPROG_ERR code otherwise.
  */
-qiprog_err jedec_chip_erase(struct qiprog_device *dev, uint32_t base,
-			    uint32_t mask)
+qiprog_err jedec_program_byte_start(const struct jedec_chip *chip,
+				    uint32_t addr, uint8_t val)
 {
 	qiprog_err ret;
+	const uint32_t mask = chip->cmd_mask;
+	PROFILE_START(t_start);
+
+	addr += chip->window;
+	ret = jedec_send_cmd(chip, addr & ~mask, mask, JEDEC_CMD_BYTE_PROGRAM);
+	if (ret == QIPROG_SUCCESS)
+		ret = chip->write8(addr, val);
 
-	ret = jedec_send_cmd(dev, base, mask, JEDEC_CMD_ERASE);
-	ret |= jedec_send_cmd(dev, base, mask, JEDEC_CMD_ERASE_CHIP);
-	return jedec_wait_ready(dev, base);
+	PROFILE_END(PROFILE_JEDEC_PROGRAM_START, t_start);
+	return ret;
 }
 
 /**
- * @brief Perform a sector-erase on a JEDEC-compliant chip
+ * @brief Start a chip-erase on a JEDEC-compliant chip
  *
- * @param[in] dev Device to operate on
- * @param[in] sector Base address of the sector
- * @param[in] mask The mask that was found to work when probing this chip
+ * @param[in] chip Chip to operate on
  *
  * @return QIPROG_SUCCESS on success, or a QIPROG_ERR code otherwise.
  */
-qiprog_err jedec_sector_erase(struct qiprog_device *dev, uint32_t sector,
-			      uint32_t mask)
+qiprog_err jedec_chip_erase_start(const struct jedec_chip *chip)
 {
 	qiprog_err ret;
-	uint32_t base = sector & ~mask;
+	const uint32_t mask = chip->cmd_mask;
+	const uint32_t base = chip->window & ~mask;
+
+	ret = jedec_send_cmd(chip, base, mask, JEDEC_CMD_ERASE);
+	ret |= jedec_send_cmd(chip, base, mask, JEDEC_CMD_ERASE_CHIP);
+	return ret;
+}
+
+/* Sector and block erase only differ in the last command */
+static qiprog_err jedec_unit_erase_start(const struct jedec_chip *chip,
+					 uint32_t unit, enum jedec_cmd cmd)
+{
+	qiprog_err ret;
+	const uint32_t mask = chip->cmd_mask;
 	const uint32_t offset1 = 0x5555;
 	const uint32_t offset2 = 0x2aaa;
+	uint32_t base;
+
+	unit += chip->window;
+	base = unit & ~mask;
 
-	ret = jedec_send_cmd(dev, base, mask, JEDEC_CMD_ERASE);
-	ret |= qiprog_write8(dev, base | (offset1 & mask), 0xaa);
-	ret |= qiprog_write8(dev, base | (offset2 & mask), 0x55);
-	ret |= qiprog_write8(dev, base | sector, JEDEC_CMD_ERASE_SECTOR);
-	return jedec_wait_ready(dev, base);
+	ret = jedec_send_cmd(chip, base, mask, JEDEC_CMD_ERASE);
+	ret |= chip->write8(base | (offset1 & mask), 0xaa);
+	ret |= chip->write8(base | (offset2 & mask), 0x55);
+	ret |= chip->write8(unit, cmd);
+	return ret;
+}
+
+/**
+ * @brief Start a sector-erase on a JEDEC-compliant chip
+ *
+ * @param[in] chip Chip to operate on
+ * @param[in] sector Base address of the sector
+ *
+ * @return QIPROG_SUCCESS on success, or a QIPROG_ERR code otherwise.
+ */
+qiprog_err jedec_sector_erase_start(const struct jedec_chip *chip,
+				    uint32_t sector)
+{
+	return jedec_unit_erase_start(chip, sector, JEDEC_CMD_ERASE_SECTOR);
+}
+
+/**
+ * @brief Start a block-erase on a JEDEC-compliant chip
+ *
+ * @param[in] chip Chip to operate on
+ * @param[in] block Base address of the block
+ *
+ * @return QIPROG_SUCCESS on success, or a QIPROG_ERR code otherwise.
+ */
+qiprog_err jedec_block_erase_start(const struct jedec_chip *chip,
+				   uint32_t block)
+{
+	return jedec_unit_erase_start(chip, block, JEDEC_CMD_ERASE_BLOCK);
 }
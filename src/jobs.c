@@ -0,0 +1,387 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file jobs.c Resumable erase and program jobs
+ *
+ * Each job is a small state machine: issue a command to the chip, then poll
+ * it until it is ready, and move on to the next byte or erase unit. Only one
+ * command or one poll is done per call to job_step(). The chip is not polled
+ * before the typical time of the operation has passed; see jedec_wait_poll().
+ * Chips with custom command scripts run those instead, one poll at a time.
+ */
+
+#include <cmd_script.h>
+#include <jobs.h>
+#include <jedec_flash.h>
+#include <profile.h>
+
+#include <libopencm3/cm3/cortex.h>
+#include <string.h>
+
+enum job_type {
+	JOB_ERASE,
+	JOB_PROGRAM,
+};
+
+enum job_state {
+	JOB_FREE = 0,
+	JOB_RESERVED,
+	JOB_ISSUE,
+	JOB_WAIT,
+	JOB_DONE,
+};
+
+struct job {
+	volatile enum job_state state;
+	enum job_type type;
+	const struct jedec_chip *chip;
+	uint32_t addr;
+	uint32_t len;
+	uint32_t pos;
+	/* Erase operation, and the size of one erase unit */
+	enum jedec_op op;
+	uint32_t unit;
+	struct jedec_wait wait;
+	/* Custom command script, if the chip has one for this job */
+	const struct cmd_script *script;
+	struct cmd_script_run run;
+	uint8_t data[JOB_DATA_SIZE];
+};
+
+static struct job queue[JOB_QUEUE_LEN];
+/* Next slot to be handed out */
+static volatile uint8_t q_head = 0;
+/* Oldest job which has not been retired */
+static volatile uint8_t q_tail = 0;
+
+static struct job_status status;
+static qiprog_err sticky_error = QIPROG_SUCCESS;
+
+/* Reserve a slot. Safe to call from interrupts. */
+static struct job *job_alloc(void)
+{
+	struct job *job = NULL;
+	uint32_t irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	if ((uint8_t)(q_head - q_tail) < JOB_QUEUE_LEN) {
+		job = &queue[q_head % JOB_QUEUE_LEN];
+		job->state = JOB_RESERVED;
+		q_head++;
+		status.submitted++;
+	}
+	cm_mask_interrupts(irq_mask);
+
+	return job;
+}
+
+static void job_finish(struct job *job, qiprog_err ret)
+{
+	uint32_t irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	status.completed++;
+	if (ret != QIPROG_SUCCESS) {
+		status.failed++;
+		status.last_error = ret;
+		sticky_error = ret;
+	}
+	job->state = JOB_DONE;
+	cm_mask_interrupts(irq_mask);
+}
+
+/* Free the slots of finished jobs, oldest first */
+static void job_retire(void)
+{
+	struct job *job;
+	uint32_t irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	while (q_tail != q_head) {
+		job = &queue[q_tail % JOB_QUEUE_LEN];
+		if (job->state != JOB_DONE)
+			break;
+		job->state = JOB_FREE;
+		q_tail++;
+	}
+	cm_mask_interrupts(irq_mask);
+}
+
+/* Send the command for the current byte or erase unit */
+static qiprog_err job_issue(struct job *job)
+{
+	uint32_t addr = job->addr + job->pos;
+	qiprog_err ret;
+
+	if (job->script) {
+		cmd_script_start(&job->run, job->script, addr,
+				 (job->type == JOB_PROGRAM) ?
+				 job->data[job->pos] : 0xff);
+		return QIPROG_SUCCESS;
+	}
+
+	/*
+	 * The chip starts on the last cycle of the command, so that is where
+	 * the typical and maximum times count from. Sending the command takes
+	 * a good part of tBP.
+	 */
+	if (job->type == JOB_PROGRAM) {
+		ret = jedec_program_byte_start(job->chip, addr,
+					       job->data[job->pos]);
+		jedec_wait_start(&job->wait, JEDEC_OP_PROGRAM, addr,
+				 job->data[job->pos]);
+		return ret;
+	}
+
+	switch (job->op) {
+	case JEDEC_OP_CHIP_ERASE:
+		ret = jedec_chip_erase_start(job->chip);
+		break;
+	case JEDEC_OP_BLOCK_ERASE:
+		ret = jedec_block_erase_start(job->chip, addr);
+		break;
+	case JEDEC_OP_SECTOR_ERASE:
+		ret = jedec_sector_erase_start(job->chip, addr);
+		break;
+	default:
+		return QIPROG_ERR_ARG;
+	}
+	jedec_wait_start(&job->wait, job->op, addr, 0xff);
+	return ret;
+}
+
+/* How far to advance once the chip is ready again */
+static uint32_t job_advance(struct job *job)
+{
+	if (job->type == JOB_PROGRAM)
+		return 1;
+
+	return job->unit;
+}
+
+/**
+ * \brief Queue an erase job
+ *
+ * Erase 'len' bytes starting at 'start', one 'unit' at a time, using the erase
+ * operation 'op'. For a chip erase, the unit is the whole chip. This may be
+ * called from an interrupt.
+ *
+ * @return QIPROG_SUCCESS, or QIPROG_ERR if the queue is full
+ */
+qiprog_err job_submit_erase(const struct jedec_chip *chip, enum jedec_op op,
+			    uint32_t start, uint32_t len, uint32_t unit)
+{
+	struct job *job;
+
+	if (!unit || (op == JEDEC_OP_PROGRAM) || (op >= JEDEC_NUM_OPS))
+		return QIPROG_ERR_ARG;
+
+	if (!(job = job_alloc()))
+		return QIPROG_ERR;
+
+	job->type = JOB_ERASE;
+	job->op = op;
+	job->chip = chip;
+	job->addr = start;
+	job->len = len;
+	job->pos = 0;
+	job->unit = unit;
+	job->script = chip->erase_script;
+	job->state = JOB_ISSUE;
+
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * \brief Queue a program job
+ *
+ * The data is copied, so the caller may reuse its buffer right away. If the
+ * queue is full, this works on the queue until a slot is available. Only call
+ * this from the main loop.
+ */
+qiprog_err job_submit_program(const struct jedec_chip *chip, uint32_t addr,
+			      const uint8_t *data, uint32_t len)
+{
+	struct job *job;
+
+	if (len > JOB_DATA_SIZE)
+		return QIPROG_ERR_ARG;
+
+	while (!(job = job_alloc()))
+		job_step();
+
+	job->type = JOB_PROGRAM;
+	job->chip = chip;
+	job->addr = addr;
+	job->len = len;
+	job->pos = 0;
+	memcpy(job->data, data, len);
+	job->script = chip->program_script;
+	job->state = JOB_ISSUE;
+
+	return QIPROG_SUCCESS;
+}
+
+/* Run the script of a job until it has to wait for the chip */
+static void job_work_script(struct job *job)
+{
+	switch (cmd_script_step(job->chip, &job->run)) {
+	case CMD_SCRIPT_BUSY:
+		break;
+	case CMD_SCRIPT_FAILED:
+		job_finish(job, job->run.error);
+		break;
+	case CMD_SCRIPT_DONE:
+		job->pos += job_advance(job);
+		job->state = JOB_ISSUE;
+		break;
+	}
+}
+
+/* Do one step of work on a job: send a command, or see if the chip is done */
+static void job_work(struct job *job)
+{
+	qiprog_err ret;
+
+	switch (job->state) {
+	case JOB_ISSUE:
+		/* Programming can only clear bits, so 0xff is a no-op */
+		while ((job->type == JOB_PROGRAM) && (job->pos < job->len) &&
+		       (job->data[job->pos] == 0xff))
+			job->pos++;
+		if (job->pos >= job->len) {
+			job_finish(job, QIPROG_SUCCESS);
+			break;
+		}
+		ret = job_issue(job);
+		if (ret != QIPROG_SUCCESS) {
+			job_finish(job, ret);
+			break;
+		}
+		job->state = JOB_WAIT;
+		break;
+	case JOB_WAIT:
+		if (job->script) {
+			job_work_script(job);
+			break;
+		}
+		switch (jedec_wait_poll(job->chip, &job->wait)) {
+		case JEDEC_WAIT_BUSY:
+			break;
+		case JEDEC_WAIT_TIMEOUT:
+			job_finish(job, QIPROG_ERR_TIMEOUT);
+			break;
+		case JEDEC_WAIT_READY:
+			job->pos += job_advance(job);
+			job->state = JOB_ISSUE;
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * \brief Do one step of work on every chip with queued jobs
+ *
+ * Only the oldest unfinished job of each chip is worked on, so jobs for the
+ * same chip complete in the order they were submitted. Call this from the main
+ * loop as often as possible.
+ */
+void job_step(void)
+{
+	struct job *job;
+	/* Chips which already have an older job in progress */
+	const struct jedec_chip *busy[JOB_QUEUE_LEN];
+	uint8_t i, j, num_busy = 0, head = q_head;
+	PROFILE_START(t_start);
+
+	for (i = q_tail; i != head; i++) {
+		job = &queue[i % JOB_QUEUE_LEN];
+
+		/* Still being filled in by whoever submitted it */
+		if (job->state == JOB_RESERVED)
+			break;
+		if (job->state == JOB_DONE)
+			continue;
+
+		for (j = 0; j < num_busy; j++) {
+			if (busy[j] == job->chip)
+				break;
+		}
+		if (j < num_busy)
+			continue;
+		busy[num_busy++] = job->chip;
+
+		job_work(job);
+	}
+
+	job_retire();
+	PROFILE_END(PROFILE_JOB_STEP, t_start);
+}
+
+/**
+ * \brief Are there jobs queued or in progress?
+ */
+bool job_busy(void)
+{
+	return q_tail != q_head;
+}
+
+/**
+ * \brief Complete all queued jobs
+ *
+ * Only call this from the main loop.
+ */
+void job_flush(void)
+{
+	while (job_busy())
+		job_step();
+}
+
+/**
+ * \brief Get and clear the error of any job which failed since the last call
+ */
+qiprog_err job_clear_error(void)
+{
+	qiprog_err ret;
+	uint32_t irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	ret = sticky_error;
+	sticky_error = QIPROG_SUCCESS;
+	cm_mask_interrupts(irq_mask);
+
+	return ret;
+}
+
+/**
+ * \brief Get the status of the job queue
+ */
+void job_get_status(struct job_status *stat)
+{
+	uint32_t irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	*stat = status;
+	stat->pending = q_head - q_tail;
+	cm_mask_interrupts(irq_mask);
+}
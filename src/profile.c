@@ -0,0 +1,100 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file profile.c Per-site cycle counts
+ */
+
+#include <profile.h>
+
+#if CONFIG_PROFILE
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scs.h>
+#include <string.h>
+
+static struct profile_stats stats[PROFILE_NUM_SITES];
+
+/**
+ * \brief Start the cycle counter, and clear all statistics
+ */
+void profile_init(void)
+{
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+	profile_reset();
+}
+
+/**
+ * \brief Account for one call to 'site', which started at 't_start'
+ *
+ * Sites are reached from the main loop and from interrupts alike, so this
+ * masks interrupts while it updates the statistics.
+ */
+void profile_end(enum profile_site site, uint32_t t_start)
+{
+	struct profile_stats *st = &stats[site];
+	uint32_t cycles, irq_mask;
+	uint8_t bin;
+
+	/* The counter wraps, but subtracting takes care of that */
+	cycles = DWT_CYCCNT - t_start;
+	bin = cycles ? (31 - __builtin_clz(cycles)) : 0;
+
+	irq_mask = cm_mask_interrupts(1);
+	st->calls++;
+	st->total += cycles;
+	if (cycles < st->min)
+		st->min = cycles;
+	if (cycles > st->max)
+		st->max = cycles;
+	st->hist[bin]++;
+	cm_mask_interrupts(irq_mask);
+}
+
+/**
+ * \brief Get the statistics of one site
+ */
+void profile_get(enum profile_site site, struct profile_stats *out)
+{
+	uint32_t irq_mask;
+
+	irq_mask = cm_mask_interrupts(1);
+	*out = stats[site];
+	cm_mask_interrupts(irq_mask);
+}
+
+/**
+ * \brief Clear the statistics of all sites
+ */
+void profile_reset(void)
+{
+	uint32_t irq_mask;
+	int i;
+
+	irq_mask = cm_mask_interrupts(1);
+	memset(stats, 0, sizeof(stats));
+	for (i = 0; i < PROFILE_NUM_SITES; i++)
+		stats[i].min = UINT32_MAX;
+	cm_mask_interrupts(irq_mask);
+}
+
+#endif				/* CONFIG_PROFILE */
@@ -0,0 +1,86 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the libopencm3 LM4F GPIO API. The ports are not memory,
+ * but the simulated bus in sim/sim_bus.c, which sees every access the driver
+ * makes.
+ */
+
+#ifndef LIBOPENCM3_LM4F_GPIO_H
+#define LIBOPENCM3_LM4F_GPIO_H
+
+#include <stdint.h>
+
+#define GPIOA		0
+#define GPIOB		1
+#define GPIOC		2
+#define GPIOD		3
+#define GPIOE		4
+#define GPIOF		5
+
+#define GPIO0		(1 << 0)
+#define GPIO1		(1 << 1)
+#define GPIO2		(1 << 2)
+#define GPIO3		(1 << 3)
+#define GPIO4		(1 << 4)
+#define GPIO5		(1 << 5)
+#define GPIO6		(1 << 6)
+#define GPIO7		(1 << 7)
+#define GPIO_ALL	0xff
+
+/* Each use is one read-modify-write of the direction register */
+#define GPIO_DIR(port)	(*sim_gpio_dir(port))
+
+enum gpio_mode {
+	GPIO_MODE_OUTPUT,
+	GPIO_MODE_INPUT,
+	GPIO_MODE_ANALOG,
+};
+
+enum gpio_pullup {
+	GPIO_PUPD_NONE,
+	GPIO_PUPD_PULLUP,
+	GPIO_PUPD_PULLDOWN,
+};
+
+enum gpio_output_type {
+	GPIO_OTYPE_PP,
+	GPIO_OTYPE_OD,
+};
+
+enum gpio_drive_strength {
+	GPIO_DRIVE_2MA,
+	GPIO_DRIVE_4MA,
+	GPIO_DRIVE_8MA,
+	GPIO_DRIVE_8MA_SLEW_CTL,
+};
+
+volatile uint32_t *sim_gpio_dir(uint32_t gpioport);
+
+void gpio_mode_setup(uint32_t gpioport, enum gpio_mode mode,
+		     enum gpio_pullup pullup, uint8_t gpios);
+void gpio_set_output_config(uint32_t gpioport, enum gpio_output_type otype,
+			    enum gpio_drive_strength drive, uint8_t gpios);
+void gpio_set(uint32_t gpioport, uint8_t gpios);
+void gpio_clear(uint32_t gpioport, uint8_t gpios);
+uint8_t gpio_read(uint32_t gpioport, uint8_t gpios);
+void gpio_write(uint32_t gpioport, uint8_t gpios, uint8_t data);
+
+#endif				/* LIBOPENCM3_LM4F_GPIO_H */
@@ -0,0 +1,147 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file firmware.c The rest of the firmware, as far as the driver can tell
+ *
+ * The driver is linked against these instead of the board code. Time comes
+ * from the simulated bus, there is no console unless asked for, and nothing
+ * but the job engine competes for the bus.
+ */
+
+#include "sim.h"
+#include "lpc_calib.h"
+#include "stellaris.h"
+
+#include <blackbox.h>
+#include <jobs.h>
+#include <timebase.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static bool verbose = false;
+static uint32_t usb_bus_us[2];
+
+void timebase_init(uint32_t core_hz)
+{
+	(void)core_hz;
+}
+
+void timebase_set_clock(uint32_t core_hz)
+{
+	(void)core_hz;
+}
+
+/* Every call stands for a pass of a polling loop, so it takes time */
+uint32_t timebase_us(void)
+{
+	sim_advance(SIM_POLL_NS);
+	return sim_time_ns() / 1000;
+}
+
+void timebase_delay_us(uint32_t us)
+{
+	sim_advance((uint64_t)us * 1000);
+}
+
+void print_blackbox(const char *format, ...)
+{
+	va_list args;
+
+	if (!verbose)
+		return;
+
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+}
+
+/**
+ * @brief Print what the firmware logs
+ */
+void sim_set_verbose(bool on)
+{
+	verbose = on;
+}
+
+uint32_t stellaris_core_hz(void)
+{
+	return 80000000;
+}
+
+void usb_stream_bus_time(enum usb_stream_dir dir, uint32_t us)
+{
+	usb_bus_us[dir] += us;
+}
+
+/**
+ * @brief Bus time QiProg transfers reported for a direction, so far
+ */
+uint32_t sim_usb_bus_us(int dir)
+{
+	return usb_bus_us[dir];
+}
+
+bool batch_busy(void)
+{
+	return false;
+}
+
+bool verify_busy(void)
+{
+	return false;
+}
+
+bool bench_busy(void)
+{
+	return false;
+}
+
+bool calib_busy(void)
+{
+	return false;
+}
+
+/**
+ * @brief What one pass of the main loop does to the bus
+ *
+ * There are no USB events to handle. Switches of the bus which were asked for
+ * are applied, and queued jobs take a step.
+ */
+void sim_main_loop_pass(void)
+{
+	stellaris_bus_step();
+	if (job_busy())
+		job_step();
+}
+
+/**
+ * @brief Spin the main loop until all queued jobs are done
+ *
+ * @return the first error of a job which failed, if any
+ */
+qiprog_err sim_run_jobs(void)
+{
+	do {
+		sim_main_loop_pass();
+	} while (job_busy());
+
+	return job_clear_error();
+}
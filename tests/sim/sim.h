@@ -0,0 +1,142 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @defgroup sim Simulated bus and chips
+ *
+ * \brief Run the firmware's bus code on the host, against simulated chips
+ *
+ * The driver is built unchanged, against a GPIO layer which feeds every pin
+ * access to the chips in the sockets. Each chip follows the LPC and FWH frames
+ * one CLK rising edge at a time, or the A/A-Mux strobes if it was reset into
+ * that mode, and runs the JEDEC command set on its own memory. Programs and
+ * erases take the time they are configured to, and DQ6 toggles and DQ7 reads
+ * inverted while they do.
+ *
+ * Time only moves when the firmware does something. Every GPIO register access
+ * costs SIM_STORE_NS or SIM_LOAD_NS, delays take as long as asked, and every
+ * call to timebase_us() costs SIM_POLL_NS, as it stands for one pass of a
+ * polling loop. Busy loops in pin_delay() are not charged.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+/** @{ */
+#include <qiprog.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Cost of each GPIO register access, and of a pass of a polling loop */
+#define SIM_STORE_NS		25
+#define SIM_LOAD_NS		25
+#define SIM_POLL_NS		1000
+
+/* Sockets on the bus. Socket n has its ID straps tied to n. */
+#define SIM_MAX_CHIPS		4
+
+/* SYNC values a chip may answer with before it is ready */
+#define SIM_SYNC_SHORT_WAIT	0x5
+#define SIM_SYNC_LONG_WAIT	0x6
+
+/* Bits of sim_chip_config.fwh_msizes */
+#define SIM_FWH_MSIZE(msize)	(1 << (msize))
+
+struct sim_chip_config {
+	uint8_t vendor_id;
+	uint8_t device_id;
+	uint32_t size;
+	uint32_t sector_size;
+	uint32_t block_size;
+	uint32_t cmd_mask;	/**< Address bits the command decoder looks at */
+	uint32_t program_us;	/**< tBP */
+	uint32_t sector_erase_us;	/**< tSE */
+	uint32_t block_erase_us;	/**< tBE */
+	uint32_t chip_erase_us;	/**< tSCE */
+	uint8_t fwh_msizes;	/**< FWH read sizes answered, SIM_FWH_MSIZE() */
+	bool cfi;		/**< Answer CFI queries */
+	bool early_sync;	/**< SYNC during the last TAR clock */
+	uint8_t sync;		/**< Wait SYNC sent before ready */
+	uint16_t sync_waits;	/**< Wait clocks before ready, per frame */
+};
+
+/* Everything is counted from sim_reset() */
+struct sim_stats {
+	uint64_t time_ns;	/**< Simulated time */
+	uint64_t clocks;	/**< LPC clocks, or A/A-Mux R/#C cycles */
+	uint64_t stores;	/**< GPIO register writes */
+	uint64_t loads;		/**< GPIO register reads */
+	uint32_t frames;	/**< LPC and FWH frames a chip answered */
+	uint32_t aborts;	/**< Frames aborted with #LFRAME */
+	uint32_t reads;		/**< Bytes the chips returned */
+	uint32_t writes;	/**< Bytes the chips were sent */
+	uint32_t busy_reads;	/**< Reads of a chip which was busy */
+	uint32_t programs;	/**< Bytes programmed */
+	uint32_t erases;	/**< Sector, block and chip erases */
+	uint32_t bad_programs;	/**< Programs which would have set bits */
+	uint32_t busy_writes;	/**< Writes a busy chip ignored */
+	uint32_t contention;	/**< Samples where drivers disagreed */
+};
+
+/* What happened on one LPC clock, as seen at the rising edge */
+struct sim_clock {
+	bool lframe;		/**< #LFRAME asserted */
+	bool host_drives;	/**< LAD driven by us, rather than a chip */
+	uint8_t lad;		/**< Value on LAD[3:0] */
+	bool irq_masked;	/**< Interrupts were masked */
+};
+
+extern const struct sim_chip_config sim_sst49lf040;
+extern const struct sim_chip_config sim_fwh_cfi;
+
+void sim_reset(void);
+qiprog_err sim_add_chip(uint8_t socket, const struct sim_chip_config *cfg);
+uint8_t *sim_chip_mem(uint8_t socket);
+void sim_get_stats(struct sim_stats *stats);
+void sim_stats_sub(struct sim_stats *delta, const struct sim_stats *now,
+		   const struct sim_stats *before);
+uint64_t sim_time_ns(void);
+void sim_advance(uint64_t ns);
+bool sim_irq_masked(void);
+void sim_trace_start(struct sim_clock *clocks, size_t max);
+size_t sim_trace_stop(void);
+
+/* The driver under test, from qiprog_lpc.c */
+extern struct qiprog_device stellaris_lpc_dev;
+
+/* firmware.c: what the main loop does, and what the USB side records */
+void sim_main_loop_pass(void);
+qiprog_err sim_run_jobs(void);
+uint32_t sim_usb_bus_us(int dir);
+void sim_set_verbose(bool verbose);
+
+/* sim_chip.c, for sim_bus.c */
+void sim_chip_reset(uint8_t socket, bool aamux);
+bool sim_chip_present(uint8_t socket);
+void sim_chip_clock(uint8_t socket, bool lframe, uint8_t lad);
+uint8_t sim_chip_drive(uint8_t socket, uint8_t *val);
+void sim_chip_aamux_latch(uint8_t socket, bool column, uint16_t addr);
+void sim_chip_aamux_oe(uint8_t socket, bool asserted);
+void sim_chip_aamux_we(uint8_t socket, uint8_t data);
+void sim_chip_count(struct sim_stats *stats);
+void sim_chips_clear(void);
+/** @} */
+
+#endif				/* SIM_H */
@@ -0,0 +1,345 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file sim_bus.c GPIO ports wired to the simulated sockets
+ *
+ * The ports have an output latch and a direction register, like the real ones.
+ * Every pin is pulled up, so a pin nobody drives reads high. The wiring is the
+ * one of lpc_pins.h and aamux_pins.h:
+ *
+ *  - LAD[3:0], or DQ[7:0] in A/A-Mux mode, on GPIOB, shared with the chips
+ *  - CLK, or R/#C, on PC5. Chips see LPC clocks on its rising edge.
+ *  - #LFRAME, or #WE, on PD2
+ *  - #OE on PA5, #RST on PA6 and MODE on PA4
+ *  - A[10:0] on PE[5:0], PC4/6/7 and PD3/6
+ *
+ * LAD is sampled by the chips on the rising edge of CLK, before they change
+ * what they drive. The same value is what gpio_read() returns afterwards.
+ */
+
+#include "sim.h"
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/lm4f/gpio.h>
+
+#include <string.h>
+
+#define SIM_NUM_PORTS	6
+
+#define PIN_CLK		GPIO5	/* GPIOC */
+#define PIN_LFRAME	GPIO2	/* GPIOD */
+#define PIN_MODE	GPIO4	/* GPIOA */
+#define PIN_OE		GPIO5	/* GPIOA */
+#define PIN_RST		GPIO6	/* GPIOA */
+
+struct sim_port {
+	uint8_t out;
+	volatile uint32_t dir;
+};
+
+static struct sim_port ports[SIM_NUM_PORTS];
+static struct sim_stats stats;
+static uint64_t now_ns;
+static bool irq_masked;
+/* Clocks #LFRAME has been low for. Aborts hold it for more than one. */
+static uint8_t lframe_clocks;
+
+static struct sim_clock *trace;
+static size_t trace_max, trace_len;
+
+/* What the pins of a port are at. Inputs are pulled up. */
+static uint8_t port_level(uint32_t port)
+{
+	const uint8_t dir = ports[port].dir;
+
+	return (ports[port].out & dir) | (uint8_t)~dir;
+}
+
+static bool in_reset(void)
+{
+	return !(port_level(GPIOA) & PIN_RST);
+}
+
+/* A[10:0], as aamux_pins.h spreads them over three ports */
+static uint16_t addr_pins(void)
+{
+	const uint8_t lo = port_level(GPIOE), mid = port_level(GPIOC);
+	const uint8_t hi = port_level(GPIOD);
+	uint16_t addr;
+
+	addr = lo & 0x3f;
+	addr |= mid & 0xc0;
+	addr |= (mid & GPIO4) << 4;
+	addr |= (hi & GPIO3) << 6;
+	addr |= (hi & GPIO6) << 4;
+	return addr;
+}
+
+/*
+ * What is on GPIOB. Chips and the host fight where they both drive, which is
+ * counted when the bus is sampled.
+ */
+static uint8_t bus_value(bool sample)
+{
+	const uint8_t host = ports[GPIOB].dir;
+	uint8_t val = 0xff, drive, mask, driven = 0, conflict = 0;
+	uint8_t socket;
+
+	val &= ports[GPIOB].out | (uint8_t)~host;
+	driven = host;
+	for (socket = 0; socket < SIM_MAX_CHIPS; socket++) {
+		mask = sim_chip_drive(socket, &drive);
+		conflict |= mask & driven & (val ^ drive);
+		val &= drive | (uint8_t)~mask;
+		driven |= mask;
+	}
+
+	if (sample && conflict)
+		stats.contention++;
+
+	return val;
+}
+
+static void clock_rise(void)
+{
+	const bool lframe = !(port_level(GPIOD) & PIN_LFRAME);
+	const uint8_t lad = bus_value(true) & 0x0f;
+	struct sim_clock *clk;
+	uint8_t socket;
+
+	stats.clocks++;
+	if (!lframe)
+		lframe_clocks = 0;
+	else if (++lframe_clocks == 2)
+		stats.aborts++;
+
+	if (trace && (trace_len < trace_max)) {
+		clk = &trace[trace_len++];
+		clk->lframe = lframe;
+		clk->host_drives = (ports[GPIOB].dir & 0x0f) ? true : false;
+		clk->lad = lad;
+		clk->irq_masked = irq_masked;
+	}
+
+	for (socket = 0; socket < SIM_MAX_CHIPS; socket++) {
+		sim_chip_clock(socket, lframe, lad);
+		sim_chip_aamux_latch(socket, true, addr_pins());
+	}
+}
+
+/* Pass the edges of a port which changed on to the chips */
+static void port_changed(uint32_t port, uint8_t old)
+{
+	const uint8_t now = port_level(port), rose = now & ~old;
+	const uint8_t fell = old & ~now;
+	uint8_t socket;
+
+	if ((port == GPIOA) && (rose & PIN_RST)) {
+		for (socket = 0; socket < SIM_MAX_CHIPS; socket++)
+			sim_chip_reset(socket, (now & PIN_MODE) ? true : false);
+	}
+	if (in_reset())
+		return;
+
+	for (socket = 0; socket < SIM_MAX_CHIPS; socket++) {
+		if ((port == GPIOA) && ((rose | fell) & PIN_OE))
+			sim_chip_aamux_oe(socket, (fell & PIN_OE) ? true : false);
+		if ((port == GPIOC) && (fell & PIN_CLK))
+			sim_chip_aamux_latch(socket, false, addr_pins());
+		if ((port == GPIOD) && (rose & PIN_LFRAME))
+			sim_chip_aamux_we(socket, bus_value(true));
+	}
+
+	if ((port == GPIOC) && (rose & PIN_CLK))
+		clock_rise();
+}
+
+static void port_store(uint32_t port, uint8_t gpios, uint8_t val)
+{
+	const uint8_t old = port_level(port);
+
+	stats.stores++;
+	now_ns += SIM_STORE_NS;
+	ports[port].out = (ports[port].out & ~gpios) | (val & gpios);
+	port_changed(port, old);
+}
+
+volatile uint32_t *sim_gpio_dir(uint32_t gpioport)
+{
+	stats.stores++;
+	now_ns += SIM_STORE_NS;
+	return &ports[gpioport].dir;
+}
+
+void gpio_mode_setup(uint32_t gpioport, enum gpio_mode mode,
+		     enum gpio_pullup pullup, uint8_t gpios)
+{
+	const uint8_t old = port_level(gpioport);
+
+	(void)pullup;
+
+	stats.stores++;
+	now_ns += SIM_STORE_NS;
+	if (mode == GPIO_MODE_OUTPUT)
+		ports[gpioport].dir |= gpios;
+	else
+		ports[gpioport].dir &= ~gpios;
+	port_changed(gpioport, old);
+}
+
+void gpio_set_output_config(uint32_t gpioport, enum gpio_output_type otype,
+			    enum gpio_drive_strength drive, uint8_t gpios)
+{
+	(void)gpioport;
+	(void)otype;
+	(void)drive;
+	(void)gpios;
+
+	stats.stores++;
+	now_ns += SIM_STORE_NS;
+}
+
+void gpio_set(uint32_t gpioport, uint8_t gpios)
+{
+	port_store(gpioport, gpios, 0xff);
+}
+
+void gpio_clear(uint32_t gpioport, uint8_t gpios)
+{
+	port_store(gpioport, gpios, 0);
+}
+
+void gpio_write(uint32_t gpioport, uint8_t gpios, uint8_t data)
+{
+	port_store(gpioport, gpios, data);
+}
+
+uint8_t gpio_read(uint32_t gpioport, uint8_t gpios)
+{
+	stats.loads++;
+	now_ns += SIM_LOAD_NS;
+
+	if (gpioport == GPIOB)
+		return bus_value(true) & gpios;
+
+	return port_level(gpioport) & gpios;
+}
+
+uint32_t cm_mask_interrupts(uint32_t mask)
+{
+	const uint32_t old = irq_masked;
+
+	irq_masked = mask ? true : false;
+	return old;
+}
+
+/**
+ * @brief Were interrupts masked by the code under test?
+ */
+bool sim_irq_masked(void)
+{
+	return irq_masked;
+}
+
+/**
+ * @brief Take out all chips, and start over from time zero
+ */
+void sim_reset(void)
+{
+	sim_chips_clear();
+	memset(ports, 0, sizeof(ports));
+	memset(&stats, 0, sizeof(stats));
+	now_ns = 0;
+	irq_masked = false;
+	lframe_clocks = 0;
+	trace = NULL;
+}
+
+/**
+ * @brief The counters so far, of the bus and of all chips
+ */
+void sim_get_stats(struct sim_stats *out)
+{
+	*out = stats;
+	out->time_ns = now_ns;
+	sim_chip_count(out);
+}
+
+/**
+ * @brief What happened between two calls of sim_get_stats()
+ */
+void sim_stats_sub(struct sim_stats *delta, const struct sim_stats *now,
+		   const struct sim_stats *before)
+{
+	delta->time_ns = now->time_ns - before->time_ns;
+	delta->clocks = now->clocks - before->clocks;
+	delta->stores = now->stores - before->stores;
+	delta->loads = now->loads - before->loads;
+	delta->frames = now->frames - before->frames;
+	delta->aborts = now->aborts - before->aborts;
+	delta->reads = now->reads - before->reads;
+	delta->writes = now->writes - before->writes;
+	delta->busy_reads = now->busy_reads - before->busy_reads;
+	delta->programs = now->programs - before->programs;
+	delta->erases = now->erases - before->erases;
+	delta->bad_programs = now->bad_programs - before->bad_programs;
+	delta->busy_writes = now->busy_writes - before->busy_writes;
+	delta->contention = now->contention - before->contention;
+}
+
+/**
+ * @brief Simulated time since sim_reset(), in nanoseconds
+ */
+uint64_t sim_time_ns(void)
+{
+	return now_ns;
+}
+
+/**
+ * @brief Let time pass without touching the bus
+ */
+void sim_advance(uint64_t ns)
+{
+	now_ns += ns;
+}
+
+/**
+ * @brief Record every LPC clock from now on
+ *
+ * @param[out] clocks Where to record them
+ * @param[in] max Clocks which fit; the ones after that are not recorded
+ */
+void sim_trace_start(struct sim_clock *clocks, size_t max)
+{
+	trace = clocks;
+	trace_max = max;
+	trace_len = 0;
+}
+
+/**
+ * @brief Stop recording clocks
+ *
+ * @return the number of clocks recorded
+ */
+size_t sim_trace_stop(void)
+{
+	trace = NULL;
+	return trace_len;
+}
@@ -0,0 +1,719 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file sim_chip.c LPC/FWH flash chips, one clock at a time
+ *
+ * Each socket holds a chip which follows LPC and FWH frames on the rising edge
+ * of CLK, the way the target side of the bus would:
+ *
+ *  - START, cycle type and the 32-bit address, or IDSEL, a 28-bit address and
+ *    MSIZE for FWH reads
+ *  - the data byte of a write, least significant nibble first
+ *  - two TAR clocks, then SYNC. An early SYNC is already driven on the second
+ *    TAR clock. Otherwise the chip drives wait SYNCs for as many clocks as it
+ *    is configured to.
+ *  - the data of a read, then TAR back to the host
+ *
+ * #LFRAME low starts a new frame at any point. Any value of LAD other than a
+ * START drops the frame, which is how aborts work.
+ *
+ * A chip only answers addresses it decodes. In LPC mode, that is the top
+ * 64 MiB, with A[25:22] the inverse of its ID straps, and in FWH mode, IDSEL
+ * equal to the straps. Socket n has its straps tied to n.
+ *
+ * Behind the bus interface is the JEDEC command set: unlock cycles, ID and CFI
+ * read modes, byte program, and sector, block and chip erase. Programs and
+ * erases take the time they are configured to. Until then, reads return the
+ * complement of the data in DQ7, and DQ6 toggles.
+ */
+
+#include "sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Where a frame is, as of the last rising edge of CLK */
+enum frame_state {
+	FRAME_IDLE = 0,
+	FRAME_TYPE,
+	FRAME_ADDR,
+	FRAME_FWH_IDSEL,
+	FRAME_FWH_ADDR,
+	FRAME_FWH_MSIZE,
+	FRAME_WDATA,
+	FRAME_TAR0,
+	FRAME_TAR1,
+	FRAME_SYNC,
+	FRAME_RDATA,
+	FRAME_TAR_HOST0,
+	FRAME_TAR_HOST1,
+};
+
+/* Where a JEDEC command sequence is */
+enum cmd_state {
+	CMD_IDLE = 0,
+	CMD_UNLOCK1,
+	CMD_UNLOCK2,
+	CMD_PROGRAM,
+	CMD_ERASE,
+	CMD_ERASE_UNLOCK1,
+	CMD_ERASE_UNLOCK2,
+};
+
+enum read_mode {
+	READ_ARRAY = 0,
+	READ_ID,
+	READ_CFI,
+};
+
+enum chip_op {
+	OP_PROGRAM = 0,
+	OP_ERASE,
+};
+
+#define FWH_MAX_BURST	128
+#define CFI_SIZE	0x40
+
+struct sim_chip {
+	bool present;
+	struct sim_chip_config cfg;
+	uint8_t *mem;
+	/* Reset into A/A-Mux mode, or out of the way of the chip which is */
+	bool aamux;
+	bool offline;
+
+	/* LPC and FWH frames */
+	enum frame_state frame;
+	bool fwh;
+	bool write;
+	bool selected;
+	uint16_t count;
+	uint32_t addr;
+	uint8_t idsel;
+	uint8_t wdata;
+	uint16_t len;
+	uint16_t waits;
+	uint8_t rdata[FWH_MAX_BURST];
+
+	/* What the chip puts on the bus */
+	bool driving;
+	uint8_t drive;
+
+	/* A/A-Mux */
+	uint32_t aa_addr;
+
+	/* JEDEC */
+	enum cmd_state cmd;
+	enum read_mode mode;
+	bool busy;
+	uint64_t busy_until;
+	enum chip_op op;
+	uint32_t op_addr;
+	uint32_t op_len;
+	uint8_t op_data;
+	uint8_t toggle;
+	uint8_t cfi[CFI_SIZE];
+};
+
+static struct sim_chip chips[SIM_MAX_CHIPS];
+static struct sim_stats chip_stats;
+
+/**
+ * @brief SST49LF040: 512 KiB, 4 KiB sectors, 64 KiB blocks, no CFI
+ */
+const struct sim_chip_config sim_sst49lf040 = {
+	.vendor_id = 0xbf,
+	.device_id = 0x51,
+	.size = 512 * 1024,
+	.sector_size = 4 * 1024,
+	.block_size = 64 * 1024,
+	.cmd_mask = 0x7fff,
+	.program_us = 14,
+	.sector_erase_us = 18000,
+	.block_erase_us = 18000,
+	.chip_erase_us = 70000,
+	.fwh_msizes = 0,
+	.cfi = false,
+	.early_sync = false,
+	.sync = SIM_SYNC_SHORT_WAIT,
+	.sync_waits = 0,
+};
+
+/**
+ * @brief A 1 MiB FWH part which is not in the chip database
+ *
+ * It is set up from its CFI table, and answers FWH reads of 1, 2, 4, 16 and
+ * 128 bytes.
+ */
+const struct sim_chip_config sim_fwh_cfi = {
+	.vendor_id = 0xda,
+	.device_id = 0x3d,
+	.size = 1024 * 1024,
+	.sector_size = 4 * 1024,
+	.block_size = 64 * 1024,
+	.cmd_mask = 0x7fff,
+	.program_us = 20,
+	.sector_erase_us = 25000,
+	.block_erase_us = 25000,
+	.chip_erase_us = 100000,
+	.fwh_msizes = SIM_FWH_MSIZE(0) | SIM_FWH_MSIZE(1) | SIM_FWH_MSIZE(2) |
+		      SIM_FWH_MSIZE(4) | SIM_FWH_MSIZE(7),
+	.cfi = true,
+	.early_sync = false,
+	.sync = SIM_SYNC_SHORT_WAIT,
+	.sync_waits = 0,
+};
+
+/* Smallest n with 2^n >= val */
+static uint8_t log2_ceil(uint32_t val)
+{
+	uint8_t n = 0;
+
+	while ((1UL << n) < val)
+		n++;
+	return n;
+}
+
+static void cfi_region(uint8_t *reg, uint32_t count, uint32_t size)
+{
+	reg[0] = (count - 1) & 0xff;
+	reg[1] = (count - 1) >> 8;
+	reg[2] = (size / 256) & 0xff;
+	reg[3] = (size / 256) >> 8;
+}
+
+/* The CFI query table, as described in the config */
+static void cfi_build(struct sim_chip *c)
+{
+	const struct sim_chip_config *cfg = &c->cfg;
+	uint8_t *cfi = c->cfi;
+
+	memset(cfi, 0, CFI_SIZE);
+	memcpy(cfi + 0x10, "QRY", 3);
+	cfi[0x1f] = log2_ceil(cfg->program_us);
+	cfi[0x21] = log2_ceil(cfg->sector_erase_us / 1000);
+	cfi[0x22] = log2_ceil(cfg->chip_erase_us / 1000);
+	/* Maximum times are 16 times the typical ones */
+	cfi[0x23] = 4;
+	cfi[0x25] = 4;
+	cfi[0x26] = 4;
+	cfi[0x27] = log2_ceil(cfg->size);
+	cfi[0x2c] = 1;
+	cfi_region(cfi + 0x2d, cfg->size / cfg->sector_size, cfg->sector_size);
+	if (cfg->block_size) {
+		cfi[0x2c] = 2;
+		cfi_region(cfi + 0x31, cfg->size / cfg->block_size,
+			   cfg->block_size);
+	}
+}
+
+/* Finish the operation in progress, if its time is up */
+static void chip_update(struct sim_chip *c)
+{
+	uint32_t i;
+
+	if (!c->busy || (sim_time_ns() < c->busy_until))
+		return;
+
+	c->busy = false;
+	if (c->op == OP_ERASE) {
+		memset(c->mem + c->op_addr, 0xff, c->op_len);
+		return;
+	}
+
+	/* Programming can only clear bits */
+	i = c->op_addr;
+	if (c->op_data & ~c->mem[i])
+		chip_stats.bad_programs++;
+	c->mem[i] &= c->op_data;
+}
+
+static void chip_start_op(struct sim_chip *c, enum chip_op op, uint32_t addr,
+			  uint32_t len, uint8_t data, uint32_t us)
+{
+	c->busy = true;
+	c->busy_until = sim_time_ns() + (uint64_t)us * 1000;
+	c->op = op;
+	c->op_addr = addr;
+	c->op_len = len;
+	c->op_data = data;
+	if (op == OP_PROGRAM)
+		chip_stats.programs++;
+	else
+		chip_stats.erases++;
+}
+
+static void chip_erase(struct sim_chip *c, uint32_t off, uint32_t size,
+		       uint32_t us)
+{
+	/* A chip without units of this size ignores the command */
+	if (!size)
+		return;
+
+	off &= ~(size - 1);
+	/* Erasing leaves 0xff, which is what DQ7 polling expects */
+	chip_start_op(c, OP_ERASE, off, size, 0xff, us);
+}
+
+static uint8_t chip_read(struct sim_chip *c, uint32_t off)
+{
+	chip_update(c);
+
+	if (c->busy) {
+		chip_stats.busy_reads++;
+		c->toggle ^= 0x40;
+		return (~c->op_data & 0x80) | c->toggle;
+	}
+
+	switch (c->mode) {
+	case READ_ID:
+		return (off & 1) ? c->cfg.device_id : c->cfg.vendor_id;
+	case READ_CFI:
+		off &= 0xff;
+		return (off < CFI_SIZE) ? c->cfi[off] : 0;
+	default:
+		return c->mem[off];
+	}
+}
+
+static void chip_write(struct sim_chip *c, uint32_t off, uint8_t data)
+{
+	const struct sim_chip_config *cfg = &c->cfg;
+	const uint32_t cmd_off = off & cfg->cmd_mask;
+	const enum cmd_state state = c->cmd;
+
+	chip_update(c);
+
+	if (c->busy) {
+		chip_stats.busy_writes++;
+		return;
+	}
+
+	c->cmd = CMD_IDLE;
+	if (state == CMD_PROGRAM) {
+		chip_start_op(c, OP_PROGRAM, off, 1, data, cfg->program_us);
+		return;
+	}
+
+	if (data == 0xf0) {
+		c->mode = READ_ARRAY;
+		return;
+	}
+
+	/* The single cycle CFI query */
+	if ((state == CMD_IDLE) && (data == 0x98) && cfg->cfi &&
+	    ((off & 0xff) == 0x55)) {
+		c->mode = READ_CFI;
+		return;
+	}
+
+	/* A first unlock cycle always starts the sequence over */
+	if ((data == 0xaa) && (cmd_off == 0x5555)) {
+		c->cmd = (state == CMD_ERASE) ? CMD_ERASE_UNLOCK1 : CMD_UNLOCK1;
+		return;
+	}
+
+	switch (state) {
+	case CMD_UNLOCK1:
+		if ((data == 0x55) && (cmd_off == 0x2aaa))
+			c->cmd = CMD_UNLOCK2;
+		break;
+	case CMD_ERASE_UNLOCK1:
+		if ((data == 0x55) && (cmd_off == 0x2aaa))
+			c->cmd = CMD_ERASE_UNLOCK2;
+		break;
+	case CMD_UNLOCK2:
+		if (cmd_off != 0x5555)
+			break;
+		if (data == 0x90)
+			c->mode = READ_ID;
+		else if ((data == 0x98) && cfg->cfi)
+			c->mode = READ_CFI;
+		else if (data == 0xa0)
+			c->cmd = CMD_PROGRAM;
+		else if (data == 0x80)
+			c->cmd = CMD_ERASE;
+		break;
+	case CMD_ERASE_UNLOCK2:
+		if ((data == 0x10) && (cmd_off == 0x5555))
+			chip_erase(c, 0, cfg->size, cfg->chip_erase_us);
+		else if (data == 0x30)
+			chip_erase(c, off, cfg->sector_size,
+				   cfg->sector_erase_us);
+		else if (data == 0x50)
+			chip_erase(c, off, cfg->block_size,
+				   cfg->block_erase_us);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Does an LPC memory cycle to this address reach the chip? */
+static bool lpc_decodes(uint8_t socket, uint32_t addr)
+{
+	return ((addr >> 26) == 0x3f) &&
+	       (((addr >> 22) & 0xf) == (~socket & 0xf));
+}
+
+static uint16_t fwh_len(uint8_t msize)
+{
+	switch (msize) {
+	case 0:
+		return 1;
+	case 1:
+		return 2;
+	case 2:
+		return 4;
+	case 4:
+		return 16;
+	case 7:
+		return 128;
+	default:
+		return 0;
+	}
+}
+
+/* Once SYNC says ready, the chip has done the memory side of the frame */
+static void frame_access(struct sim_chip *c)
+{
+	const uint32_t mask = c->cfg.size - 1;
+	uint32_t off;
+	uint16_t i;
+
+	chip_stats.frames++;
+	if (c->write) {
+		chip_stats.writes++;
+		chip_write(c, c->addr & mask, c->wdata);
+		return;
+	}
+
+	/* Bursts wrap around within their own, aligned, size */
+	off = c->addr & mask & ~(uint32_t)(c->len - 1);
+	for (i = 0; i < c->len; i++)
+		c->rdata[i] = chip_read(c, off + i);
+	chip_stats.reads += c->len;
+}
+
+static void frame_drive(struct sim_chip *c, uint8_t nibble)
+{
+	c->driving = true;
+	c->drive = nibble & 0xf;
+}
+
+/* What comes after SYNC */
+static void frame_ready(struct sim_chip *c)
+{
+	frame_access(c);
+	frame_drive(c, 0);
+	c->count = 0;
+	c->frame = c->write ? FRAME_TAR_HOST0 : FRAME_RDATA;
+}
+
+/**
+ * @brief A rising edge of CLK
+ *
+ * @param[in] socket Socket of the chip
+ * @param[in] lframe #LFRAME is asserted
+ * @param[in] lad What is on LAD[3:0]
+ */
+void sim_chip_clock(uint8_t socket, bool lframe, uint8_t lad)
+{
+	struct sim_chip *c = &chips[socket];
+	const struct sim_chip_config *cfg = &c->cfg;
+
+	if (!c->present || c->aamux || c->offline)
+		return;
+
+	if (lframe) {
+		c->driving = false;
+		c->fwh = (lad == 0xd);
+		if (lad == 0x0)
+			c->frame = FRAME_TYPE;
+		else if (lad == 0xd)
+			c->frame = FRAME_FWH_IDSEL;
+		else
+			c->frame = FRAME_IDLE;
+		return;
+	}
+
+	switch (c->frame) {
+	case FRAME_TYPE:
+		c->frame = FRAME_ADDR;
+		c->count = 0;
+		c->addr = 0;
+		c->len = 1;
+		if (lad == 0x4)
+			c->write = false;
+		else if (lad == 0x6)
+			c->write = true;
+		else
+			c->frame = FRAME_IDLE;
+		break;
+	case FRAME_ADDR:
+		c->addr = (c->addr << 4) | lad;
+		if (++c->count < 8)
+			break;
+		c->selected = lpc_decodes(socket, c->addr);
+		c->count = 0;
+		c->frame = c->write ? FRAME_WDATA : FRAME_TAR0;
+		break;
+	case FRAME_FWH_IDSEL:
+		c->idsel = lad;
+		c->write = false;
+		c->count = 0;
+		c->addr = 0;
+		c->frame = FRAME_FWH_ADDR;
+		break;
+	case FRAME_FWH_ADDR:
+		c->addr = (c->addr << 4) | lad;
+		if (++c->count == 7)
+			c->frame = FRAME_FWH_MSIZE;
+		break;
+	case FRAME_FWH_MSIZE:
+		c->len = fwh_len(lad);
+		c->selected = (c->idsel == socket) && c->len &&
+			      (cfg->fwh_msizes & SIM_FWH_MSIZE(lad));
+		c->frame = FRAME_TAR0;
+		break;
+	case FRAME_WDATA:
+		if (c->count++ == 0) {
+			c->wdata = lad;
+			break;
+		}
+		c->wdata |= lad << 4;
+		c->frame = FRAME_TAR0;
+		break;
+	case FRAME_TAR0:
+		c->frame = FRAME_TAR1;
+		break;
+	case FRAME_TAR1:
+		if (!c->selected) {
+			c->frame = FRAME_IDLE;
+			break;
+		}
+		c->waits = 0;
+		if (cfg->early_sync) {
+			frame_ready(c);
+			break;
+		}
+		frame_drive(c, 0xf);
+		c->frame = FRAME_SYNC;
+		break;
+	case FRAME_SYNC:
+		if (c->waits < cfg->sync_waits) {
+			c->waits++;
+			frame_drive(c, cfg->sync);
+			break;
+		}
+		frame_ready(c);
+		break;
+	case FRAME_RDATA:
+		frame_drive(c, c->rdata[c->count / 2] >> ((c->count & 1) * 4));
+		if (++c->count == 2 * c->len)
+			c->frame = FRAME_TAR_HOST0;
+		break;
+	case FRAME_TAR_HOST0:
+		frame_drive(c, 0xf);
+		c->frame = FRAME_TAR_HOST1;
+		break;
+	case FRAME_TAR_HOST1:
+		c->driving = false;
+		c->frame = FRAME_IDLE;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief What the chip drives on GPIOB
+ *
+ * @param[in] socket Socket of the chip
+ * @param[out] val Value driven on the bits in the mask
+ *
+ * @return the bits the chip drives
+ */
+uint8_t sim_chip_drive(uint8_t socket, uint8_t *val)
+{
+	const struct sim_chip *c = &chips[socket];
+
+	*val = c->drive;
+	if (!c->present || !c->driving)
+		return 0;
+
+	return c->aamux ? 0xff : 0x0f;
+}
+
+/**
+ * @brief #RST went high. MODE decides between LPC and A/A-Mux.
+ *
+ * A/A-Mux has no ID decoding, so only the chip in socket 0 takes part in it.
+ * The others stay off the bus until they are reset into LPC mode again.
+ */
+void sim_chip_reset(uint8_t socket, bool aamux)
+{
+	struct sim_chip *c = &chips[socket];
+
+	if (!c->present)
+		return;
+
+	/* An operation in progress is cut short, and leaves what it did */
+	chip_update(c);
+	c->busy = false;
+
+	c->aamux = aamux && (socket == 0);
+	c->offline = aamux && (socket != 0);
+	c->frame = FRAME_IDLE;
+	c->driving = false;
+	c->cmd = CMD_IDLE;
+	c->mode = READ_ARRAY;
+	c->aa_addr = 0;
+}
+
+/**
+ * @brief An edge of R/#C: the row on the falling edge, the column on the rising
+ */
+void sim_chip_aamux_latch(uint8_t socket, bool column, uint16_t addr)
+{
+	struct sim_chip *c = &chips[socket];
+
+	if (!c->present || !c->aamux)
+		return;
+
+	addr &= 0x7ff;
+	if (column)
+		c->aa_addr = (c->aa_addr & 0x7ff) | ((uint32_t)addr << 11);
+	else
+		c->aa_addr = addr;
+}
+
+/**
+ * @brief #OE changed. The chip drives DQ[7:0] for as long as it is low.
+ */
+void sim_chip_aamux_oe(uint8_t socket, bool asserted)
+{
+	struct sim_chip *c = &chips[socket];
+
+	if (!c->present || !c->aamux)
+		return;
+
+	c->driving = asserted;
+	if (!asserted)
+		return;
+
+	c->drive = chip_read(c, c->aa_addr & (c->cfg.size - 1));
+	chip_stats.reads++;
+}
+
+/**
+ * @brief Rising edge of #WE, which latches DQ[7:0]
+ */
+void sim_chip_aamux_we(uint8_t socket, uint8_t data)
+{
+	struct sim_chip *c = &chips[socket];
+
+	if (!c->present || !c->aamux)
+		return;
+
+	chip_stats.writes++;
+	chip_write(c, c->aa_addr & (c->cfg.size - 1), data);
+}
+
+/**
+ * @brief Put a chip in a socket
+ *
+ * The chip starts out erased, in LPC mode. The size must be a power of two,
+ * and so must the sector and block sizes, unless zero.
+ */
+qiprog_err sim_add_chip(uint8_t socket, const struct sim_chip_config *cfg)
+{
+	struct sim_chip *c;
+
+	if ((socket >= SIM_MAX_CHIPS) || !cfg->size ||
+	    (cfg->size & (cfg->size - 1)) || !cfg->sector_size ||
+	    (cfg->sector_size & (cfg->sector_size - 1)) ||
+	    (cfg->block_size & (cfg->block_size - 1)))
+		return QIPROG_ERR_ARG;
+
+	c = &chips[socket];
+	free(c->mem);
+	memset(c, 0, sizeof(*c));
+	c->mem = malloc(cfg->size);
+	if (!c->mem)
+		return QIPROG_ERR_MALLOC;
+
+	memset(c->mem, 0xff, cfg->size);
+	c->cfg = *cfg;
+	cfi_build(c);
+	c->present = true;
+	return QIPROG_SUCCESS;
+}
+
+/**
+ * @brief Is there a chip in the socket?
+ */
+bool sim_chip_present(uint8_t socket)
+{
+	return (socket < SIM_MAX_CHIPS) && chips[socket].present;
+}
+
+/**
+ * @brief The memory array of a chip, with any finished operation applied
+ */
+uint8_t *sim_chip_mem(uint8_t socket)
+{
+	struct sim_chip *c = &chips[socket];
+
+	if (!sim_chip_present(socket))
+		return NULL;
+
+	chip_update(c);
+	return c->mem;
+}
+
+/**
+ * @brief Fill in what the chips counted
+ */
+void sim_chip_count(struct sim_stats *stats)
+{
+	stats->frames = chip_stats.frames;
+	stats->reads = chip_stats.reads;
+	stats->writes = chip_stats.writes;
+	stats->busy_reads = chip_stats.busy_reads;
+	stats->programs = chip_stats.programs;
+	stats->erases = chip_stats.erases;
+	stats->bad_programs = chip_stats.bad_programs;
+	stats->busy_writes = chip_stats.busy_writes;
+}
+
+/**
+ * @brief Take out all chips
+ */
+void sim_chips_clear(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < SIM_MAX_CHIPS; i++) {
+		free(chips[i].mem);
+		memset(&chips[i], 0, sizeof(chips[i]));
+	}
+	memset(&chip_stats, 0, sizeof(chip_stats));
+}
@@ -0,0 +1,165 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The host side of the benchmark in bench.c. The board counts cycles, which we
+ * can't. What we can count exactly are GPIO register stores and loads, and LPC
+ * clocks, per byte of the same operations. They are printed as JSON, which
+ * tools/bench.py --sim compares against a baseline.
+ */
+
+#include "sim.h"
+#include "lpc_io.h"
+#include "stellaris.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static struct qiprog_device *const dev = &stellaris_lpc_dev;
+
+/* Where socket 0 decodes in LPC mode */
+#define CHIP_BASE	0xffc00000
+
+#define PRIMITIVE_BYTES	256
+#define RANGE_BYTES	4096
+
+static uint8_t buf[RANGE_BYTES];
+static bool failed = false;
+
+static void setup(const struct sim_chip_config *cfg)
+{
+	struct qiprog_chip_id ids[9];
+
+	sim_reset();
+	sim_add_chip(0, cfg);
+	dev->drv->dev_open(dev);
+	dev->drv->read_chip_id(dev, ids);
+}
+
+/* Print one metric, from the counters before and after it ran */
+static void metric(const char *name, uint32_t bytes,
+		   const struct sim_stats *before, qiprog_err ret, bool last)
+{
+	struct sim_stats now, d;
+
+	sim_get_stats(&now);
+	sim_stats_sub(&d, &now, before);
+
+	if (ret != QIPROG_SUCCESS) {
+		fprintf(stderr, "%s failed with %d\n", name, ret);
+		failed = true;
+	}
+
+	printf("    \"%s\": {\n", name);
+	printf("      \"bytes\": %u,\n", bytes);
+	printf("      \"stores\": %llu,\n", (unsigned long long)d.stores);
+	printf("      \"loads\": %llu,\n", (unsigned long long)d.loads);
+	printf("      \"clocks\": %llu,\n", (unsigned long long)d.clocks);
+	printf("      \"stores_per_byte\": %.2f,\n", (double)d.stores / bytes);
+	printf("      \"loads_per_byte\": %.2f,\n", (double)d.loads / bytes);
+	printf("      \"clocks_per_byte\": %.2f\n", (double)d.clocks / bytes);
+	printf("    }%s\n", last ? "" : ",");
+}
+
+static qiprog_err bench_mread(void)
+{
+	qiprog_err ret = 0;
+	uint32_t i;
+
+	for (i = 0; i < PRIMITIVE_BYTES; i++)
+		ret |= lpc_mread(CHIP_BASE + i, buf + i);
+
+	return ret;
+}
+
+/* The reset command, which leaves the chip alone, like bench.c does */
+static qiprog_err bench_mwrite(void)
+{
+	qiprog_err ret = 0;
+	uint32_t i;
+
+	for (i = 0; i < PRIMITIVE_BYTES; i++)
+		ret |= lpc_mwrite(CHIP_BASE + 0x5555, 0xf0);
+
+	return ret;
+}
+
+static qiprog_err bench_read(uint32_t start)
+{
+	dev->drv->set_address(dev, start, start + RANGE_BYTES);
+	return dev->drv->read(dev, start, buf, RANGE_BYTES);
+}
+
+/* Program erased flash, a USB packet at a time, until the chip is done */
+static qiprog_err bench_write(uint32_t start)
+{
+	qiprog_err ret = 0;
+	uint32_t i;
+
+	for (i = 0; i < RANGE_BYTES; i++)
+		buf[i] = i ^ (i >> 8);
+
+	dev->drv->set_address(dev, start, start + RANGE_BYTES);
+	for (i = 0; i < RANGE_BYTES; i += 64) {
+		ret |= dev->drv->write(dev, dev->addr.pwrite, buf + i, 64);
+		sim_main_loop_pass();
+	}
+
+	return ret | sim_run_jobs();
+}
+
+int main(void)
+{
+	struct sim_stats before;
+	qiprog_err ret;
+
+	printf("{\n");
+	printf("  \"store_ns\": %u,\n", SIM_STORE_NS);
+	printf("  \"load_ns\": %u,\n", SIM_LOAD_NS);
+	printf("  \"metrics\": {\n");
+
+	setup(&sim_sst49lf040);
+	sim_get_stats(&before);
+	ret = bench_mread();
+	metric("lpc_mread", PRIMITIVE_BYTES, &before, ret, false);
+
+	sim_get_stats(&before);
+	ret = bench_mwrite();
+	metric("lpc_mwrite", PRIMITIVE_BYTES, &before, ret, false);
+
+	sim_get_stats(&before);
+	ret = bench_read(0x10000);
+	metric("read", RANGE_BYTES, &before, ret, false);
+
+	sim_get_stats(&before);
+	ret = bench_write(0x20000);
+	metric("write", RANGE_BYTES, &before, ret, false);
+
+	/* The same read, with FWH bursts */
+	setup(&sim_fwh_cfi);
+	bench_read(0x10000);
+	sim_get_stats(&before);
+	ret = bench_read(0x10000);
+	metric("read_fwh", RANGE_BYTES, &before, ret, true);
+
+	printf("  }\n");
+	printf("}\n");
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * What QiProg operations cost on the simulated bus: LPC clocks, GPIO register
+ * accesses, polls of a busy chip, and simulated time. The numbers only change
+ * when the driver does, so they can be compared from one build to the next,
+ * without a board.
+ */
+
+#include "sim.h"
+#include "stellaris.h"
+
+#include <jedec_flash.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static struct qiprog_device *const dev = &stellaris_lpc_dev;
+static uint8_t buf[4096];
+
+struct measure {
+	const char *name;
+	uint32_t bytes;
+	struct sim_stats start;
+};
+
+static void setup(const struct sim_chip_config *cfg)
+{
+	struct qiprog_chip_id ids[9];
+
+	sim_reset();
+	sim_add_chip(0, cfg);
+	dev->drv->dev_open(dev);
+	dev->drv->read_chip_id(dev, ids);
+}
+
+static void begin(struct measure *m, const char *name, uint32_t bytes)
+{
+	m->name = name;
+	m->bytes = bytes;
+	jedec_reset_poll_stats();
+	sim_get_stats(&m->start);
+}
+
+static void end(struct measure *m, qiprog_err ret)
+{
+	struct sim_stats now, d;
+	struct jedec_poll_stats ps;
+	uint32_t polls = 0;
+	int op;
+
+	sim_get_stats(&now);
+	sim_stats_sub(&d, &now, &m->start);
+	for (op = 0; op < JEDEC_NUM_OPS; op++) {
+		jedec_get_poll_stats(op, &ps);
+		polls += ps.polls;
+	}
+
+	printf("%-24s %6u %9llu %9llu %7u %7u %11.1f%s\n", m->name, m->bytes,
+	       (unsigned long long)d.clocks, (unsigned long long)d.stores,
+	       polls, d.busy_reads, d.time_ns / 1000.0,
+	       (ret == QIPROG_SUCCESS) ? "" : "  FAILED");
+}
+
+static qiprog_err read_range(uint32_t start, uint32_t len)
+{
+	dev->drv->set_address(dev, start, start + len);
+	return dev->drv->read(dev, start, buf, len);
+}
+
+static qiprog_err write_range(uint32_t start, uint32_t len)
+{
+	qiprog_err ret = 0;
+	uint32_t i;
+
+	memset(buf, 0x5a, len);
+	dev->drv->set_address(dev, start, start + len);
+	for (i = 0; i < len; i += 64) {
+		ret |= dev->drv->write(dev, dev->addr.pwrite, buf + i, 64);
+		sim_main_loop_pass();
+	}
+
+	return ret | sim_run_jobs();
+}
+
+static qiprog_err erase_range(uint32_t start, uint32_t end)
+{
+	qiprog_err ret;
+
+	ret = stellaris_erase_async(start, end);
+	return ret | sim_run_jobs();
+}
+
+/* The same operations, on one kind of chip, with one bus engine */
+static void report_chip(const char *name, const struct sim_chip_config *cfg,
+			enum qiprog_bus bus)
+{
+	struct qiprog_chip_id ids[9];
+	struct measure m;
+	qiprog_err ret;
+
+	printf("\n%s\n", name);
+	printf("%-24s %6s %9s %9s %7s %7s %11s\n", "operation", "bytes",
+	       "clocks", "stores", "polls", "busy", "time (us)");
+
+	sim_reset();
+	sim_add_chip(0, cfg);
+	dev->drv->set_bus(dev, bus);
+	sim_main_loop_pass();
+	dev->drv->dev_open(dev);
+	begin(&m, "probe", 0);
+	ret = dev->drv->read_chip_id(dev, ids);
+	end(&m, ret);
+
+	begin(&m, "read 4 KiB", sizeof(buf));
+	end(&m, read_range(0x10000, sizeof(buf)));
+
+	begin(&m, "program 256 bytes", 256);
+	end(&m, write_range(0x20000, 256));
+
+	begin(&m, "program 4 KiB", sizeof(buf));
+	end(&m, write_range(0x21000, sizeof(buf)));
+
+	setup(cfg);
+	begin(&m, "sector erase", cfg->sector_size);
+	end(&m, erase_range(0x30000, 0x30000 + cfg->sector_size));
+
+	begin(&m, "block erase", cfg->block_size);
+	end(&m, erase_range(0x40000, 0x40000 + cfg->block_size));
+
+	begin(&m, "chip erase", cfg->size);
+	end(&m, erase_range(0, cfg->size));
+}
+
+int main(void)
+{
+	printf("Simulated bus: %u ns per GPIO store, %u ns per load, "
+	       "%u ns per timebase read\n", SIM_STORE_NS, SIM_LOAD_NS,
+	       SIM_POLL_NS);
+
+	report_chip("SST49LF040 (LPC, DQ7 polling, from the chip database)",
+		    &sim_sst49lf040, QIPROG_BUS_LPC | QIPROG_BUS_FWH);
+	report_chip("SST49LF040 (A/A-Mux, R/#C counted as clocks)",
+		    &sim_sst49lf040, QIPROG_BUS_ISA);
+	report_chip("1 MiB FWH part (FWH bursts, toggle polling, from CFI)",
+		    &sim_fwh_cfi, QIPROG_BUS_LPC | QIPROG_BUS_FWH);
+
+	return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Just enough to write host tests with. A failed check is reported, and the
+ * test carries on, so one run shows everything which is broken. The test
+ * returns test_result() from main().
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static unsigned int test_checks, test_failures;
+
+#define CHECK(cond)							\
+	do {								\
+		test_checks++;						\
+		if (!(cond)) {						\
+			test_failures++;				\
+			printf("%s:%d: check failed: %s\n",		\
+			       __FILE__, __LINE__, #cond);		\
+		}							\
+	} while (0)
+
+/* Compare two integers, and show both if they differ */
+#define CHECK_EQ(a, b)							\
+	do {								\
+		const unsigned long long test_a = (a), test_b = (b);	\
+		test_checks++;						\
+		if (test_a != test_b) {					\
+			test_failures++;				\
+			printf("%s:%d: %s == %s failed: 0x%llx != 0x%llx\n", \
+			       __FILE__, __LINE__, #a, #b, test_a, test_b); \
+		}							\
+	} while (0)
+
+static inline int test_result(const char *name)
+{
+	printf("%s: %u checks, %u failed\n", name, test_checks,
+	       test_failures);
+	return test_failures ? 1 : 0;
+}
+
+#endif				/* TEST_H */
@@ -0,0 +1,108 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The chip database: the table stays sorted, so the binary search finds every
+ * part and nothing else, and the entries agree with themselves.
+ *
+ * The table is static, so the source is included rather than linked.
+ */
+
+#include "test.h"
+
+#include "../src/chip_db.c"
+
+#include <string.h>
+
+#define NUM_PARTS	(sizeof(chip_db) / sizeof(chip_db[0]))
+
+static void test_sorted(void)
+{
+	size_t i;
+
+	for (i = 1; i < NUM_PARTS; i++) {
+		if (chip_db_cmp(&chip_db[i - 1], &chip_db[i]) >= 0)
+			printf("%s is out of order\n", chip_db[i].name);
+		CHECK(chip_db_cmp(&chip_db[i - 1], &chip_db[i]) < 0);
+	}
+}
+
+static void test_find(void)
+{
+	static const uint16_t misses[][2] = {
+		{0x00, 0x00},
+		{0x9d, 0x6c},	/* Below the first part */
+		{0xda, 0xd4},	/* Above the last part */
+		{0xbf, 0x53},	/* Between two parts of a vendor */
+		{0xc2, 0x51},	/* Between two vendors */
+		{0x51, 0xbf},	/* Vendor and device swapped */
+		{0xffff, 0xffff},
+	};
+	const struct chip_profile *p;
+	size_t i;
+
+	/* Every part, and at the right entry */
+	for (i = 0; i < NUM_PARTS; i++) {
+		p = chip_db_find(chip_db[i].vendor_id, chip_db[i].device_id);
+		CHECK(p == &chip_db[i]);
+	}
+
+	for (i = 0; i < sizeof(misses) / sizeof(misses[0]); i++)
+		CHECK(chip_db_find(misses[i][0], misses[i][1]) == NULL);
+
+	/* What the simulated SST49LF040 is modelled on */
+	p = chip_db_find(0xbf, 0x51);
+	CHECK(p && !strcmp(p->name, "SST49LF040"));
+	CHECK(p && (p->size == KiB(512)));
+	CHECK(p && (p->poll_method == JEDEC_POLL_DQ7));
+	CHECK(p && (p->chip_erase_buses == AAMUX));
+}
+
+/* Entries which could not be right for any part */
+static void test_entries(void)
+{
+	const struct chip_profile *p;
+	size_t i;
+	int op;
+
+	for (i = 0; i < NUM_PARTS; i++) {
+		p = &chip_db[i];
+
+		CHECK(p->name && p->size);
+		CHECK(p->sector_size && !(p->size % p->sector_size));
+		CHECK(!p->block_size || !(p->size % p->block_size));
+		CHECK(!p->block_size || (p->block_size > p->sector_size));
+		CHECK(p->buses && !(p->buses & ~(LPC | FWH | AAMUX)));
+		CHECK(!(p->chip_erase_buses & ~p->buses));
+		CHECK(!p->fwh_burst || (p->buses & FWH));
+		CHECK((p->lock_type == CHIP_LOCK_NONE) == !p->lock_size);
+		for (op = 0; op < JEDEC_NUM_OPS; op++)
+			CHECK(p->timing[op].typ_us <= p->timing[op].max_us);
+		CHECK(p->timing[JEDEC_OP_PROGRAM].max_us);
+	}
+}
+
+int main(void)
+{
+	test_sorted();
+	test_find();
+	test_entries();
+
+	return test_result("test_chip_db");
+}
@@ -0,0 +1,363 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Custom command scripts: what is refused when a script is loaded, what the
+ * interpreter puts on the bus, and scripts run by QiProg on a simulated chip.
+ */
+
+#include "test.h"
+#include "sim.h"
+#include "stellaris.h"
+
+#include <cmd_script.h>
+
+#include <string.h>
+
+static struct qiprog_device *const dev = &stellaris_lpc_dev;
+
+#define OP(opcode, operand)	(((uint32_t)(opcode) << 24) | (operand))
+
+/* The SST49LF040 byte program and sector erase, as a host would send them */
+static const uint32_t program_addr[] = {
+	OP(CMD_OP_WRITE, 0x5555), OP(CMD_OP_WRITE, 0x2aaa),
+	OP(CMD_OP_WRITE, 0x5555), OP(CMD_OP_WRITE_VALUE, 0),
+	OP(CMD_OP_POLL_DQ7, 0),
+};
+static const uint8_t program_data[] = { 0xaa, 0x55, 0xa0, 0, 4 };
+
+static const uint32_t erase_addr[] = {
+	OP(CMD_OP_WRITE, 0x5555), OP(CMD_OP_WRITE, 0x2aaa),
+	OP(CMD_OP_WRITE, 0x5555), OP(CMD_OP_WRITE, 0x5555),
+	OP(CMD_OP_WRITE, 0x2aaa), OP(CMD_OP_WRITE_TARGET, 0),
+	OP(CMD_OP_POLL_TOGGLE, 0),
+};
+static const uint8_t erase_data[] = { 0xaa, 0x55, 0x80, 0xaa, 0x55, 0x30, 8 };
+
+#define NUM(a)		(sizeof(a) / sizeof((a)[0]))
+
+/*
+ * A chip which only records what it is asked to do. Reads toggle DQ6 for as
+ * many reads as 'toggles' says.
+ */
+struct access {
+	bool write;
+	uint32_t addr;
+	uint8_t data;
+};
+
+static struct access trace[64];
+static size_t trace_len;
+static unsigned int toggles;
+static uint8_t toggle_bit;
+
+static qiprog_err fake_read8(uint32_t addr, uint8_t *data)
+{
+	if (toggles) {
+		toggles--;
+		toggle_bit ^= 0x40;
+	}
+	*data = 0xbf | toggle_bit;
+	if (trace_len < NUM(trace))
+		trace[trace_len++] = (struct access) {false, addr, *data};
+	return QIPROG_SUCCESS;
+}
+
+static qiprog_err fake_write8(uint32_t addr, uint8_t data)
+{
+	if (trace_len < NUM(trace))
+		trace[trace_len++] = (struct access) {true, addr, data};
+	return QIPROG_SUCCESS;
+}
+
+static const struct jedec_chip fake_chip = {
+	.read8 = fake_read8,
+	.write8 = fake_write8,
+	.window = 0xff800000,
+};
+
+static qiprog_err load(struct cmd_script *script, enum cmd_script_type type,
+		       const uint32_t *addr, const uint8_t *data, size_t num)
+{
+	qiprog_err ret;
+
+	ret = cmd_script_load(script, type, addr, data, num);
+	/* A script which is refused is left empty */
+	if (ret != QIPROG_SUCCESS)
+		CHECK_EQ(script->num_ops, 0);
+
+	return ret;
+}
+
+/* Scripts are checked once, when they are loaded */
+static void test_load(void)
+{
+	struct cmd_script s;
+	uint32_t addr[CMD_SCRIPT_MAX_OPS + 1];
+	uint8_t data[CMD_SCRIPT_MAX_OPS + 1];
+	size_t i;
+
+	CHECK_EQ(load(&s, CMD_SCRIPT_PROGRAM, program_addr, program_data,
+		      NUM(program_addr)), QIPROG_SUCCESS);
+	CHECK_EQ(s.num_ops, NUM(program_addr));
+	CHECK_EQ(s.ops[3].opcode, CMD_OP_WRITE_VALUE);
+	CHECK_EQ(s.ops[1].operand, 0x2aaa);
+	CHECK_EQ(s.ops[2].data, 0xa0);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, erase_addr, erase_data,
+		      NUM(erase_addr)), QIPROG_SUCCESS);
+
+	/* Empty, or too long */
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, erase_addr, erase_data, 0),
+		 QIPROG_ERR_ARG);
+	for (i = 0; i <= CMD_SCRIPT_MAX_OPS; i++) {
+		addr[i] = OP(CMD_OP_READ, 0);
+		data[i] = 0;
+	}
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, CMD_SCRIPT_MAX_OPS),
+		 QIPROG_SUCCESS);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data,
+		      CMD_SCRIPT_MAX_OPS + 1), QIPROG_ERR_ARG);
+
+	/* Opcodes we don't know */
+	addr[0] = OP(CMD_NUM_OPCODES, 0);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_ERR_ARG);
+	addr[0] = OP(0xff, 0);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_ERR_ARG);
+
+	/* Chips decode 4 MiB at most */
+	addr[0] = OP(CMD_OP_WRITE, 0x3fffff);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_SUCCESS);
+	addr[0] = OP(CMD_OP_WRITE, 0x400000);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_ERR_ARG);
+	addr[0] = OP(CMD_OP_READ, 0x400000);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_ERR_ARG);
+
+	/* Program scripts, and only those, write the value */
+	addr[0] = OP(CMD_OP_WRITE_VALUE, 0);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_ERR_ARG);
+	CHECK_EQ(load(&s, CMD_SCRIPT_PROGRAM, erase_addr, erase_data,
+		      NUM(erase_addr)), QIPROG_ERR_ARG);
+
+	/* Polls give up after 2^16 ms at most, delays after a second */
+	addr[0] = OP(CMD_OP_POLL_DQ7, 0);
+	data[0] = 16;
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_SUCCESS);
+	data[0] = 17;
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_ERR_ARG);
+	addr[0] = OP(CMD_OP_POLL_TOGGLE, 0);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_ERR_ARG);
+	addr[0] = OP(CMD_OP_DELAY, 1000000);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_SUCCESS);
+	addr[0] = OP(CMD_OP_DELAY, 1000001);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_ERR_ARG);
+
+	/* Loops run at least once, don't nest, and are closed */
+	addr[0] = OP(CMD_OP_LOOP, 0x1000);
+	addr[1] = OP(CMD_OP_READ, 0);
+	addr[2] = OP(CMD_OP_END_LOOP, 0);
+	data[0] = 2;
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 3), QIPROG_SUCCESS);
+	data[0] = 0;
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 3), QIPROG_ERR_ARG);
+	data[0] = 2;
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 2), QIPROG_ERR_ARG);
+	addr[1] = OP(CMD_OP_LOOP, 0);
+	data[1] = 2;
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 3), QIPROG_ERR_ARG);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr + 2, data + 2, 1),
+		 QIPROG_ERR_ARG);
+}
+
+/* Run a script on the fake chip until it is done */
+static enum cmd_script_state run(const struct cmd_script *s, uint32_t target,
+				 uint8_t value, unsigned int *steps)
+{
+	struct cmd_script_run r;
+	enum cmd_script_state state;
+
+	trace_len = 0;
+	*steps = 0;
+	cmd_script_start(&r, s, target, value);
+	do {
+		state = cmd_script_step(&fake_chip, &r);
+		(*steps)++;
+	} while (state == CMD_SCRIPT_BUSY);
+
+	if (state == CMD_SCRIPT_FAILED)
+		CHECK_EQ(r.error, QIPROG_ERR_TIMEOUT);
+
+	return state;
+}
+
+/* The interpreter puts the ops on the bus in order, relative to the target */
+static void test_step(void)
+{
+	struct cmd_script s;
+	unsigned int steps;
+	uint32_t addr[4];
+	uint8_t data[4];
+	size_t i;
+
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, erase_addr, erase_data,
+		      NUM(erase_addr)), QIPROG_SUCCESS);
+	toggles = 3;
+	CHECK_EQ(run(&s, 0x3000, 0xff, &steps), CMD_SCRIPT_DONE);
+	/*
+	 * Five commands, the erase at the target, then the first read, and
+	 * one more per toggle
+	 */
+	CHECK_EQ(trace_len, 6 + 1 + 3);
+	for (i = 0; i < 5; i++) {
+		CHECK(trace[i].write);
+		CHECK_EQ(trace[i].addr, 0xff800000 + (erase_addr[i] & 0xffffff));
+		CHECK_EQ(trace[i].data, erase_data[i]);
+	}
+	CHECK_EQ(trace[5].addr, 0xff803000);
+	CHECK_EQ(trace[5].data, 0x30);
+	for (i = 6; i < trace_len; i++) {
+		CHECK(!trace[i].write);
+		CHECK_EQ(trace[i].addr, 0xff803000);
+	}
+	/* One poll per step, and none once the toggling stopped */
+	CHECK_EQ(steps, 3);
+
+	/* The value goes where the target is */
+	CHECK_EQ(load(&s, CMD_SCRIPT_PROGRAM, program_addr, program_data,
+		      NUM(program_addr)), QIPROG_SUCCESS);
+	CHECK_EQ(run(&s, 0x1234, 0xa5, &steps), CMD_SCRIPT_DONE);
+	CHECK_EQ(trace[3].addr, 0xff801234);
+	CHECK_EQ(trace[3].data, 0xa5);
+
+	/* DQ7 which never matches gives up after 2^data ms */
+	CHECK_EQ(run(&s, 0x1234, 0x40, &steps), CMD_SCRIPT_FAILED);
+	CHECK(steps > 1);
+
+	/* A loop moves the target each time around */
+	addr[0] = OP(CMD_OP_LOOP, 0x1000);
+	addr[1] = OP(CMD_OP_WRITE_TARGET, 0x10);
+	addr[2] = OP(CMD_OP_END_LOOP, 0);
+	addr[3] = OP(CMD_OP_WRITE_TARGET, 0);
+	data[0] = 3;
+	data[1] = 0xd0;
+	data[2] = 0;
+	data[3] = 0xff;
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 4), QIPROG_SUCCESS);
+	CHECK_EQ(run(&s, 0x20000, 0xff, &steps), CMD_SCRIPT_DONE);
+	CHECK_EQ(trace_len, 4);
+	CHECK_EQ(trace[0].addr, 0xff820010);
+	CHECK_EQ(trace[1].addr, 0xff821010);
+	CHECK_EQ(trace[2].addr, 0xff822010);
+	CHECK_EQ(trace[3].addr, 0xff820000);
+	CHECK_EQ(trace[3].data, 0xff);
+
+	/* Delays wait in the job engine, not in the script */
+	addr[0] = OP(CMD_OP_DELAY, 100);
+	CHECK_EQ(load(&s, CMD_SCRIPT_ERASE, addr, data, 1), QIPROG_SUCCESS);
+	CHECK_EQ(run(&s, 0, 0xff, &steps), CMD_SCRIPT_DONE);
+	CHECK(steps > 1);
+	CHECK_EQ(trace_len, 0);
+}
+
+/* Scripts loaded through QiProg program and erase a simulated chip */
+static void test_sim_chip(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_chip_config cfg = sim_sst49lf040;
+	struct sim_stats before, after, d;
+	static uint8_t data[4096];
+	const uint32_t start = 0x10000, len = sizeof(data);
+	uint32_t i;
+	qiprog_err ret = 0;
+
+	sim_reset();
+	CHECK_EQ(sim_add_chip(0, &sim_sst49lf040), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->dev_open(dev), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->read_chip_id(dev, ids), QIPROG_SUCCESS);
+
+	/* The device must not take half a script */
+	CHECK_EQ(dev->drv->set_custom_write_command(dev, 0,
+				(uint32_t *)erase_addr, (uint8_t *)erase_data,
+				NUM(erase_addr)), QIPROG_ERR_ARG);
+	CHECK_EQ(dev->drv->set_custom_erase_command(dev, 0,
+				(uint32_t *)erase_addr, (uint8_t *)erase_data,
+				NUM(erase_addr)), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->set_custom_write_command(dev, 0,
+				(uint32_t *)program_addr,
+				(uint8_t *)program_data, NUM(program_addr)),
+		 QIPROG_SUCCESS);
+
+	/* The erase script erases one sector at a time */
+	memset(sim_chip_mem(0) + start, 0, 2 * len);
+	sim_get_stats(&before);
+	CHECK_EQ(stellaris_erase_async(start, start + 2 * len),
+		 QIPROG_SUCCESS);
+	CHECK_EQ(sim_run_jobs(), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+	CHECK_EQ(d.erases, 2);
+	for (i = 0; i < 2 * len; i++) {
+		if (sim_chip_mem(0)[start + i] != 0xff)
+			break;
+	}
+	CHECK_EQ(i, 2 * len);
+
+	/* The program script, a USB packet at a time */
+	for (i = 0; i < len; i++)
+		data[i] = i ^ (i >> 8);
+	sim_get_stats(&before);
+	dev->drv->set_address(dev, start, start + len);
+	for (i = 0; i < len; i += 64) {
+		ret |= dev->drv->write(dev, dev->addr.pwrite, data + i, 64);
+		sim_main_loop_pass();
+	}
+	ret |= sim_run_jobs();
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+
+	CHECK_EQ(ret, QIPROG_SUCCESS);
+	CHECK(!memcmp(sim_chip_mem(0) + start, data, len));
+	CHECK_EQ(d.bad_programs, 0);
+	CHECK_EQ(d.busy_writes, 0);
+	/* Four writes per byte, and at least one poll */
+	CHECK_EQ(d.writes, 4 * d.programs);
+	CHECK(d.reads >= d.programs);
+
+	/* A chip slower than the script allows for fails the write */
+	cfg.program_us = 20000;
+	sim_reset();
+	CHECK_EQ(sim_add_chip(0, &cfg), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->dev_open(dev), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->read_chip_id(dev, ids), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->set_custom_write_command(dev, 0,
+				(uint32_t *)program_addr,
+				(uint8_t *)program_data, NUM(program_addr)),
+		 QIPROG_SUCCESS);
+	dev->drv->set_address(dev, start, start + 1);
+	CHECK_EQ(dev->drv->write(dev, start, data, 1), QIPROG_SUCCESS);
+	CHECK_EQ(sim_run_jobs(), QIPROG_ERR_TIMEOUT);
+}
+
+int main(void)
+{
+	test_load();
+	test_step();
+	test_sim_chip();
+
+	return test_result("test_cmd_script");
+}
@@ -0,0 +1,158 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The checksums of the verify command. Expected values are what Python's
+ * zlib.crc32() and hashlib.sha256() give for the same data, so the host can
+ * check a digest from the board with either.
+ */
+
+#include "test.h"
+
+#include <crc32.h>
+#include <sha256.h>
+
+#include <string.h>
+
+#define PATTERN_LEN	1000
+
+static uint8_t pattern[PATTERN_LEN];
+/* Room to move the pattern off a word boundary */
+static uint8_t shifted[PATTERN_LEN + 4];
+
+static const char *const fox = "The quick brown fox jumps over the lazy dog";
+
+static void make_pattern(void)
+{
+	size_t i;
+
+	for (i = 0; i < PATTERN_LEN; i++)
+		pattern[i] = ((i * 31 + 7) ^ (i >> 8)) & 0xff;
+}
+
+static void test_crc32(void)
+{
+	uint32_t crc;
+	size_t off, split;
+
+	crc32_init();
+
+	CHECK_EQ(crc32_update(0, "", 0), 0);
+	CHECK_EQ(crc32_update(0, "123456789", 9), 0xcbf43926);
+	CHECK_EQ(crc32_update(0, fox, strlen(fox)), 0x414fa339);
+	CHECK_EQ(crc32_update(0, pattern, PATTERN_LEN), 0x6590591b);
+
+	/* Unaligned starts take the bytewise path into the sliced one */
+	for (off = 1; off < 4; off++) {
+		memcpy(shifted + off, pattern, PATTERN_LEN);
+		CHECK_EQ(crc32_update(0, shifted + off, PATTERN_LEN),
+			 0x6590591b);
+	}
+
+	/* A CRC fed back in carries on where it left off */
+	for (split = 0; split <= 9; split++) {
+		crc = crc32_update(0, pattern, split);
+		crc = crc32_update(crc, pattern + split, PATTERN_LEN - split);
+		CHECK_EQ(crc, 0x6590591b);
+	}
+}
+
+static void hex(char *out, const uint8_t *digest)
+{
+	size_t i;
+
+	for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+		sprintf(out + 2 * i, "%02x", digest[i]);
+}
+
+/* Check a digest, and say which data it was for if it differs */
+static void check_sha256(const char *what, const void *data, size_t len,
+			 const char *want)
+{
+	struct sha256_ctx ctx;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	char got[2 * SHA256_DIGEST_SIZE + 1];
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, digest);
+	hex(got, digest);
+
+	test_checks++;
+	if (strcmp(got, want)) {
+		test_failures++;
+		printf("sha256 of %s, %zu bytes: %s != %s\n", what, len, got,
+		       want);
+	}
+}
+
+static void test_sha256(void)
+{
+	static const struct {
+		size_t len;
+		const char *digest;
+	} lengths[] = {
+		/* Either side of where the length no longer fits in a block */
+		{55, "8aa994584139d128848eeebc4e815639ba5ab6e6e39574195a63ac4f14f7c43b"},
+		{56, "ad574708f75c044c9b85de64cb568ee7711ff4f36448c6242f053ba8f6cc2b63"},
+		{63, "280ed3e8ff1df845b2e7dfe6ac6cee817bef20e783cc65abc41b818b4d2fe076"},
+		{64, "c6ab9724ade5b6a7a1edfffb12f3aa9181351355af8fd08c919952ad211339dd"},
+		{65, "788367c73c7ddf4c53f65e68cc0d943e6227ab55b0e78ba63ace822b1c6301c0"},
+		{119, "3d610547d68216dedf7435a4fb6260353911f6b3fd3f18805ddb8be285d726fe"},
+		{120, "1f80156a804cb7862ad113e8200e9d74499723e7c7854d5f48776d3148e09656"},
+		{1000, "4cdc56c9b07775cf51fa4ad851ad5f5d7a030d6efc5742821dd0609f15beffac"},
+	};
+	static const char *const million_a =
+	    "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+	struct sha256_ctx ctx;
+	uint8_t digest[SHA256_DIGEST_SIZE], a[1001];
+	char got[2 * SHA256_DIGEST_SIZE + 1];
+	size_t i;
+
+	check_sha256("\"\"", "", 0,
+		     "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+	check_sha256("\"abc\"", "abc", 3,
+		     "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+	check_sha256("the two block message",
+		     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+		     56,
+		     "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+	for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+		check_sha256("the pattern", pattern, lengths[i].len,
+			     lengths[i].digest);
+
+	/* A million 'a's, in pieces which don't line up with blocks */
+	memset(a, 'a', sizeof(a));
+	sha256_init(&ctx);
+	for (i = 0; i < 1000; i++)
+		sha256_update(&ctx, a, (i & 1) ? 999 : 1001);
+	sha256_final(&ctx, digest);
+	hex(got, digest);
+	CHECK(!strcmp(got, million_a));
+}
+
+int main(void)
+{
+	make_pattern();
+	test_crc32();
+	test_sha256();
+
+	return test_result("test_digest");
+}
@@ -0,0 +1,232 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Precompiled waveforms: a patched table is the table built from scratch, and
+ * playing it puts the same clocks on the bus as lpc_mread() and lpc_mwrite().
+ */
+
+#include "test.h"
+#include "sim.h"
+#include "lpc_io.h"
+#include "lpc_wave.h"
+
+#include <string.h>
+
+static struct qiprog_device *const dev = &stellaris_lpc_dev;
+
+/* Where socket 0 decodes in LPC mode */
+#define CHIP_BASE	0xffc00000
+
+#define MAX_CLOCKS	256
+
+static struct sim_clock want[MAX_CLOCKS], got[MAX_CLOCKS];
+
+static void setup(const struct sim_chip_config *cfg)
+{
+	sim_reset();
+	CHECK_EQ(sim_add_chip(0, cfg), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->dev_open(dev), QIPROG_SUCCESS);
+}
+
+static bool same_wave(const struct lpc_wave *a, const struct lpc_wave *b)
+{
+	return (a->len == b->len) && (a->num_reads == b->num_reads) &&
+	       !memcmp(a->step, b->step, a->len * sizeof(a->step[0]));
+}
+
+/* Clocks are the same if the same side drives the same values */
+static bool same_clocks(const struct sim_clock *a, const struct sim_clock *b,
+			size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if ((a[i].lframe != b[i].lframe) ||
+		    (a[i].host_drives != b[i].host_drives) ||
+		    (a[i].lad != b[i].lad)) {
+			printf("clock %zu differs\n", i);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Patching the address and data gives the table built for them */
+static void test_patch(void)
+{
+	struct lpc_wave built, patched;
+	size_t frame;
+
+	lpc_wave_init(&built);
+	CHECK_EQ(lpc_wave_mread(&built, 0xffc05555), QIPROG_SUCCESS);
+	lpc_wave_init(&patched);
+	CHECK_EQ(lpc_wave_mread(&patched, 0), QIPROG_SUCCESS);
+	lpc_wave_patch_addr(&patched, 0, 0xffc05555);
+	CHECK(same_wave(&built, &patched));
+
+	lpc_wave_init(&built);
+	CHECK_EQ(lpc_wave_mwrite(&built, 0xffc02aaa, 0x5a), QIPROG_SUCCESS);
+	lpc_wave_init(&patched);
+	CHECK_EQ(lpc_wave_mwrite(&patched, 0xffffffff, 0xff), QIPROG_SUCCESS);
+	lpc_wave_patch_addr(&patched, 0, 0xffc02aaa);
+	lpc_wave_patch_data(&patched, 0, 0x5a);
+	CHECK(same_wave(&built, &patched));
+
+	/* A batch: only the frame which is patched changes */
+	lpc_wave_init(&built);
+	CHECK_EQ(lpc_wave_mwrite(&built, 0xffc05555, 0xaa), QIPROG_SUCCESS);
+	CHECK_EQ(lpc_wave_mwrite(&built, 0xffc02aaa, 0x55), QIPROG_SUCCESS);
+	CHECK_EQ(lpc_wave_mwrite(&built, 0xffc05555, 0xa0), QIPROG_SUCCESS);
+	frame = built.len;
+	CHECK_EQ(lpc_wave_mwrite(&built, 0xffc01234, 0x42), QIPROG_SUCCESS);
+
+	lpc_wave_init(&patched);
+	CHECK_EQ(lpc_wave_mwrite(&patched, 0xffc05555, 0xaa), QIPROG_SUCCESS);
+	CHECK_EQ(lpc_wave_mwrite(&patched, 0xffc02aaa, 0x55), QIPROG_SUCCESS);
+	CHECK_EQ(lpc_wave_mwrite(&patched, 0xffc05555, 0xa0), QIPROG_SUCCESS);
+	CHECK_EQ(lpc_wave_mwrite(&patched, 0, 0), QIPROG_SUCCESS);
+	lpc_wave_patch_addr(&patched, frame, 0xffc01234);
+	lpc_wave_patch_data(&patched, frame, 0x42);
+	CHECK(same_wave(&built, &patched));
+
+	/* A frame which doesn't fit is left out whole */
+	lpc_wave_init(&built);
+	while (lpc_wave_mread(&built, 0) == QIPROG_SUCCESS)
+		;
+	CHECK_EQ(built.len, built.num_reads * 17);
+	CHECK(built.len <= LPC_WAVE_MAX_STEPS);
+}
+
+/* Play a read, and the same read clocked by hand */
+static void check_mread(uint32_t addr)
+{
+	struct lpc_wave wave;
+	size_t want_len, got_len;
+	uint8_t want_val = 0, got_val = 0;
+
+	sim_trace_start(want, MAX_CLOCKS);
+	CHECK_EQ(lpc_mread(addr, &want_val), QIPROG_SUCCESS);
+	want_len = sim_trace_stop();
+
+	lpc_wave_init(&wave);
+	CHECK_EQ(lpc_wave_mread(&wave, addr), QIPROG_SUCCESS);
+	sim_trace_start(got, MAX_CLOCKS);
+	CHECK_EQ(lpc_wave_play(&wave, &got_val), QIPROG_SUCCESS);
+	got_len = sim_trace_stop();
+
+	CHECK_EQ(got_len, want_len);
+	CHECK(same_clocks(want, got, want_len));
+	CHECK_EQ(got_val, want_val);
+	CHECK_EQ(got_val, sim_chip_mem(0)[addr & 0x7ffff]);
+}
+
+static void check_mwrite(uint32_t addr, uint8_t data)
+{
+	struct lpc_wave wave;
+	size_t want_len, got_len;
+
+	sim_trace_start(want, MAX_CLOCKS);
+	CHECK_EQ(lpc_mwrite(addr, data), QIPROG_SUCCESS);
+	want_len = sim_trace_stop();
+
+	lpc_wave_init(&wave);
+	CHECK_EQ(lpc_wave_mwrite(&wave, addr, data), QIPROG_SUCCESS);
+	sim_trace_start(got, MAX_CLOCKS);
+	CHECK_EQ(lpc_wave_play(&wave, NULL), QIPROG_SUCCESS);
+	got_len = sim_trace_stop();
+
+	CHECK_EQ(got_len, want_len);
+	CHECK(same_clocks(want, got, want_len));
+}
+
+/* The table puts the same clocks on the bus as lpc_mread() and lpc_mwrite() */
+static void test_play(void)
+{
+	struct sim_chip_config cfg = sim_sst49lf040;
+
+	setup(&cfg);
+	sim_chip_mem(0)[0x12345] = 0xa5;
+	check_mread(CHIP_BASE + 0x12345);
+	check_mwrite(CHIP_BASE + 0x5555, 0xf0);
+
+	/* SYNC on the last TAR clock, where a SYNC clock is skipped */
+	cfg.early_sync = true;
+	setup(&cfg);
+	sim_chip_mem(0)[0x100] = 0x3c;
+	check_mread(CHIP_BASE + 0x100);
+	check_mwrite(CHIP_BASE + 0x5555, 0xf0);
+
+	/* Wait states, where the same SYNC clock is repeated */
+	cfg.early_sync = false;
+	cfg.sync_waits = 3;
+	setup(&cfg);
+	sim_chip_mem(0)[0x200] = 0x96;
+	check_mread(CHIP_BASE + 0x200);
+	check_mwrite(CHIP_BASE + 0x5555, 0xf0);
+}
+
+/* Interrupts are only let through while the chip has us waiting */
+static void test_irq(void)
+{
+	struct sim_chip_config cfg = sim_sst49lf040;
+	struct lpc_wave wave;
+	size_t len, i, unmasked = 0;
+	uint8_t val;
+
+	cfg.sync_waits = 5;
+	setup(&cfg);
+	lpc_wave_init(&wave);
+	CHECK_EQ(lpc_wave_mread(&wave, CHIP_BASE), QIPROG_SUCCESS);
+
+	CHECK(!sim_irq_masked());
+	sim_trace_start(got, MAX_CLOCKS);
+	CHECK_EQ(lpc_wave_play(&wave, &val), QIPROG_SUCCESS);
+	len = sim_trace_stop();
+	CHECK(!sim_irq_masked());
+
+	CHECK_EQ(len, 17 + cfg.sync_waits);
+	for (i = 0; i < len; i++) {
+		if (!got[i].irq_masked)
+			unmasked++;
+	}
+	/* All wait clocks but the first, and the SYNC which ends them */
+	CHECK_EQ(unmasked, cfg.sync_waits);
+	CHECK(got[0].irq_masked);
+	CHECK(got[len - 1].irq_masked);
+
+	/* No waits, no interrupts */
+	cfg.sync_waits = 0;
+	setup(&cfg);
+	sim_trace_start(got, MAX_CLOCKS);
+	CHECK_EQ(lpc_wave_play(&wave, &val), QIPROG_SUCCESS);
+	len = sim_trace_stop();
+	for (i = 0; i < len; i++)
+		CHECK(got[i].irq_masked);
+}
+
+int main(void)
+{
+	test_patch();
+	test_play();
+	test_irq();
+
+	return test_result("test_lpc_wave");
+}
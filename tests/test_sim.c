@@ -0,0 +1,901 @@
+/*
+ * This file is part of the vultureprog project.
+ *
+ * Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The QiProg driver against simulated chips: probing, reads, and programs and
+ * erases which have to be waited on, with both ways of polling.
+ */
+
+#include "test.h"
+#include "sim.h"
+#include "lpc_io.h"
+#include "stellaris.h"
+
+#include <jedec_flash.h>
+#include <jobs.h>
+
+#include <string.h>
+
+static struct qiprog_device *const dev = &stellaris_lpc_dev;
+static uint8_t buf[128 * 1024];
+
+/* Put a chip in socket 0, then open the device and probe, like the host does */
+static void setup(const struct sim_chip_config *cfg,
+		  struct qiprog_chip_id ids[9])
+{
+	sim_reset();
+	CHECK_EQ(sim_add_chip(0, cfg), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->dev_open(dev), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->read_chip_id(dev, ids), QIPROG_SUCCESS);
+	jedec_reset_poll_stats();
+}
+
+static void fill(uint8_t *data, uint32_t len, uint8_t seed)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		data[i] = (i * 7 + seed) ^ (i >> 8);
+}
+
+/* Send data the way QiProg does, a USB packet at a time */
+static qiprog_err write_range(uint32_t start, const uint8_t *data,
+			      uint32_t len)
+{
+	qiprog_err ret = 0;
+	uint32_t i;
+
+	dev->drv->set_address(dev, start, start + len);
+	for (i = 0; i < len; i += 64) {
+		ret |= dev->drv->write(dev, dev->addr.pwrite,
+				       (uint8_t *)data + i, 64);
+		/* The main loop runs while the next packet comes in */
+		sim_main_loop_pass();
+	}
+
+	return ret | sim_run_jobs();
+}
+
+static void test_probe(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_stats stats;
+
+	sim_reset();
+	CHECK_EQ(sim_add_chip(0, &sim_sst49lf040), QIPROG_SUCCESS);
+	CHECK_EQ(sim_add_chip(1, &sim_sst49lf040), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->dev_open(dev), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->read_chip_id(dev, ids), QIPROG_SUCCESS);
+
+	CHECK_EQ(ids[0].id_method, QIPROG_ID_METH_JEDEC);
+	CHECK_EQ(ids[0].vendor_id, 0xbf);
+	CHECK_EQ(ids[0].device_id, 0x51);
+	CHECK_EQ(ids[1].id_method, QIPROG_ID_METH_JEDEC);
+	CHECK_EQ(ids[1].vendor_id, 0xbf);
+	CHECK_EQ(ids[2].id_method, QIPROG_ID_INVALID);
+	CHECK_EQ(stellaris_chip_size(), 512 * 1024);
+
+	/* Socket 2 is empty, which takes one abort per probe cycle to find */
+	sim_get_stats(&stats);
+	CHECK_EQ(stats.contention, 0);
+	CHECK(stats.aborts > 0);
+	CHECK_EQ(stats.busy_writes, 0);
+}
+
+/*
+ * A part which is not in the chip database is set up from its CFI table. The
+ * simulated chip rounds its times up to powers of two for the table, and says
+ * the maximum is 16 times that.
+ */
+static void test_cfi(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct jedec_chip chip = {
+		.read8 = lpc_mread,
+		.write8 = lpc_mwrite,
+		.cmd_mask = 0x7fff,
+	};
+	struct jedec_cfi cfi;
+	struct jedec_poll_stats polls;
+	struct sim_stats before, after, d;
+	uint8_t val;
+
+	setup(&sim_fwh_cfi, ids);
+	CHECK_EQ(jedec_cfi_query(&chip, 0xffff0000, &cfi), QIPROG_SUCCESS);
+	CHECK_EQ(cfi.size, 1024 * 1024);
+	CHECK_EQ(cfi.num_regions, 2);
+	CHECK_EQ(cfi.region[0].count, 256);
+	CHECK_EQ(cfi.region[0].size, 4 * 1024);
+	CHECK_EQ(cfi.region[1].count, 16);
+	CHECK_EQ(cfi.region[1].size, 64 * 1024);
+	CHECK_EQ(cfi.timing[JEDEC_OP_PROGRAM].typ_us, 32);
+	CHECK_EQ(cfi.timing[JEDEC_OP_PROGRAM].max_us, 32 * 16);
+	CHECK_EQ(cfi.timing[JEDEC_OP_SECTOR_ERASE].typ_us, 32000);
+	CHECK_EQ(cfi.timing[JEDEC_OP_SECTOR_ERASE].max_us, 32000 * 16);
+	CHECK_EQ(cfi.timing[JEDEC_OP_BLOCK_ERASE].typ_us, 32000);
+	CHECK_EQ(cfi.timing[JEDEC_OP_CHIP_ERASE].typ_us, 128000);
+	CHECK_EQ(cfi.timing[JEDEC_OP_CHIP_ERASE].max_us, 128000 * 16);
+	/* The chip is back in read mode */
+	sim_chip_mem(0)[0x10] = 0x42;
+	CHECK_EQ(stellaris_read(0x10, &val, 1), QIPROG_SUCCESS);
+	CHECK_EQ(val, 0x42);
+
+	/* The SST part has no table */
+	setup(&sim_sst49lf040, ids);
+	CHECK_EQ(jedec_cfi_query(&chip, 0xffff0000, &cfi),
+		 QIPROG_ERR_NO_RESPONSE);
+
+	/*
+	 * What the driver made of it: a sector at the start of a block, then
+	 * the block, and no poll before the typical time from the table.
+	 */
+	setup(&sim_fwh_cfi, ids);
+	CHECK_EQ(stellaris_chip_size(), 1024 * 1024);
+	sim_get_stats(&before);
+	CHECK_EQ(stellaris_erase_async(0x0f000, 0x20000), QIPROG_SUCCESS);
+	CHECK_EQ(sim_run_jobs(), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+	CHECK_EQ(d.erases, 2);
+	CHECK(d.time_ns >= 2 * 32000000ULL);
+	jedec_get_poll_stats(JEDEC_OP_SECTOR_ERASE, &polls);
+	CHECK_EQ(polls.ops, 1);
+	CHECK_EQ(polls.polls, 1);
+	jedec_get_poll_stats(JEDEC_OP_BLOCK_ERASE, &polls);
+	CHECK_EQ(polls.ops, 1);
+	CHECK_EQ(polls.polls, 1);
+}
+
+static void test_read(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_stats before, after, d;
+	const uint32_t len = 4096, start = 0x7f000;
+
+	setup(&sim_sst49lf040, ids);
+	fill(sim_chip_mem(0) + start, len, 0x5a);
+
+	sim_get_stats(&before);
+	dev->drv->set_address(dev, start, start + len);
+	CHECK_EQ(dev->drv->read(dev, start, buf, len), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+
+	CHECK(!memcmp(buf, sim_chip_mem(0) + start, len));
+	/* One LPC frame per byte, of 17 clocks with no wait states */
+	CHECK_EQ(d.frames, len);
+	CHECK_EQ(d.reads, len);
+	CHECK_EQ(d.clocks, 17 * len);
+	CHECK_EQ(d.aborts, 0);
+	CHECK_EQ(d.contention, 0);
+}
+
+/* Read through QiProg, check the data, and count the frames it took */
+static uint32_t read_frames(uint32_t start, uint32_t len)
+{
+	struct sim_stats before, after, d;
+
+	sim_get_stats(&before);
+	dev->drv->set_address(dev, start, start + len);
+	CHECK_EQ(dev->drv->read(dev, start, buf, len), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+
+	CHECK(!memcmp(buf, sim_chip_mem(0) + start, len));
+	CHECK_EQ(d.contention, 0);
+	return d.frames;
+}
+
+/*
+ * A part which is not in the chip database is asked over the bus how large a
+ * burst it takes. The largest one it answers is used, LPC reads where none is.
+ */
+static void test_fwh_burst(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_chip_config cfg = sim_fwh_cfi;
+	const uint32_t start = 0x40000, len = 4096;
+
+	setup(&cfg, ids);
+	fill(sim_chip_mem(0), cfg.size, 0x24);
+	read_frames(start, 16);
+	CHECK_EQ(read_frames(start, len), len / 128);
+	/* Single bytes at the edges, 16 byte bursts up to 128 byte ones */
+	CHECK_EQ(read_frames(start + 0x0f, 0x1f1), 1 + 7 + 3);
+
+	/* No 128 byte bursts, so it has to settle for 16 bytes */
+	cfg.fwh_msizes &= ~SIM_FWH_MSIZE(7);
+	setup(&cfg, ids);
+	fill(sim_chip_mem(0), cfg.size, 0x42);
+	read_frames(start, 16);
+	CHECK_EQ(read_frames(start, len), len / 16);
+
+	/* No bursts at all */
+	cfg.fwh_msizes = SIM_FWH_MSIZE(0);
+	setup(&cfg, ids);
+	read_frames(start, 16);
+	CHECK_EQ(read_frames(start, len), len);
+
+	/* The host may forbid FWH frames */
+	setup(&sim_fwh_cfi, ids);
+	CHECK_EQ(dev->drv->set_bus(dev, QIPROG_BUS_LPC), QIPROG_SUCCESS);
+	sim_main_loop_pass();
+	CHECK_EQ(read_frames(start, len), len);
+	CHECK_EQ(dev->drv->set_bus(dev, QIPROG_BUS_LPC | QIPROG_BUS_FWH),
+		 QIPROG_SUCCESS);
+	sim_main_loop_pass();
+	read_frames(start, 16);
+	CHECK_EQ(read_frames(start, len), len / 128);
+}
+
+/* The chip asks for wait states, or does not answer at all */
+static void test_sync(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_chip_config cfg = sim_sst49lf040;
+	struct lpc_bus_stats bus;
+	struct sim_stats before, after, d;
+	uint8_t val;
+
+	cfg.sync_waits = 3;
+	setup(&cfg, ids);
+	CHECK_EQ(ids[0].vendor_id, 0xbf);
+	sim_chip_mem(0)[0x100] = 0xa5;
+	lpc_get_bus_stats(&bus, true);
+	CHECK_EQ(dev->drv->read8(dev, 0x100, &val), QIPROG_SUCCESS);
+	CHECK_EQ(val, 0xa5);
+	lpc_get_bus_stats(&bus, true);
+	CHECK_EQ(bus.waits, 3);
+	CHECK_EQ(bus.retries, 0);
+
+	/* More short waits than the spec allows. Retried, then given up. */
+	cfg.sync_waits = 9;
+	setup(&cfg, ids);
+	lpc_get_bus_stats(&bus, true);
+	sim_get_stats(&before);
+	CHECK_EQ(dev->drv->read8(dev, 0x100, &val), QIPROG_ERR_TIMEOUT);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+	lpc_get_bus_stats(&bus, true);
+	CHECK_EQ(bus.retries, 2);
+	CHECK_EQ(bus.failures, 1);
+	CHECK_EQ(d.aborts, 3);
+	CHECK_EQ(d.contention, 0);
+
+	/* Long waits may go on for much longer */
+	cfg.sync = SIM_SYNC_LONG_WAIT;
+	cfg.sync_waits = 200;
+	setup(&cfg, ids);
+	sim_chip_mem(0)[0x100] = 0x3c;
+	CHECK_EQ(dev->drv->read8(dev, 0x100, &val), QIPROG_SUCCESS);
+	CHECK_EQ(val, 0x3c);
+
+	/* SYNC on the last TAR clock */
+	cfg = sim_sst49lf040;
+	cfg.early_sync = true;
+	setup(&cfg, ids);
+	CHECK_EQ(ids[0].device_id, 0x51);
+	sim_chip_mem(0)[0x100] = 0x69;
+	CHECK_EQ(dev->drv->read8(dev, 0x100, &val), QIPROG_SUCCESS);
+	CHECK_EQ(val, 0x69);
+	CHECK_EQ(dev->drv->write8(dev, 0x5555, 0xf0), QIPROG_SUCCESS);
+}
+
+/* Auto erase and program, polling DQ7 as the chip database says to */
+static void test_program_dq7(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct jedec_poll_stats polls;
+	struct sim_stats before, after, d;
+	const uint32_t start = 0x10000, len = 8192;
+
+	setup(&sim_sst49lf040, ids);
+	CHECK_EQ(dev->drv->set_erase_command(dev, 0, QIPROG_ERASE_CMD_JEDEC_ISA,
+					     QIPROG_ERASE_SUBCMD_DEFAULT,
+					     QIPROG_ERASE_BEFORE_WRITE),
+		 QIPROG_SUCCESS);
+	memset(sim_chip_mem(0) + start, 0, len);
+	fill(buf, len, 0x11);
+
+	sim_get_stats(&before);
+	CHECK_EQ(write_range(start, buf, len), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+
+	CHECK(!memcmp(sim_chip_mem(0) + start, buf, len));
+	CHECK_EQ(d.erases, len / 4096);
+	CHECK_EQ(d.bad_programs, 0);
+	CHECK_EQ(d.busy_writes, 0);
+	CHECK_EQ(d.contention, 0);
+	/* 0xff bytes are left alone */
+	CHECK(d.programs <= len);
+
+	/* A sector erase takes 18ms, and is not polled before that */
+	jedec_get_poll_stats(JEDEC_OP_SECTOR_ERASE, &polls);
+	CHECK_EQ(polls.ops, len / 4096);
+	CHECK_EQ(polls.timeouts, 0);
+	CHECK(d.time_ns >= 2 * 18000000ULL);
+	jedec_get_poll_stats(JEDEC_OP_PROGRAM, &polls);
+	CHECK_EQ(polls.ops, d.programs);
+	CHECK_EQ(polls.timeouts, 0);
+	CHECK_EQ(dev->drv->set_erase_command(dev, 0, QIPROG_ERASE_CMD_JEDEC_ISA,
+					     QIPROG_ERASE_SUBCMD_DEFAULT, 0),
+		 QIPROG_SUCCESS);
+}
+
+/*
+ * A new range starts while the queue is still full of the last one. Its erase
+ * must still be queued, and done before anything is programmed over it.
+ */
+static void test_program_queue_full(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_stats before, after, d;
+	const uint32_t start = 0x10000, len = 20 * 64;
+	const uint32_t size = sim_sst49lf040.size;
+	uint32_t i;
+
+	setup(&sim_sst49lf040, ids);
+	memset(sim_chip_mem(0), 0, size);
+	memset(buf, 0, len);
+
+	/* More packets than there are jobs, with no main loop in between */
+	dev->drv->set_address(dev, start, start + len);
+	for (i = 0; i < len; i += 64)
+		CHECK_EQ(dev->drv->write(dev, dev->addr.pwrite, buf + i, 64),
+			 QIPROG_SUCCESS);
+
+	CHECK_EQ(dev->drv->set_erase_command(dev, 0, QIPROG_ERASE_CMD_JEDEC_ISA,
+					     QIPROG_ERASE_SUBCMD_DEFAULT,
+					     QIPROG_ERASE_BEFORE_WRITE),
+		 QIPROG_SUCCESS);
+	memset(buf, 0x5a, 64);
+	sim_get_stats(&before);
+	dev->drv->set_address(dev, 0, size);
+	CHECK_EQ(dev->drv->write(dev, 0, buf, 64), QIPROG_SUCCESS);
+	CHECK_EQ(sim_run_jobs(), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+
+	CHECK(!memcmp(sim_chip_mem(0), buf, 64));
+	CHECK(d.erases > 0);
+	CHECK_EQ(sim_chip_mem(0)[size - 1], 0xff);
+	CHECK_EQ(d.bad_programs, 0);
+	CHECK_EQ(dev->drv->set_erase_command(dev, 0, QIPROG_ERASE_CMD_JEDEC_ISA,
+					     QIPROG_ERASE_SUBCMD_DEFAULT, 0),
+		 QIPROG_SUCCESS);
+}
+
+/* A part we don't know, set up from CFI, and polled with the toggle bit */
+static void test_program_toggle(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct jedec_poll_stats polls;
+	struct sim_stats before, after, d;
+	const uint32_t start = 0x20000, len = 1024;
+
+	setup(&sim_fwh_cfi, ids);
+	CHECK_EQ(ids[0].vendor_id, 0xda);
+	CHECK_EQ(ids[0].device_id, 0x3d);
+	CHECK_EQ(stellaris_chip_size(), 1024 * 1024);
+	jedec_set_poll_method(JEDEC_POLL_TOGGLE);
+
+	fill(buf, len, 0x77);
+	sim_get_stats(&before);
+	CHECK_EQ(write_range(start, buf, len), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+
+	CHECK(!memcmp(sim_chip_mem(0) + start, buf, len));
+	CHECK_EQ(d.bad_programs, 0);
+	CHECK_EQ(d.busy_writes, 0);
+	/* CFI says 32us, and the part takes 20us, so one poll is enough */
+	jedec_get_poll_stats(JEDEC_OP_PROGRAM, &polls);
+	CHECK_EQ(polls.ops, d.programs);
+	CHECK_EQ(polls.polls, polls.ops);
+	CHECK_EQ(d.busy_reads, 0);
+}
+
+/*
+ * tBP longer than the driver takes as typical, so it has to poll more than
+ * once. It is still well within the maximum.
+ */
+static void test_program_slow(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_chip_config cfg = sim_fwh_cfi;
+	struct jedec_poll_stats polls;
+	struct sim_stats before, after, d;
+	const uint32_t start = 0x30000, len = 256;
+
+	cfg.program_us = 100;
+	setup(&cfg, ids);
+	jedec_set_timing(JEDEC_OP_PROGRAM, 20, 1000);
+	fill(buf, len, 0x42);
+
+	sim_get_stats(&before);
+	CHECK_EQ(write_range(start, buf, len), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+
+	CHECK(!memcmp(sim_chip_mem(0) + start, buf, len));
+	CHECK_EQ(d.bad_programs, 0);
+	CHECK_EQ(d.busy_writes, 0);
+	CHECK(d.time_ns >= d.programs * 100000ULL);
+	jedec_get_poll_stats(JEDEC_OP_PROGRAM, &polls);
+	CHECK_EQ(polls.ops, d.programs);
+	CHECK(polls.polls > polls.ops);
+	CHECK(d.busy_reads > 0);
+}
+
+/*
+ * A chip near its maximum tBP still makes it, as the timer starts once the
+ * command is on the bus, not before it is sent.
+ */
+static void test_program_tbp(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_chip_config cfg = sim_sst49lf040;
+	struct jedec_poll_stats polls;
+	struct sim_stats before, after, d;
+	const uint32_t start = 0x10000, len = 256;
+
+	cfg.program_us = 18;
+	setup(&cfg, ids);
+	fill(buf, len, 0x5e);
+
+	sim_get_stats(&before);
+	CHECK_EQ(write_range(start, buf, len), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+
+	CHECK(!memcmp(sim_chip_mem(0) + start, buf, len));
+	CHECK_EQ(d.busy_writes, 0);
+	jedec_get_poll_stats(JEDEC_OP_PROGRAM, &polls);
+	CHECK_EQ(polls.ops, d.programs);
+	CHECK_EQ(polls.timeouts, 0);
+}
+
+/*
+ * What a full speed bulk pipe takes for a 64 byte packet, and how many packets
+ * the endpoint interrupt rings up before the host is NAKed, as in usb_dev.c.
+ */
+#define USB_PACKET_NS		52000
+#define USB_RX_PACKETS		8
+
+/*
+ * The host streams while the chip is programmed. The ring of usb_dev.c is not
+ * built for the host, so packets land in a model of it, on their own time.
+ * QiProg takes a packet whenever there is one, and the main loop programs in
+ * between. The time on USB should be hidden under the time on the bus.
+ */
+static void test_usb_overlap(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_stats before, now;
+	const uint32_t start = 0x20000, len = 4096, pkt = 64;
+	uint32_t sent = 0, taken = 0, naks = 0, programs_at_second = 0;
+	uint64_t t_start, t, next, usb_ns = 0, bus_ns = 0;
+	int64_t overlap_ns;
+	bool held = false;
+	qiprog_err ret = 0;
+
+	setup(&sim_sst49lf040, ids);
+	fill(buf, len, 0x77);
+	dev->drv->set_address(dev, start, start + len);
+
+	sim_get_stats(&before);
+	t_start = sim_time_ns();
+	next = t_start + USB_PACKET_NS;
+	while (taken < len) {
+		/* A full ring leaves the packet in the FIFO, and NAKs the next */
+		while ((sent < len) && (sim_time_ns() >= next)) {
+			if (sent - taken >= USB_RX_PACKETS * pkt) {
+				naks += !held;
+				held = true;
+				break;
+			}
+			sent += pkt;
+			usb_ns += USB_PACKET_NS;
+			next = (held ? sim_time_ns() : next) + USB_PACKET_NS;
+			held = false;
+		}
+
+		t = sim_time_ns();
+		if (sent > taken) {
+			if (taken == pkt) {
+				sim_get_stats(&now);
+				programs_at_second = now.programs -
+						     before.programs;
+			}
+			ret |= dev->drv->write(dev, dev->addr.pwrite,
+					       buf + taken, pkt);
+			taken += pkt;
+		} else if (job_busy()) {
+			sim_main_loop_pass();
+		} else {
+			sim_advance(next - sim_time_ns());
+			continue;
+		}
+		bus_ns += sim_time_ns() - t;
+	}
+	t = sim_time_ns();
+	ret |= sim_run_jobs();
+	bus_ns += sim_time_ns() - t;
+
+	CHECK_EQ(ret, QIPROG_SUCCESS);
+	CHECK(!memcmp(sim_chip_mem(0) + start, buf, len));
+	/* The first packet was being programmed while the second came in */
+	CHECK(programs_at_second > 0);
+	/* The chip is slower than USB, so the host had to be held off */
+	CHECK(naks > 0);
+	/*
+	 * One after the other, the transfer would take the time on USB plus
+	 * the time on the bus. All of the USB time but the first packet is
+	 * hidden under the bus time.
+	 */
+	overlap_ns = (int64_t)(bus_ns + usb_ns) -
+		     (int64_t)(sim_time_ns() - t_start);
+	CHECK(overlap_ns >= (int64_t)(usb_ns - USB_PACKET_NS));
+}
+
+/* Write a range, and count what the differential write did with it */
+static void diff_write_range(uint32_t start, const uint8_t *data, uint32_t len,
+			     struct stellaris_diff_stats *stats,
+			     struct sim_stats *d)
+{
+	struct sim_stats before, after;
+
+	stellaris_get_diff_stats(stats, true);
+	sim_get_stats(&before);
+	CHECK_EQ(write_range(start, data, len), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(d, &after, &before);
+	stellaris_get_diff_stats(stats, true);
+
+	CHECK(!memcmp(sim_chip_mem(0) + start, data, len));
+	CHECK_EQ(d->bad_programs, 0);
+	CHECK_EQ(d->busy_writes, 0);
+}
+
+/* Only sectors which differ are erased and programmed again */
+static void test_diff_write(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct stellaris_diff_stats stats;
+	struct sim_stats d;
+	const uint32_t start = 0x40000, len = 4 * 4096;
+	const uint32_t ustart = 0x50000 + 100, ulen = 4096 + 100;
+	uint8_t *const mem = sim_chip_mem(0);
+
+	setup(&sim_sst49lf040, ids);
+	CHECK_EQ(stellaris_set_write_mode(STELLARIS_WRITE_DIFF),
+		 QIPROG_SUCCESS);
+
+	/* The same data again: nothing to do */
+	fill(mem + start, len, 0x21);
+	memcpy(buf, mem + start, len);
+	diff_write_range(start, buf, len, &stats, &d);
+	CHECK_EQ(stats.skipped, 4);
+	CHECK_EQ(stats.erased, 0);
+	CHECK_EQ(stats.programmed, 0);
+	CHECK_EQ(d.erases, 0);
+	CHECK_EQ(d.programs, 0);
+
+	/* One byte of the third sector needs bits set */
+	buf[2 * 4096 + 10] = ~buf[2 * 4096 + 10];
+	diff_write_range(start, buf, len, &stats, &d);
+	CHECK_EQ(stats.skipped, 3);
+	CHECK_EQ(stats.erased, 1);
+	CHECK_EQ(stats.programmed, 1);
+	CHECK_EQ(stats.patched, 0);
+	CHECK_EQ(d.erases, 1);
+	CHECK(d.programs <= 4096);
+
+	/*
+	 * A range which starts and ends within a sector. The bytes of those
+	 * sectors which are outside of it are put back after the erase.
+	 */
+	fill(mem + ustart - 100, 2 * 4096, 0x5e);
+	memcpy(buf, mem + ustart - 100, 2 * 4096);
+	fill(buf + 100, ulen, 0xa7);
+	diff_write_range(ustart, buf + 100, ulen, &stats, &d);
+	CHECK_EQ(stats.erased, 2);
+	CHECK_EQ(stats.programmed, 2);
+	CHECK_EQ(d.erases, 2);
+	CHECK(!memcmp(mem + ustart - 100, buf, 2 * 4096));
+
+	CHECK_EQ(stellaris_set_write_mode(STELLARIS_WRITE_NORMAL),
+		 QIPROG_SUCCESS);
+
+	/*
+	 * Auto erase takes the same path, but erases the block the range
+	 * covers whole, without comparing it.
+	 */
+	CHECK_EQ(dev->drv->set_erase_command(dev, 0, QIPROG_ERASE_CMD_JEDEC_ISA,
+					     QIPROG_ERASE_SUBCMD_DEFAULT,
+					     QIPROG_ERASE_BEFORE_WRITE),
+		 QIPROG_SUCCESS);
+	fill(mem + 0x0f000, 0x12000, 0x3c);
+	memcpy(buf, mem + 0x0f000, 0x12000);
+	fill(buf + 0x800, 0x11000, 0xc3);
+	diff_write_range(0x0f800, buf + 0x800, 0x11000, &stats, &d);
+	CHECK_EQ(stats.erased, 16 + 2);
+	CHECK_EQ(d.erases, 1 + 2);
+	CHECK(!memcmp(mem + 0x0f000, buf, 0x12000));
+	CHECK_EQ(dev->drv->set_erase_command(dev, 0, QIPROG_ERASE_CMD_JEDEC_ISA,
+					     QIPROG_ERASE_SUBCMD_DEFAULT, 0),
+		 QIPROG_SUCCESS);
+}
+
+/*
+ * New data which only clears bits is programmed over the old, with no erase.
+ * One bit which has to be set again takes an erase after all.
+ */
+static void test_diff_patch(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct stellaris_diff_stats stats;
+	struct sim_stats d;
+	const uint32_t start = 0x60000, len = 4096;
+	uint8_t *const mem = sim_chip_mem(0);
+	uint32_t i;
+
+	setup(&sim_sst49lf040, ids);
+	CHECK_EQ(stellaris_set_write_mode(STELLARIS_WRITE_DIFF),
+		 QIPROG_SUCCESS);
+
+	fill(mem + start, len, 0x6b);
+	memcpy(buf, mem + start, len);
+	for (i = 0; i < len; i += 16)
+		buf[i] &= 0x0f;
+	diff_write_range(start, buf, len, &stats, &d);
+	CHECK_EQ(stats.patched, 1);
+	CHECK_EQ(stats.programmed, 1);
+	CHECK_EQ(stats.erased, 0);
+	CHECK_EQ(d.erases, 0);
+	/* Only the bytes which changed */
+	CHECK(d.programs > 0);
+	CHECK(d.programs <= len / 16);
+
+	/* The high nibble of this one was just cleared */
+	buf[16] |= 0xf0;
+	diff_write_range(start, buf, len, &stats, &d);
+	CHECK_EQ(stats.patched, 0);
+	CHECK_EQ(stats.erased, 1);
+	CHECK_EQ(d.erases, 1);
+
+	CHECK_EQ(stellaris_set_write_mode(STELLARIS_WRITE_NORMAL),
+		 QIPROG_SUCCESS);
+}
+
+/* Is [start, start + len) of a chip the same as 'data'? */
+static bool chip_has(uint8_t socket, uint32_t start, const uint8_t *data,
+		     uint32_t len)
+{
+	return !memcmp(sim_chip_mem(socket) + start, data, len);
+}
+
+/* Erase and program a range on every chip in the gang, and time both */
+static void gang_write(uint32_t start, const uint8_t *data, uint32_t len,
+		       uint64_t *erase_ns, uint64_t *program_ns)
+{
+	struct sim_stats before, after, d;
+
+	sim_get_stats(&before);
+	CHECK_EQ(stellaris_erase_async(start, start + len), QIPROG_SUCCESS);
+	CHECK_EQ(sim_run_jobs(), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+	*erase_ns = d.time_ns;
+
+	before = after;
+	CHECK_EQ(write_range(start, data, len), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+	*program_ns = d.time_ns;
+
+	CHECK_EQ(d.bad_programs, 0);
+	CHECK_EQ(d.busy_writes, 0);
+	CHECK_EQ(d.contention, 0);
+}
+
+/*
+ * Three chips in a gang. Each is written in its own window on the bus, and the
+ * job engine works on one while the others are busy.
+ */
+static void test_gang(void)
+{
+	struct qiprog_chip_id ids[9];
+	const uint32_t start = 0x10000, len = 8192;
+	const uint32_t size = sim_sst49lf040.size;
+	uint64_t erase3_ns, program3_ns, erase1_ns, program1_ns;
+	uint8_t i, val;
+
+	sim_reset();
+	for (i = 0; i < 3; i++) {
+		CHECK_EQ(sim_add_chip(i, &sim_sst49lf040), QIPROG_SUCCESS);
+		memset(sim_chip_mem(i), i, size);
+	}
+	CHECK_EQ(dev->drv->dev_open(dev), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->read_chip_id(dev, ids), QIPROG_SUCCESS);
+	CHECK_EQ(ids[2].device_id, 0x51);
+	CHECK_EQ(ids[3].id_method, QIPROG_ID_INVALID);
+
+	fill(buf, len, 0x99);
+	gang_write(start, buf, len, &erase3_ns, &program3_ns);
+	for (i = 0; i < 3; i++) {
+		CHECK(chip_has(i, start, buf, len));
+		CHECK_EQ(sim_chip_mem(i)[start - 1], i);
+		CHECK_EQ(sim_chip_mem(i)[start + len], i);
+	}
+
+	/* The gang changes from the main loop. Reads come from its first chip. */
+	CHECK_EQ(stellaris_set_gang_mask(1 << 3), QIPROG_ERR_ARG);
+	CHECK_EQ(stellaris_set_gang_mask(1 << 1), QIPROG_SUCCESS);
+	sim_chip_mem(0)[0x100] = 0xa0;
+	sim_chip_mem(1)[0x100] = 0xa1;
+	CHECK_EQ(stellaris_read(0x100, &val, 1), QIPROG_SUCCESS);
+	CHECK_EQ(val, 0xa0);
+	sim_main_loop_pass();
+	CHECK_EQ(stellaris_read(0x100, &val, 1), QIPROG_SUCCESS);
+	CHECK_EQ(val, 0xa1);
+
+	/* The same, on chip 1 alone */
+	fill(buf, len, 0x33);
+	gang_write(start, buf, len, &erase1_ns, &program1_ns);
+	CHECK(chip_has(1, start, buf, len));
+	CHECK(!chip_has(0, start, buf, len));
+	CHECK(!chip_has(2, start, buf, len));
+
+	/*
+	 * Erases are all waiting, so three chips take about as long as one.
+	 * Programs are partly bus time, which the chips can't share.
+	 */
+	CHECK(erase3_ns < erase1_ns + erase1_ns / 4);
+	CHECK(program3_ns < program1_ns + program1_ns / 2);
+}
+
+/* Switch the bus engine, and let the main loop apply it */
+static void set_bus(enum qiprog_bus bus)
+{
+	CHECK_EQ(dev->drv->set_bus(dev, bus), QIPROG_SUCCESS);
+	sim_main_loop_pass();
+}
+
+/*
+ * The same chip, reset into its A/A-Mux interface. Reads, programs and
+ * erases go through the JEDEC layer like on LPC, with no LPC frames at all.
+ */
+static void test_aamux(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_stats before, after, d;
+	const uint32_t start = 0x30000, len = 4096;
+
+	sim_reset();
+	CHECK_EQ(sim_add_chip(0, &sim_sst49lf040), QIPROG_SUCCESS);
+	CHECK_EQ(sim_add_chip(1, &sim_sst49lf040), QIPROG_SUCCESS);
+	CHECK_EQ(dev->drv->dev_open(dev), QIPROG_SUCCESS);
+
+	/* Not together with the LPC engines */
+	CHECK_EQ(dev->drv->set_bus(dev, QIPROG_BUS_ISA | QIPROG_BUS_LPC),
+		 QIPROG_ERR_ARG);
+	set_bus(QIPROG_BUS_ISA);
+
+	/* No ID straps, so only the chip in socket 0 answers */
+	sim_get_stats(&before);
+	CHECK_EQ(dev->drv->read_chip_id(dev, ids), QIPROG_SUCCESS);
+	CHECK_EQ(ids[0].vendor_id, 0xbf);
+	CHECK_EQ(ids[0].device_id, 0x51);
+	CHECK_EQ(ids[1].id_method, QIPROG_ID_INVALID);
+
+	fill(sim_chip_mem(0) + start, len, 0x3c);
+	dev->drv->set_address(dev, start, start + len);
+	CHECK_EQ(dev->drv->read(dev, start, buf, len), QIPROG_SUCCESS);
+	CHECK(!memcmp(buf, sim_chip_mem(0) + start, len));
+
+	CHECK_EQ(stellaris_erase_async(start, start + len), QIPROG_SUCCESS);
+	CHECK_EQ(sim_run_jobs(), QIPROG_SUCCESS);
+	fill(buf, len, 0xc3);
+	CHECK_EQ(write_range(start, buf, len), QIPROG_SUCCESS);
+	CHECK(!memcmp(sim_chip_mem(0) + start, buf, len));
+
+	/* This part only takes a chip erase in A/A-Mux mode */
+	CHECK_EQ(stellaris_erase_async(0, sim_sst49lf040.size),
+		 QIPROG_SUCCESS);
+	CHECK_EQ(sim_run_jobs(), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+	CHECK_EQ(sim_chip_mem(0)[start], 0xff);
+
+	CHECK_EQ(d.frames, 0);
+	CHECK_EQ(d.erases, 2);
+	CHECK_EQ(d.bad_programs, 0);
+	CHECK_EQ(d.busy_writes, 0);
+	CHECK_EQ(d.contention, 0);
+
+	/* And back. Both chips are on the bus again. */
+	set_bus(QIPROG_BUS_LPC | QIPROG_BUS_FWH);
+	sim_get_stats(&before);
+	CHECK_EQ(dev->drv->read_chip_id(dev, ids), QIPROG_SUCCESS);
+	CHECK_EQ(ids[1].device_id, 0x51);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+	CHECK(d.frames > 0);
+}
+
+/* Erase units come from the config, and the driver picks the right ones */
+static void test_erase(void)
+{
+	struct qiprog_chip_id ids[9];
+	struct sim_stats before, after, d;
+	uint32_t i;
+	bool erased = true;
+
+	setup(&sim_fwh_cfi, ids);
+	memset(sim_chip_mem(0), 0, 1024 * 1024);
+
+	/* Half a block, then a whole one */
+	sim_get_stats(&before);
+	CHECK_EQ(stellaris_erase_async(0x8000, 0x20000), QIPROG_SUCCESS);
+	CHECK_EQ(sim_run_jobs(), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+
+	for (i = 0x8000; i < 0x20000; i++)
+		erased &= (sim_chip_mem(0)[i] == 0xff);
+	CHECK(erased);
+	CHECK_EQ(sim_chip_mem(0)[0x7fff], 0);
+	CHECK_EQ(sim_chip_mem(0)[0x20000], 0);
+	CHECK_EQ(d.erases, 8 + 1);
+	CHECK(d.time_ns >= 9 * 25000000ULL);
+
+	/* The whole chip, with a single command */
+	sim_get_stats(&before);
+	CHECK_EQ(stellaris_erase_async(0, 1024 * 1024), QIPROG_SUCCESS);
+	CHECK_EQ(sim_run_jobs(), QIPROG_SUCCESS);
+	sim_get_stats(&after);
+	sim_stats_sub(&d, &after, &before);
+	CHECK_EQ(d.erases, 1);
+	CHECK_EQ(sim_chip_mem(0)[0], 0xff);
+	CHECK(d.time_ns >= 100000000ULL);
+}
+
+int main(void)
+{
+	test_probe();
+	test_cfi();
+	test_read();
+	test_fwh_burst();
+	test_sync();
+	test_program_dq7();
+	test_program_queue_full();
+	test_program_toggle();
+	test_program_slow();
+	test_program_tbp();
+	test_usb_overlap();
+	test_diff_write();
+	test_diff_patch();
+	test_gang();
+	test_erase();
+	test_aamux();
+
+	return test_result("test_sim");
+}
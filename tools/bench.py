@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+#
+# This file is part of the vultureprog project.
+#
+# Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""Time the bus primitives of a vultureprog, and catch regressions.
+
+The firmware times lpc_mread(), lpc_mwrite() and chip reads with the DWT cycle
+counter, see bench.c. This asks it to do so, and writes the cycles per byte of
+each to a JSON file. A chip must have been probed first, for example by
+reading its ID with the host tools.
+
+Cycles per byte depend on the core clock, and on whether profiling is built
+in, so the baseline keeps one set of numbers for each. The first run of a
+given clock and build records its numbers. Later runs fail if any metric takes
+more than the threshold, in percent, over the baseline. With --clocks, the
+benchmark is run at each of the given core clocks in turn, and the board is
+switched back to the clock it was at.
+
+With --sim, no board is needed. The given program, tests/sim_bench, runs the
+driver against simulated chips, and prints GPIO stores and loads, and LPC
+clocks, per byte. Those are compared instead of cycles, under the key "sim".
+
+Usage: bench.py [--output bench.json] [--baseline bench-baseline.json]
+                [--threshold 5] [--update-baseline] [--clocks 80,40|all]
+                [--sim tests/sim_bench]
+
+Needs pyusb, unless --sim is given.
+"""
+
+import argparse
+import json
+import os
+import struct
+import subprocess
+import sys
+import time
+
+USB_VID = 0x1d50
+USB_PID = 0x6076
+
+REQ_TYPE_OUT = 0x40
+REQ_TYPE_IN = 0xc0
+
+VULTUREPROG_RUN_BENCH = 0xd2
+VULTUREPROG_GET_BENCH_RESULT = 0xd3
+VULTUREPROG_SET_CLOCK = 0xd7
+VULTUREPROG_GET_CLOCK = 0xd8
+
+BENCH_BUSY = 1
+BENCH_DONE = 2
+
+# In the order of enum bench_metric
+METRICS = ['lpc_mread', 'lpc_mwrite', 'read']
+
+FLAG_NAMES = {1 << 0: 'profile', 1 << 1: 'wave'}
+
+# In the order of enum stellaris_clock
+CLOCKS = ['80', '57', '40', '20', '16', '16-mosc']
+
+# What is compared, on the board and on the simulated bus
+BOARD_FIELDS = ['cycles_per_byte']
+SIM_FIELDS = ['stores_per_byte', 'loads_per_byte', 'clocks_per_byte']
+
+TIMEOUT_S = 10
+
+
+def get_clock(dev):
+    """The name of the core clock in effect"""
+    data = bytes(dev.ctrl_transfer(REQ_TYPE_IN, VULTUREPROG_GET_CLOCK, 0, 0,
+                                   8))
+    return CLOCKS[struct.unpack('<II', data)[0]]
+
+
+def set_clock(dev, name):
+    """Switch the core clock, and wait for the firmware to do it"""
+    clk = CLOCKS.index(name)
+    dev.ctrl_transfer(REQ_TYPE_OUT, VULTUREPROG_SET_CLOCK, clk, 0, None)
+
+    deadline = time.time() + TIMEOUT_S
+    while True:
+        if get_clock(dev) == name:
+            return
+        if time.time() > deadline:
+            sys.exit('Clock did not change to %s MHz' % name)
+        time.sleep(0.05)
+
+
+def parse_clocks(arg):
+    if arg == 'all':
+        return list(CLOCKS)
+    names = arg.split(',')
+    for name in names:
+        if name not in CLOCKS:
+            sys.exit('Unknown clock %s, pick from %s' %
+                     (name, ', '.join(CLOCKS)))
+    return names
+
+
+def run_bench(dev):
+    """Run the benchmark on the board, and return its raw results"""
+    dev.ctrl_transfer(REQ_TYPE_OUT, VULTUREPROG_RUN_BENCH, 0, 0, None)
+
+    size = 16 + 8 * len(METRICS)
+    deadline = time.time() + TIMEOUT_S
+    while True:
+        data = bytes(dev.ctrl_transfer(REQ_TYPE_IN,
+                                       VULTUREPROG_GET_BENCH_RESULT, 0, 0,
+                                       size))
+        words = struct.unpack('<%dI' % (len(data) // 4), data)
+        state, error, core_hz, flags = words[:4]
+        if state != BENCH_BUSY:
+            break
+        if time.time() > deadline:
+            sys.exit('Benchmark did not finish')
+        time.sleep(0.05)
+
+    if state != BENCH_DONE:
+        sys.exit('Benchmark failed with error %d. Was a chip probed?' % error)
+
+    metrics = {}
+    for i, name in enumerate(METRICS):
+        nbytes, cycles = words[4 + 2 * i:6 + 2 * i]
+        metrics[name] = {
+            'bytes': nbytes,
+            'cycles': cycles,
+            'cycles_per_byte': cycles / nbytes if nbytes else 0,
+        }
+
+    return {
+        'core_hz': core_hz,
+        'flags': [n for bit, n in sorted(FLAG_NAMES.items()) if flags & bit],
+        'metrics': metrics,
+    }
+
+
+def run_sim(prog):
+    """Run the benchmark on the simulated bus, and return its results"""
+    proc = subprocess.run([prog], stdout=subprocess.PIPE)
+    if proc.returncode:
+        sys.exit('%s failed' % prog)
+    return json.loads(proc.stdout.decode())
+
+
+def run_board(args):
+    """Run the benchmark on the board, at each clock asked for"""
+    import usb.core
+
+    dev = usb.core.find(idVendor=USB_VID, idProduct=USB_PID)
+    if dev is None:
+        sys.exit('No vultureprog found')
+
+    results = {}
+    initial = get_clock(dev)
+    clocks = parse_clocks(args.clocks) if args.clocks else [initial]
+    for name in clocks:
+        set_clock(dev, name)
+        result = run_bench(dev)
+        results[config_key(result)] = result
+    set_clock(dev, initial)
+
+    return results
+
+
+def config_key(result):
+    """Numbers are only comparable for the same clock and build options"""
+    return '+'.join(['%dHz' % result['core_hz']] + result['flags'])
+
+
+def load_json(path):
+    if not os.path.exists(path):
+        return {}
+    with open(path) as f:
+        return json.load(f)
+
+
+def save_json(path, obj):
+    with open(path, 'w') as f:
+        json.dump(obj, f, indent=2, sort_keys=True)
+        f.write('\n')
+
+
+def compare(result, base, threshold, fields):
+    """Print how each metric compares, and return the names of regressions"""
+    regressed = []
+    for name in result['metrics']:
+        if name not in base['metrics']:
+            print('%-12s %-16s %10s' % (name, '', 'new'))
+            continue
+        for field in fields:
+            new = result['metrics'][name][field]
+            old = base['metrics'][name][field]
+            change = (new - old) * 100.0 / old if old else 0.0
+            verdict = ''
+            if change > threshold:
+                verdict = '  REGRESSION'
+                regressed.append('%s %s' % (name, field))
+            print('%-12s %-16s %10.2f %10.2f %+7.1f%%%s' %
+                  (name, field, old, new, change, verdict))
+    return regressed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--output', default='bench.json',
+                        help='where to write the results')
+    parser.add_argument('--baseline', default='bench-baseline.json',
+                        help='results to compare against')
+    parser.add_argument('--threshold', type=float, default=5,
+                        help='allowed increase in cycles per byte, in percent')
+    parser.add_argument('--update-baseline', action='store_true',
+                        help='replace the baseline with this run')
+    parser.add_argument('--clocks',
+                        help='core clocks in MHz to run at, or "all"')
+    parser.add_argument('--sim', metavar='PROG',
+                        help='benchmark the simulated bus with PROG instead')
+    args = parser.parse_args()
+
+    if args.sim:
+        results = {'sim': run_sim(args.sim)}
+        fields = SIM_FIELDS
+    else:
+        results = run_board(args)
+        fields = BOARD_FIELDS
+    save_json(args.output, results)
+
+    baseline = load_json(args.baseline)
+    failed = False
+    for key, result in sorted(results.items()):
+        if args.update_baseline or key not in baseline:
+            baseline[key] = result
+            save_json(args.baseline, baseline)
+            print('Recorded baseline for %s in %s' % (key, args.baseline))
+            continue
+
+        print('%s, per byte:' % key)
+        print('%-12s %-16s %10s %10s %8s' %
+              ('', '', 'baseline', 'now', 'change'))
+        regressed = compare(result, baseline[key], args.threshold, fields)
+        if regressed:
+            print('%s regressed by more than %g%%' %
+                  (', '.join(regressed), args.threshold))
+            failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+#
+# This file is part of the vultureprog project.
+#
+# Copyright (C) 2013 Alexandru Gagniuc <mr.nuke.me@gmail.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""Decode the binary console log of firmware built with CONFIG_BINARY_LOG.
+
+Each message is a frame of 0xa5, the number of arguments, the address of the
+format string, a timestamp in microseconds, and the arguments, all as
+little-endian 32-bit words. Format strings, and strings passed with %s, are
+read from the ELF file the firmware was built from. Anything outside of frames
+is passed through as text.
+
+Usage: decode_log.py stellaris.elf [capture]
+
+The capture defaults to stdin. To decode a live console, set up the port with
+stty first, e.g. 'stty -F /dev/ttyACM0 921600 raw', and pass the device.
+"""
+
+import re
+import struct
+import sys
+
+FRAME_MAGIC = 0xa5
+MAX_ARGS = 8
+
+SHT_PROGBITS = 1
+SHF_ALLOC = 0x2
+
+FORMAT_SPEC = re.compile(
+    r'%([-+ #0]*)(\d+|\*)?(?:\.(\d+|\*))?(hh|h|ll|l|z|j|t)?([diouxXcsp%])')
+
+
+class Image:
+    """The loadable sections of a 32-bit little-endian ELF file"""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            elf = f.read()
+        if elf[:4] != b'\x7fELF' or elf[4] != 1 or elf[5] != 1:
+            raise ValueError('%s is not a 32-bit little-endian ELF' % path)
+
+        shoff, = struct.unpack_from('<I', elf, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', elf, 0x2e)
+        self.sections = []
+        for i in range(shnum):
+            (_, sh_type, flags, addr, offset,
+             size) = struct.unpack_from('<IIIIII', elf, shoff + i * shentsize)
+            if sh_type == SHT_PROGBITS and flags & SHF_ALLOC and addr:
+                self.sections.append((addr, elf[offset:offset + size]))
+
+    def string(self, addr):
+        """The C string at 'addr', or None if it is not in the image"""
+        for base, data in self.sections:
+            if base <= addr < base + len(data):
+                end = data.find(b'\0', addr - base)
+                if end < 0:
+                    return None
+                return data[addr - base:end].decode('latin-1')
+        return None
+
+
+def format_message(image, fmt, args):
+    """Do what printf() would have done with the raw argument words"""
+    args = list(args)
+
+    def convert(match):
+        flags, width, precision, _, conv = match.groups()
+        if conv == '%':
+            return '%'
+        if width == '*':
+            width = str(args.pop(0) if args else 0)
+        if precision == '*':
+            precision = str(args.pop(0) if args else 0)
+        val = args.pop(0) if args else 0
+        spec = '%' + flags + (width or '')
+        if precision is not None:
+            spec += '.' + precision
+
+        if conv in 'di':
+            return (spec + 'd') % struct.unpack('<i', struct.pack('<I', val))
+        if conv == 'c':
+            return (spec + 'c') % chr(val & 0xff)
+        if conv == 's':
+            text = image.string(val)
+            return (spec + 's') % (text if text is not None
+                                   else '<0x%08x>' % val)
+        if conv == 'p':
+            return '0x%08x' % val
+        return (spec + conv) % val
+
+    return FORMAT_SPEC.sub(convert, fmt)
+
+
+def decode(image, stream, out):
+    data = b''
+    text = ''
+    while True:
+        chunk = stream.read(1)
+        if not chunk:
+            break
+        data += chunk
+
+        while data:
+            if data[0] != FRAME_MAGIC:
+                text += chr(data[0])
+                data = data[1:]
+                if text.endswith('\n'):
+                    out.write(text.replace('\r', ''))
+                    out.flush()
+                    text = ''
+                continue
+
+            if len(data) < 2:
+                break
+            nargs = data[1]
+            if nargs > MAX_ARGS:
+                # Not a frame after all
+                text += chr(data[0])
+                data = data[1:]
+                continue
+            size = 10 + 4 * nargs
+            if len(data) < size:
+                break
+
+            addr, stamp = struct.unpack_from('<II', data, 2)
+            fmt = image.string(addr)
+            if fmt is None:
+                text += chr(data[0])
+                data = data[1:]
+                continue
+
+            args = struct.unpack_from('<%dI' % nargs, data, 10)
+            data = data[size:]
+            msg = format_message(image, fmt, args)
+            out.write('[%6u.%06u] %s' % (stamp // 1000000, stamp % 1000000,
+                                          msg))
+            out.flush()
+
+    if text:
+        out.write(text)
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.stderr.write(__doc__)
+        return 1
+
+    image = Image(sys.argv[1])
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], 'rb', buffering=0) as stream:
+            decode(image, stream, sys.stdout)
+    else:
+        decode(image, sys.stdin.buffer, sys.stdout)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())